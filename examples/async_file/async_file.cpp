@@ -0,0 +1,44 @@
+//#define TINYASYNC_TRACE
+#ifndef TINYASYNC_BASICS_H
+#include <tinyasync/tinyasync.h>
+#endif
+
+using namespace tinyasync;
+
+Task<> copy_file(IoContext &ctx, char const *from, char const *to)
+{
+    AsyncFile src(ctx, from, O_RDONLY);
+    AsyncFile dst(ctx, to, O_WRONLY | O_CREAT | O_TRUNC);
+
+    char buf[4096];
+    off_t offset = 0;
+    for(;;) {
+        std::size_t nread = co_await src.async_read_at(buf, sizeof(buf), offset);
+        if(nread == 0) {
+            break;
+        }
+        std::size_t nwrite = 0;
+        for(; nwrite < nread; ) {
+            nwrite += co_await dst.async_write_at(buf + nwrite, nread - nwrite, offset + nwrite);
+        }
+        offset += nread;
+    }
+    co_await dst.async_fsync();
+    printf("copy %s -> %s: %lld bytes\n", from, to, (long long)offset);
+
+    ctx.request_abort();
+}
+
+int main(int argc, char *argv[])
+{
+    char const *from = argc > 1 ? argv[1] : argv[0];
+    char const *to = argc > 2 ? argv[2] : "async_file.copy";
+
+    FileWorkers::instance().add_workers(2);
+
+    IoContext ctx;
+    co_spawn(copy_file(ctx, from, to));
+    ctx.run();
+
+    printf("all done\n");
+}
@@ -35,6 +35,17 @@ Task<uint64_t> task(StackfulPool &sp, uint64_t n)
 
 }
 
+// linear co_await chain
+// stack depth is constant because of symmetric transfer
+Task<uint64_t> chain(uint64_t n)
+{
+	if(n == 0) {
+		co_return 0;
+	}
+	auto c = co_await chain(n - 1);
+	co_return c + 1;
+}
+
 uint64_t n_call(uint64_t n)
 {
 	if(n == 0) {
@@ -190,6 +201,17 @@ int main(int argc, char *[])
 		return total;
     }, nCreate, N, "task(stackful pool)");
 
+	{
+		// deeper than any native stack could hold without symmetric transfer
+		uint64_t depth = 1000*1000;
+		auto t0 = std::chrono::high_resolution_clock::now();
+		Task<uint64_t> gen = chain(depth);
+		gen.resume();
+		auto t1 = std::chrono::high_resolution_clock::now();
+		auto d = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+		printf("%30s: %f ns/await (depth %d)\n", "task(chain)", double(1. * d / depth), (int)gen.result());
+	}
+
     timeit([&]() { 
 		VC vc;
 		uint64_t total = 0;
@@ -0,0 +1,85 @@
+//#define TINYASYNC_TRACE
+#ifndef TINYASYNC_BASICS_H
+#include <tinyasync/tinyasync.h>
+#endif
+
+using namespace tinyasync;
+
+// cpu heavy work, should not run in the ctx thread
+uint64_t hash(uint64_t seed, int rounds)
+{
+    uint64_t h = seed;
+    for(int i = 0; i < rounds; ++i) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+    }
+    return h;
+}
+
+Task<> hash_one(IoContext &ctx, BlockingExecutor &executor, uint64_t seed, uint64_t &out)
+{
+    out = co_await executor.run(ctx, [seed]() {
+        return hash(seed, 100000);
+    });
+}
+
+Task<> test(IoContext &ctx, BlockingExecutor &executor)
+{
+    // more tasks than the queues can hold, the rest are parked until a slot is free
+    int const n = 2000;
+    std::vector<uint64_t> results(n);
+    std::vector<Task<> > tasks;
+    for(int i = 0; i < n; ++i) {
+        tasks.push_back(hash_one(ctx, executor, i, results[i]));
+        tasks.back().resume();
+    }
+    printf("%zu submitters parked\n", executor.parked());
+    for(auto &task : tasks) {
+        co_await task.join();
+    }
+
+    int wrong = 0;
+    for(int i = 0; i < n; ++i) {
+        if(results[i] != hash(i, 100000)) {
+            ++wrong;
+        }
+    }
+    printf("%d tasks, %d wrong\n", n, wrong);
+
+    // now we are resumed by ctx.run(), ctx can be omitted
+    int sum = co_await executor.run([]() {
+        return 1 + 2;
+    });
+    printf("1 + 2 = %d\n", sum);
+
+    // exception is rethrown in the awaiting coroutine
+    try {
+        co_await executor.run(ctx, []() {
+            throw std::runtime_error("oops");
+        });
+    } catch(std::exception &e) {
+        printf("caught: %s\n", e.what());
+    }
+
+    ctx.request_abort();
+}
+
+int main()
+{
+    BlockingExecutor executor;
+    executor.add_workers(4);
+
+    IoContext ctx;
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+
+    co_spawn(test(ctx, executor));
+    ctx.run();
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    auto d = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0);
+
+    printf("%d ms\n", (int)d.count());
+    printf("all done\n");
+}
@@ -0,0 +1,184 @@
+// 很多小消息: 每条消息一次 async_read/async_send vs BufferedConnection
+// 客户端一次发 batch 个请求 "GET 00000001\n", 再收 batch 个回复 "OK 00000001\n"
+// plain: 两边每个请求/回复都是单独的 send, 服务端按定长一条一条读
+// buffered: 两边都用 BufferedConnection, 读一次 recv 读很多条, 写在一轮 run loop 里合并成一次 send
+//
+// buffered_connection [batches] [batch]
+
+#include <tinyasync/tinyasync.h>
+
+using namespace tinyasync;
+
+constexpr std::size_t k_request_size = 13;
+constexpr std::size_t k_response_size = 12;
+
+struct Counters
+{
+    uint64_t m_reads = 0;
+    uint64_t m_sends = 0;
+    // clients and servers still running
+    int m_running = 0;
+};
+
+void finish(IoContext &ctx, Counters &counters)
+{
+    if(--counters.m_running == 0) {
+        ctx.request_abort();
+    }
+}
+
+Task<bool> read_exactly(Connection &conn, char *buf, std::size_t bytes, Counters &counters)
+{
+    while(bytes) {
+        std::size_t nread = co_await conn.async_read(buf, bytes);
+        ++counters.m_reads;
+        if(!nread) {
+            co_return false;
+        }
+        buf += nread;
+        bytes -= nread;
+    }
+    co_return true;
+}
+
+Task<> send_exactly(Connection &conn, char const *buf, std::size_t bytes, Counters &counters)
+{
+    while(bytes) {
+        std::size_t sent = co_await conn.async_send(buf, bytes);
+        ++counters.m_sends;
+        buf += sent;
+        bytes -= sent;
+    }
+}
+
+Task<> plain_server(IoContext &ctx, Connection conn, Counters &counters, Name = "plain_server")
+{
+    char req[k_request_size + 1];
+    char resp[k_response_size + 1];
+    while(co_await read_exactly(conn, req, k_request_size, counters)) {
+        snprintf(resp, sizeof(resp), "OK %.8s\n", req + 4);
+        co_await send_exactly(conn, resp, k_response_size, counters);
+    }
+    finish(ctx, counters);
+}
+
+Task<> plain_client(IoContext &ctx, Endpoint endpoint, int batches, int batch, Counters &counters, Name = "plain_client")
+{
+    Connection conn = co_await async_connect(ctx, Protocol::ip_v4(), endpoint);
+    // otherwise Nagle and delayed ack stall the small sends
+    conn.set_tcp_no_delay();
+    char req[k_request_size + 1];
+    char resp[k_response_size + 1];
+    for(int b = 0; b < batches; ++b) {
+        for(int i = 0; i < batch; ++i) {
+            snprintf(req, sizeof(req), "GET %08u\n", (unsigned)i % 100000000u);
+            co_await send_exactly(conn, req, k_request_size, counters);
+        }
+        for(int i = 0; i < batch; ++i) {
+            if(!co_await read_exactly(conn, resp, k_response_size, counters)) {
+                throw_error("connection closed", 0);
+            }
+        }
+    }
+    // the server sees eof and finishes too
+    conn.safe_close();
+    finish(ctx, counters);
+}
+
+void add_stats(Counters &counters, BufferedStats const &stats)
+{
+    counters.m_reads += stats.m_reads;
+    counters.m_sends += stats.m_sends;
+}
+
+Task<> buffered_server(IoContext &ctx, Connection conn_, Counters &counters, Name = "buffered_server")
+{
+    BufferedConnection conn(ctx, std::move(conn_));
+    char resp[k_response_size + 1];
+    for(;;) {
+        std::string_view line = co_await conn.async_read_line();
+        if(line.empty()) {
+            break;
+        }
+        snprintf(resp, sizeof(resp), "OK %.8s\n", line.data() + 4);
+        co_await conn.async_write(resp, k_response_size);
+    }
+    co_await conn.async_flush();
+    add_stats(counters, conn.stats());
+    finish(ctx, counters);
+}
+
+Task<> buffered_client(IoContext &ctx, Endpoint endpoint, int batches, int batch, Counters &counters, Name = "buffered_client")
+{
+    BufferedConnection conn(ctx, co_await async_connect(ctx, Protocol::ip_v4(), endpoint));
+    conn.connection().set_tcp_no_delay();
+    char req[k_request_size + 1];
+    for(int b = 0; b < batches; ++b) {
+        for(int i = 0; i < batch; ++i) {
+            snprintf(req, sizeof(req), "GET %08u\n", (unsigned)i % 100000000u);
+            co_await conn.async_write(req, k_request_size);
+        }
+        for(int i = 0; i < batch; ++i) {
+            std::string_view line = co_await conn.async_read_line();
+            if(line.size() != k_response_size) {
+                throw_error("bad response", 0);
+            }
+        }
+    }
+    add_stats(counters, conn.stats());
+    conn.connection().safe_close();
+    finish(ctx, counters);
+}
+
+Task<> listen(IoContext &ctx, Acceptor &acceptor, bool buffered, Counters &counters, Name = "listen")
+{
+    for(;;) {
+        Connection conn = co_await acceptor.async_accept();
+        conn.set_tcp_no_delay();
+        if(buffered) {
+            co_spawn(buffered_server(ctx, std::move(conn), counters));
+        } else {
+            co_spawn(plain_server(ctx, std::move(conn), counters));
+        }
+    }
+}
+
+void run(bool buffered, int batches, int batch, uint16_t port)
+{
+    int const clients = 4;
+    Counters counters;
+    counters.m_running = 2 * clients;
+    IoContext ctx(std::false_type{});
+    Endpoint endpoint(Address(INADDR_LOOPBACK), port);
+    Acceptor acceptor(ctx, Protocol::ip_v4(), endpoint);
+    co_spawn(listen(ctx, acceptor, buffered, counters));
+    for(int i = 0; i < clients; ++i) {
+        if(buffered) {
+            co_spawn(buffered_client(ctx, endpoint, batches, batch, counters));
+        } else {
+            co_spawn(plain_client(ctx, endpoint, batches, batch, counters));
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    ctx.run();
+    double d = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double msgs = (double)clients * batches * batch;
+    printf("%-9s %6d %12.0f %12.3f %12.3f\n", buffered ? "buffered" : "plain", batch,
+        msgs / d, counters.m_reads / msgs, counters.m_sends / msgs);
+}
+
+int main(int argc, char *argv[])
+{
+    int batches = argc > 1 ? atoi(argv[1]) : 2000;
+    int batch = argc > 2 ? atoi(argv[2]) : 32;
+    try {
+        printf("%-9s %6s %12s %12s %12s\n", "mode", "batch", "msgs/s", "reads/msg", "sends/msg");
+        run(false, batches, batch, 8907);
+        run(true, batches, batch, 8908);
+    } catch(...) {
+        printf("%s\n", to_string(std::current_exception()).c_str());
+        return 1;
+    }
+    return 0;
+}
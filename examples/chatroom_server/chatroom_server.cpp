@@ -7,20 +7,26 @@
 
 using namespace tinyasync;
 
-Task<size_t> async_send_all(Connection &conn, void const *buffer, size_t bytes)
+// 消息放在 IoBuf 里, 广播时每个成员拿一个 clone, 数据只有一份
+IoBuf make_msg(std::string const &str)
 {
-    size_t sent = 0;
-    for(;bytes;) {
+    return IoBuf::copy_buffer(ConstBuffer((std::byte const *)str.data(), str.size()));
+}
 
-        auto nsend = co_await conn.async_send(buffer, bytes);
-        if(nsend == 0) {
-            break;
+// 链上第一个 '\n' 的位置, 没有返回 npos
+std::size_t find_newline(IoBuf const &chain)
+{
+    std::size_t offset = 0;
+    for(IoBuf const *p = &chain; p; p = p->next()) {
+        auto begin = (char const *)p->data();
+        auto end = begin + p->size();
+        auto it = std::find(begin, end, '\n');
+        if(it != end) {
+            return offset + (it - begin);
         }
-        sent += nsend;
-        bytes -= nsend;
-        (char const *&)buffer += nsend;
+        offset += p->size();
     }
-    co_return sent;
+    return std::string::npos;
 }
 
 std::atomic_uint64_t g_id = 0;
@@ -41,7 +47,7 @@ struct Part
 
 
     Mutex m_msg_mtx;
-    std::queue<std::string> m_messages;
+    std::queue<IoBuf> m_messages;
     ConditionVariable m_msg_condv; // ??
 
     Part(ChatRoomServer &server, Connection conn);
@@ -58,7 +64,7 @@ struct Part
     }
 
     // 加入信息
-    void post_msg(std::string msg)
+    void post_msg(IoBuf msg)
     {
         m_messages.push(std::move(msg));
         m_msg_condv.notify_all();
@@ -82,22 +88,23 @@ public:
     IoContext *m_ctx = &m_ctx_;
     std::list<Part> m_clients;
     Mutex m_mtx;
+    IoBuf m_received = make_msg("**** server received ****\n");
 
     ChatRoomServer()  {
 
     }
 
-    //广播消息,每一具client都加入消息
-    Task<> broadcast(Part *client, std::string const &msg)
+    //广播消息,每一具client都加入消息, 只增加引用计数, 不拷贝
+    Task<> broadcast(Part *client, IoBuf const &msg)
     {
         co_await m_mtx.lock(*m_ctx);
         auto m_mtx_ = auto_unlock(m_mtx);
 
         for(auto &c: m_clients) {
             if(client != &c)
-                c.post_msg(msg);
+                c.post_msg(msg.clone());
             else
-                c.post_msg("**** server received ****\n");
+                c.post_msg(m_received.clone());
         }
     }
 
@@ -159,14 +166,12 @@ Part::Part(ChatRoomServer &server, Connection conn) :
 Task<> Part::listen() {
 
     auto *client = this;
-    auto &conn = client->m_conn;
-    std::string buffer;
+    // 收到还没有切出去的数据, buffer 来自 IoContext 的 BufferPool
+    IoBuf pending;
     for (;;)
     {
-        char sb[1000];
-
         printf("read...\n");
-        auto nread = co_await client->m_conn.async_read(sb, sizeof(sb));
+        auto nread = co_await client->m_conn.async_read_append(pending);
         printf("read end\n");
 
         if (nread == 0)
@@ -174,21 +179,14 @@ Task<> Part::listen() {
             break;
         }
 
-        char *end = sb + nread;
-        char *break_ = std::find(sb, end, '\n');
-
-        if (break_ != end)
+        for(std::size_t pos; (pos = find_newline(pending)) != std::string::npos;)
         {
-            std::string output = std::move(buffer);
-            output.append(sb, break_);
-            buffer.assign(break_+1, end); // +1 skip \n
-            std::string msg = client->m_name + ": " + output + "\n";
+            // 名字一节, 后面接上这一行 (包括 \n) 的 slice
+            IoBuf msg = make_msg(client->m_name + ": ");
+            msg.append_chain(pending.slice(0, pos + 1));
+            pending = pending.slice(pos + 1, pending.chain_size() - pos - 1);
             co_await m_chatroom->broadcast(client, msg);
         }
-        else
-        {
-            buffer.append(sb, break_);
-        }
     }
 }
 
@@ -201,14 +199,14 @@ Task<> Part::send() {
             co_await m_msg_condv.wait(m_msg_mtx);
             printf("!");
         }
-        std::string msg = std::move(m_messages.back());
+        IoBuf msg = std::move(m_messages.front());
         m_messages.pop();
         m_msg_mtx.unlock();
 
-        printf("%s sending\n", msg.c_str());
-        size_t nsent = co_await async_send_all(m_conn, msg.data(), msg.size());
+        printf("%d bytes in %d buffers sending\n", (int)msg.chain_size(), (int)msg.chain_count());
+        size_t nsent = co_await m_conn.async_sendv(msg);
         printf("%d bytes sent\n", (int)nsent);
-        if(nsent < msg.size()) {
+        if(nsent < msg.chain_size()) {
             printf("send error\n");
             break;
         }
@@ -221,7 +219,7 @@ Task<> Part::start() {
 
     auto *client = this;
 
-    co_await m_chatroom->broadcast(client, "Welcome " + client->m_name + "\n");
+    co_await m_chatroom->broadcast(client, make_msg("Welcome " + client->m_name + "\n"));
     co_spawn(client->listen());
     co_await send();
 
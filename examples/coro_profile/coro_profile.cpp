@@ -0,0 +1,76 @@
+#define TINYASYNC_CORO_PROFILE
+#ifndef TINYASYNC_BASICS_H
+#include <tinyasync/tinyasync.h>
+#endif
+
+using namespace tinyasync;
+
+// frames from the pool
+Task<uint64_t> fib(StackfulPool &sp, uint64_t n, Name = "fib")
+{
+	if(n < 2) {
+		co_return 1;
+	}
+	auto c1 = co_await fib(sp, n - 1);
+	auto c2 = co_await fib(sp, n - 2);
+	co_return c1 + c2;
+}
+
+// running, not suspended
+Task<uint64_t> parse(int id, Name = "parse")
+{
+	uint64_t h = id;
+	for(int i = 0; i < 100000; ++i) {
+		h = h * 31 + i;
+	}
+	co_return h;
+}
+
+// no name, reported as <unnamed:frame size>
+Task<> wait_a_little(IoContext &ctx)
+{
+	co_await async_sleep(ctx, std::chrono::milliseconds(1));
+}
+
+// mostly suspended
+Task<> handler(IoContext &ctx, int id, uint64_t &sum, Name = "handler")
+{
+	char big_local[4096];
+	for(int i = 0; i < 5; ++i) {
+		co_await async_sleep(ctx, std::chrono::milliseconds(2));
+		big_local[i] = (char)(co_await parse(id));
+		co_await wait_a_little(ctx);
+	}
+	sum += big_local[0];
+}
+
+Task<> test(IoContext &ctx)
+{
+	StackfulPool sp(1024 * 1024);
+	auto n = co_await fib(sp, 20);
+	printf("fib(20) = %d\n", (int)n);
+
+	uint64_t sum = 0;
+	std::vector<Task<> > tasks;
+	for(int i = 0; i < 100; ++i) {
+		tasks.push_back(handler(ctx, i, sum));
+		tasks.back().resume();
+	}
+	for(auto &task : tasks) {
+		co_await task.join();
+	}
+	ctx.request_abort();
+}
+
+int main()
+{
+	IoContext ctx;
+	co_spawn(test(ctx));
+	ctx.run();
+
+	printf("\nsorted by peak bytes:\n");
+	coro_profile_report(stdout, CoroProfileSort::PeakBytes);
+	printf("\nsorted by running time:\n");
+	coro_profile_report(stdout, CoroProfileSort::RunningTime);
+	printf("all done\n");
+}
@@ -0,0 +1,77 @@
+// 协程帧的内存: 第一个参数是 IoContext & 的协程从 ctx 的 resource 申请
+// 单线程 ctx 默认自己有一个 PoolResource, 多线程 ctx 默认用全局的 resource
+// 也可以用 set_memory_resource 换成别的 (new_delete, arena, ...)
+//
+// ctx_memory [rounds]
+
+#include <tinyasync/tinyasync.h>
+
+using namespace tinyasync;
+
+// frames of different sizes
+Task<uint64_t> leaf(IoContext &ctx, int depth)
+{
+    char local[64];
+    local[0] = (char)depth;
+    if(depth == 0) {
+        co_return local[0];
+    }
+    uint64_t r = co_await leaf(ctx, depth - 1);
+    co_return r + local[0];
+}
+
+Task<> batch(IoContext &ctx, int n, uint64_t &sum)
+{
+    for(int i = 0; i < n; ++i) {
+        sum += co_await leaf(ctx, i % 8);
+    }
+}
+
+void bench(char const *title, IoContext &ctx, int rounds, std::pmr::monotonic_buffer_resource *arena = nullptr)
+{
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < rounds; ++i) {
+        // co_spawn is eager, these coroutines never suspend
+        co_spawn(batch(ctx, 1000, sum));
+        if(arena) {
+            arena->release();
+        }
+    }
+    auto d = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    // 1000 leaf chains of 4.5 frames on average, plus the batch frame
+    double frames = rounds * (1000 * 4.5 + 1);
+    printf("%-28s %8.2f ns/frame (sum %llu)\n", title, d / frames, (unsigned long long)sum);
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+
+    {
+        IoContext ctx(std::false_type{});
+        bench("single thread (PoolResource)", ctx, rounds);
+    }
+    {
+        IoContext ctx(std::false_type{});
+        ctx.set_memory_resource(std::pmr::new_delete_resource());
+        bench("single thread (new_delete)", ctx, rounds);
+    }
+    {
+        // frames are only freed by release() after each round
+        std::pmr::monotonic_buffer_resource arena;
+        IoContext ctx(std::false_type{});
+        ctx.set_memory_resource(&arena);
+        bench("single thread (arena)", ctx, rounds, &arena);
+    }
+    {
+        IoContext ctx(std::true_type{});
+        bench("multiple thread (default)", ctx, rounds);
+    }
+    {
+        IoContext ctx(std::true_type{});
+        ctx.set_memory_resource(std::make_unique<std::pmr::synchronized_pool_resource>());
+        bench("multiple thread (sync pool)", ctx, rounds);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+//#define TINYASYNC_TRACE
+#ifndef TINYASYNC_BASICS_H
+#include <tinyasync/tinyasync.h>
+#endif
+
+#include <thread>
+#include <atomic>
+#include <set>
+
+using namespace tinyasync;
+
+// a stub dns server on 127.0.0.1, runs in its own thread
+//     *.test          A 10.0.0.1, A 10.0.0.2, AAAA fd00::1, ttl 2s
+//     missing.test    NXDOMAIN
+//     slow.test       the first packet of each type is dropped
+struct StubDnsServer
+{
+    int m_fd;
+    uint16_t m_port;
+    std::atomic<int> m_queries = 0;
+    // source ports of the queries, read after the client is done
+    std::set<uint16_t> m_ports;
+    std::atomic<bool> m_stop = false;
+    std::thread m_thread;
+    int m_slow_dropped = 0;
+
+    StubDnsServer()
+    {
+        m_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        if(::bind(m_fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+            throw_errno("stub: bind");
+        }
+        socklen_t len = sizeof(addr);
+        getsockname(m_fd, (sockaddr*)&addr, &len);
+        m_port = ntohs(addr.sin_port);
+
+        timeval tv = { 0, 100 * 1000 };
+        setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        m_thread = std::thread([this]() { serve(); });
+    }
+
+    ~StubDnsServer()
+    {
+        m_stop = true;
+        m_thread.join();
+        ::close(m_fd);
+    }
+
+    static void put16(std::string &out, uint16_t v)
+    {
+        out.push_back(char(v >> 8));
+        out.push_back(char(v & 0xff));
+    }
+
+    void serve()
+    {
+        for(; !m_stop;) {
+            uint8_t buf[512];
+            sockaddr_in peer;
+            socklen_t len = sizeof(peer);
+            auto n = recvfrom(m_fd, buf, sizeof(buf), 0, (sockaddr*)&peer, &len);
+            if(n < 12) {
+                continue;
+            }
+            m_queries += 1;
+            m_ports.insert(ntohs(peer.sin_port));
+
+            // question
+            std::string name;
+            std::size_t off = 12;
+            for(; off < (std::size_t)n && buf[off]; off += buf[off] + 1) {
+                if(!name.empty()) name.push_back('.');
+                name.append((char*)buf + off + 1, buf[off]);
+            }
+            off += 1;
+            uint16_t qtype = (buf[off] << 8) | buf[off + 1];
+            off += 4;
+
+            if(name == "slow.test" && m_slow_dropped < 2) {
+                ++m_slow_dropped;
+                continue;
+            }
+
+            std::string out((char*)buf, off);
+            out[2] = char(0x81);
+            bool nx = name == "missing.test";
+            out[3] = char(nx ? 0x83 : 0x80);
+            std::string answers;
+            int ancount = 0;
+            if(!nx) {
+                auto answer = [&](uint16_t type, void const *rdata, uint16_t rdlength) {
+                    // pointer to the question name
+                    put16(answers, 0xc00c);
+                    put16(answers, type);
+                    put16(answers, 1);
+                    put16(answers, 0);
+                    put16(answers, 2);
+                    put16(answers, rdlength);
+                    answers.append((char const*)rdata, rdlength);
+                    ++ancount;
+                };
+                if(qtype == 1) {
+                    uint8_t a1[4] = { 10, 0, 0, 1 };
+                    uint8_t a2[4] = { 10, 0, 0, 2 };
+                    answer(1, a1, 4);
+                    answer(1, a2, 4);
+                } else if(qtype == 28) {
+                    in6_addr a6;
+                    inet_pton(AF_INET6, "fd00::1", &a6);
+                    answer(28, &a6, 16);
+                }
+            }
+            out[6] = 0;
+            out[7] = char(ancount);
+            out += answers;
+            sendto(m_fd, out.data(), out.size(), 0, (sockaddr*)&peer, len);
+        }
+    }
+};
+
+void print_result(char const *name, DnsLookupResult const &res)
+{
+    printf("%20s ", name);
+    if(!res.ok()) {
+        printf("error: %s\n", dns_errc_string(res.errc()));
+        return;
+    }
+    for(auto &addr : res.addresses()) {
+        printf("%s ", addr.to_string().c_str());
+    }
+    printf("\n");
+}
+
+Task<> lookup1(DnsClient &client, char const *name)
+{
+    DnsLookupResult res = co_await client.lookup(name);
+    print_result(name, res);
+}
+
+Task<> test(IoContext &ctx, DnsClient &client, StubDnsServer &server)
+{
+    // ip literal and hosts, no packet
+    print_result("127.0.0.1", co_await client.lookup("127.0.0.1"));
+    print_result("myhost.local", co_await client.lookup("myhost.local"));
+
+    // 10 lookups of the same name share one A and one AAAA query
+    std::vector<Task<> > tasks;
+    for(int i = 0; i < 10; ++i) {
+        tasks.push_back(lookup1(client, "www.example.test"));
+        tasks.back().resume();
+    }
+    for(auto &task : tasks) {
+        co_await task.join();
+    }
+    printf("server got %d queries for 10 lookups\n", server.m_queries.load());
+
+    // from cache
+    print_result("WWW.Example.TEST.", co_await client.lookup("WWW.Example.TEST."));
+    printf("server got %d queries after cached lookup\n", server.m_queries.load());
+
+    print_result("missing.test", co_await client.lookup("missing.test"));
+    print_result("slow.test", co_await client.lookup("slow.test"));
+    print_result("bad..name", co_await client.lookup("bad..name"));
+
+    // ttl is 2s
+    co_await async_sleep(ctx, std::chrono::milliseconds(2100));
+    int before = server.m_queries.load();
+    print_result("www.example.test", co_await client.lookup("www.example.test"));
+    printf("expired: %d more queries\n", server.m_queries.load() - before);
+
+    auto stats = client.stats();
+    printf("lookups %d, hosts %d, cache %d, coalesced %d, sent %d, received %d, retransmits %d\n",
+        (int)stats.m_lookups, (int)stats.m_hosts_hits, (int)stats.m_cache_hits, (int)stats.m_coalesced,
+        (int)stats.m_packets_sent, (int)stats.m_packets_received, (int)stats.m_retransmits);
+
+    // every query (and every retry) comes from a fresh random port
+    printf("%d queries from %d source ports\n", server.m_queries.load(), (int)server.m_ports.size());
+
+    ctx.request_abort();
+}
+
+int main()
+{
+    StubDnsServer server;
+
+    IoContext ctx;
+
+    DnsConfig config;
+    config.add_nameserver(Endpoint(Address(INADDR_LOOPBACK), server.m_port));
+    config.m_timeout = std::chrono::milliseconds(200);
+    config.add_host("myhost.local", address_v4_from_string("192.168.1.10"));
+
+    DnsClient client(ctx, config);
+
+    co_spawn(test(ctx, client, server));
+    ctx.run();
+
+    printf("all done\n");
+}
@@ -0,0 +1,53 @@
+#define TINYASYNC_EVENT_TRACE
+#ifndef TINYASYNC_BASICS_H
+#include <tinyasync/tinyasync.h>
+#endif
+
+using namespace tinyasync;
+
+Task<> worker(IoContext &ctx, Mutex &mutex)
+{
+    for(int i = 0; i < 3; ++i) {
+        co_await mutex.lock(ctx);
+        co_await async_sleep(ctx, std::chrono::milliseconds(10));
+        mutex.unlock();
+    }
+}
+
+Task<> test(IoContext &ctx)
+{
+    Mutex mutex;
+    std::vector<Task<> > tasks;
+    for(int i = 0; i < 4; ++i) {
+        tasks.push_back(worker(ctx, mutex));
+        tasks.back().resume();
+    }
+    for(auto &task : tasks) {
+        co_await task.join();
+    }
+    ctx.request_abort();
+}
+
+int main(int argc, char *argv[])
+{
+    char const *path = argc > 1 ? argv[1] : "trace.json";
+
+    // cost of one event
+    int const n = 10 * 1000 * 1000;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < n; ++i) {
+        TINYASYNC_TRACE_EVENT(PostTask, i, nullptr);
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    auto d = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0);
+    printf("%.2f ns/event\n", double(d.count()) / n);
+
+    IoContext ctx;
+    co_spawn(test(ctx));
+    ctx.run();
+
+    if(trace_export_chrome_json(path)) {
+        printf("trace written to %s, open it in chrome://tracing or ui.perfetto.dev\n", path);
+    }
+    printf("all done\n");
+}
@@ -1,93 +1,109 @@
 //#define TINYASYNC_TRACE
 #include <tinyasync/tinyasync.h>
-#include <regex>
 
 using namespace tinyasync;
 
-void print(std::string const &s) {
+// > ./http_helloworld_server/http_helloworld_server
+// > ./http_client/http_client http://127.0.0.1:8899/ 1000 8
+// requests are sent by `concurrency` workers, connections are reused
 
-    for(auto c : s) {
-        
-        if(c == '\r') {
-            printf("\\r");
-        } else if(c == '\n') {
-            printf("\\n\n");
-        } else {
-            printf("%c", c);
+struct Options
+{
+    char const *url = "http://127.0.0.1:8899/";
+    int requests = 100;
+    int concurrency = 4;
+};
+
+Task<> worker(HttpClient &client, Options const &opts, int &remain, int &failed, Name = "worker")
+{
+    while(remain > 0) {
+        --remain;
+        try {
+            HttpClientResponse resp = co_await client.get(opts.url);
+            if(resp.m_status != 200) {
+                ++failed;
+            }
+        } catch(...) {
+            printf("%s\n", to_string(std::current_exception()).c_str());
+            ++failed;
         }
     }
 }
 
-Task<> do_download(IoContext &ctx, Name="download") {
-
-
-    char const *hostname = "www.baidu.com";
-    auto dns_result = co_await async_dns_resolve(ctx, hostname);
-    if(dns_result.native_errc()) {
-        printf("can't resolve hostname\n");
+Task<> do_download(IoContext &ctx, Options opts, Name = "download")
+{
+    HttpClientConfig config;
+    config.m_max_connections_per_host = opts.concurrency;
+    HttpClient client(ctx, config);
+
+    try {
+        HttpClientResponse resp = co_await client.get(opts.url);
+        printf("HTTP/1.%d %d %s\n", resp.m_version_minor, resp.m_status, resp.m_reason.c_str());
+        for(auto &h : resp.m_headers) {
+            printf("%s: %s\n", h.m_name.c_str(), h.m_value.c_str());
+        }
+        printf("\n%zu bytes of body\n", resp.m_body.size());
+    } catch(...) {
+        printf("%s\n", to_string(std::current_exception()).c_str());
+        ctx.request_abort();
         co_return;
     }
 
-    printf("ip: %s\n", dns_result.address().to_string().c_str());
-
-
-    Connection conn = co_await async_connect(ctx, Protocol::ip_v4(), Endpoint(dns_result.address(), 80));
-
-    std::string http_header =
-R"(GET / HTTP/1.1
-Host: HOSTNAME
-User-Agent: curl/7.71.1
-Connection: close
-Accept: */*
-
-)";
-
-    http_header = std::regex_replace(http_header, std::regex("\r?\n"), "\r\n");
-    http_header = std::regex_replace(http_header, std::regex("HOSTNAME"), hostname);
-    
-    char const *buf = http_header.data();
-    std::size_t remain = http_header.size();
-
-    print(http_header);
+    int remain = opts.requests;
+    int failed = 0;
+    int running = opts.concurrency;
+    Event done(ctx);
+    auto run_worker = [&]() -> Task<> {
+        co_await worker(client, opts, remain, failed);
+        if(--running == 0) {
+            done.notify_one();
+        }
+    };
 
-    // send request
-    for(;remain;) {
-        auto nbytes = co_await conn.async_send(buf, remain);
-        remain -= nbytes;
-        buf += nbytes;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < opts.concurrency; ++i) {
+        co_spawn(run_worker());
     }
-
-    // receive response
-    for(;;) {
-        char b[1000];
-        auto nbytes = co_await conn.async_read(b, sizeof(b)-1);
-        if(nbytes == 0) {
-            printf("server shutdown\n");
-            break;
-        }
-        b[nbytes] = '\0';
-        printf("%zu\n", nbytes);
-        //printf("%s", b);
+    if(running) {
+        co_await done;
     }
+    auto d = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto stats = client.stats();
+    printf("%d requests, %d failed, %.0f requests/s\n", opts.requests, failed, opts.requests / d);
+    printf("connects %llu, reuses %llu, retries %llu, waits %llu\n",
+        (unsigned long long)stats.m_connects,
+        (unsigned long long)stats.m_reuses,
+        (unsigned long long)stats.m_retries,
+        (unsigned long long)stats.m_waits);
 
+    client.close_idle();
     ctx.request_abort();
 }
 
-void download() {	
+void download(Options const &opts) {
 	TINYASYNC_GUARD("download():");
 
-	IoContext ctx;
-    co_spawn(do_download(ctx));
+	IoContext ctx(std::false_type{});
+    co_spawn(do_download(ctx, opts));
 
 	TINYASYNC_LOG("run");
 	ctx.run();
 }
 
 
-int main()
+int main(int argc, char *argv[])
 {
-	download();
+    Options opts;
+    if(argc > 1) {
+        opts.url = argv[1];
+    }
+    if(argc > 2) {
+        opts.requests = atoi(argv[2]);
+    }
+    if(argc > 3) {
+        opts.concurrency = std::max(1, atoi(argv[3]));
+    }
+	download(opts);
 	return 0;
 }
-
-
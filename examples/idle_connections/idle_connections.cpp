@@ -0,0 +1,134 @@
+// 大量空闲连接时接收 buffer 占的内存
+// buffer: 每个读协程先申请一个 16KB buffer 再 async_read, 挂起时一直占着
+// pooled: async_read_pooled, 挂起时不占 buffer, 数据到了才从 IoContext 的 BufferPool 拿
+// 连上以后所有连接都空闲, 看 RSS 涨了多少; 然后每个客户端发一条消息, 看 BufferPool 同时用了几个 buffer
+//
+// idle_connections [connections]
+
+#include <tinyasync/tinyasync.h>
+
+using namespace tinyasync;
+
+constexpr std::size_t k_buffer_size = 16 * 1024;
+
+long rss_kb()
+{
+    long kb = 0;
+    FILE *f = fopen("/proc/self/status", "r");
+    if(!f) {
+        return 0;
+    }
+    char line[256];
+    while(fgets(line, sizeof(line), f)) {
+        if(!strncmp(line, "VmRSS:", 6)) {
+            kb = atol(line + 6);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+struct State
+{
+    bool m_pooled;
+    int m_connections;
+    int m_connected = 0;
+    int m_messages = 0;
+    int m_closed = 0;
+};
+
+Task<> reader(Connection conn, State &state, Name = "reader")
+{
+    if(state.m_pooled) {
+        PooledBuffer buffer;
+        for(;;) {
+            std::size_t nread = co_await conn.async_read_pooled(buffer);
+            if(!nread) {
+                break;
+            }
+            state.m_messages += 1;
+            // done with the data, the buffer goes back to the pool
+            buffer.reset();
+        }
+    } else {
+        // a buffer from a pool is dirty, touch it
+        std::unique_ptr<char[]> buffer(new char[k_buffer_size]);
+        memset(buffer.get(), 0, k_buffer_size);
+        for(;;) {
+            std::size_t nread = co_await conn.async_read(buffer.get(), k_buffer_size);
+            if(!nread) {
+                break;
+            }
+            state.m_messages += 1;
+        }
+    }
+    state.m_closed += 1;
+}
+
+Task<> listen(Acceptor &acceptor, State &state, Name = "listen")
+{
+    for(int i = 0; i < state.m_connections; ++i) {
+        Connection conn = co_await acceptor.async_accept();
+        co_spawn(reader(std::move(conn), state));
+    }
+}
+
+Task<> clients(IoContext &ctx, Endpoint endpoint, State &state, long &idle_rss_kb)
+{
+    std::vector<Connection> conns;
+    long before = rss_kb();
+    for(int i = 0; i < state.m_connections; ++i) {
+        conns.push_back(co_await async_connect(ctx, Protocol::ip_v4(), endpoint));
+    }
+    // let the readers park
+    co_await async_sleep(ctx, std::chrono::milliseconds(100));
+    idle_rss_kb = rss_kb() - before;
+
+    char msg[128] = {};
+    for(auto &conn : conns) {
+        co_await conn.async_send(msg, sizeof(msg));
+    }
+    while(state.m_messages < state.m_connections) {
+        co_await async_sleep(ctx, std::chrono::milliseconds(10));
+    }
+    conns.clear();
+    while(state.m_closed < state.m_connections) {
+        co_await async_sleep(ctx, std::chrono::milliseconds(10));
+    }
+    ctx.request_abort();
+}
+
+void run(bool pooled, int connections, uint16_t port)
+{
+    State state;
+    state.m_pooled = pooled;
+    state.m_connections = connections;
+    long idle_rss_kb = 0;
+
+    IoContext ctx(std::false_type{});
+    ctx.buffer_pool().set_buffer_size(k_buffer_size);
+    Endpoint endpoint(Address(INADDR_LOOPBACK), port);
+    Acceptor acceptor(ctx, Protocol::ip_v4(), endpoint);
+    co_spawn(listen(acceptor, state));
+    co_spawn(clients(ctx, endpoint, state, idle_rss_kb));
+    ctx.run();
+
+    printf("%-8s %8d %14ld %14.1f %12zu\n", pooled ? "pooled" : "buffer", connections,
+        idle_rss_kb, (double)idle_rss_kb / connections, ctx.buffer_pool().peak_in_use());
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : 4000;
+    try {
+        printf("%-8s %8s %14s %14s %12s\n", "mode", "conns", "idle_rss_kb", "kb_per_conn", "pool_peak");
+        // pooled first, the heap of the buffer mode is not returned to the system
+        run(true, connections, 8905);
+        run(false, connections, 8906);
+    } catch(...) {
+        printf("%s\n", to_string(std::current_exception()).c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -16,7 +16,7 @@ const size_t align_size = 8;
 std::pmr::monotonic_buffer_resource mbr;
 #endif
 
-void test_memory_resource(char const *title, std::pmr::memory_resource *mr)
+void test_memory_resource(char const *title, std::pmr::memory_resource *mr, size_t size = test_size)
 {
 
     std::vector<void*> mem;
@@ -38,7 +38,7 @@ void test_memory_resource(char const *title, std::pmr::memory_resource *mr)
 
             auto t0 = std::chrono::high_resolution_clock::now();
             for(int i = 0; i < m; ++i) { //申请m次内存
-                void *p = mr->allocate(test_size, align_size);
+                void *p = mr->allocate(size, align_size);
                 mem[i] = p;
             }
             auto t1 = std::chrono::high_resolution_clock::now();
@@ -61,7 +61,7 @@ void test_memory_resource(char const *title, std::pmr::memory_resource *mr)
             for(int i = 0; i < m; ++i) //每一个内存都释放
             {
                 if(mem[i]) {
-                    mr->deallocate(mem[i], test_size, align_size);
+                    mr->deallocate(mem[i], size, align_size);
                     mem[i] = nullptr;
                 }
             }
@@ -78,7 +78,7 @@ void test_memory_resource(char const *title, std::pmr::memory_resource *mr)
     for(int i = 0; i < n; ++i)
     {
         if(mem[i]) { //这是应该不会执行的吧
-            mr->deallocate(mem[i], test_size);
+            mr->deallocate(mem[i], size, align_size);
             mem[i] = nullptr;
         }
     }
@@ -90,6 +90,34 @@ void test_memory_resource(char const *title, std::pmr::memory_resource *mr)
 }
 
 
+// 大 buffer: 每次只有几个同时在用, 轮流申请释放, 看能不能复用
+void test_large_buffers(char const *title, std::pmr::memory_resource *mr, size_t size)
+{
+    const int in_flight = 8;
+    const int N = 20000;
+    void *mem[in_flight] = {};
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < N; ++i) {
+        void *&p = mem[i % in_flight];
+        if(p) {
+            mr->deallocate(p, size, align_size);
+        }
+        p = mr->allocate(size, align_size);
+        // 碰一下首尾, mmap 出来的新页面要缺页
+        ((char *)p)[0] = 1;
+        ((char *)p)[size - 1] = 1;
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for(auto p : mem) {
+        if(p) {
+            mr->deallocate(p, size, align_size);
+        }
+    }
+    auto d = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0);
+    printf("%-28s %10.2f ns/(alloc+free)\n", title, (double)d.count() / N);
+}
+
 struct Malloc : std::pmr::memory_resource {
 
     virtual void*
@@ -128,6 +156,28 @@ struct Null : std::pmr::memory_resource {
 
 };
 
+// PoolResource without the slab layer
+struct Tlsf : std::pmr::memory_resource {
+
+    PoolImpl m_impl;
+
+    virtual void*
+    do_allocate(size_t __bytes, size_t __alignment) {
+        return PoolImpl::alloc(&m_impl, __bytes, __alignment);
+    }
+
+    virtual void
+    do_deallocate(void* __p, size_t __bytes, size_t __alignment) {
+        PoolImpl::free(&m_impl, __p, __bytes, __alignment);
+    }
+
+    virtual bool
+    do_is_equal(const std::pmr::memory_resource& __other) const noexcept {
+        return this == &__other;
+    }
+
+};
+
 struct Fix : std::pmr::memory_resource {
 
     Fix() {
@@ -178,6 +228,28 @@ int main()
         test_memory_resource("synchronized_pool_resource", &spr);
         test_memory_resource("monotonic_buffer_resource", &mbr);
 #endif        
+
+        // slab 层 (<= 512 字节) 和原来只有 PoolImpl 的路径对比
+        for(size_t size : { 15, 64, 128, 200, 512, 1000 }) {
+            PoolResource slab;
+            Tlsf tlsf;
+            printf("---- %zu bytes\n", size);
+            test_memory_resource("PoolResource", &slab, size);
+            test_memory_resource("PoolImpl", &tlsf, size);
+        }
+
+        // 大对象走 LargeObjectCache, chunk 调大后 128KB 以下的留在 PoolImpl 里
+        PoolConfig big;
+        big.m_chunk_size = 256 * 1024;
+        big.m_large_threshold = 128 * 1024;
+        for(size_t size : { 20 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024 }) {
+            PoolResource large;
+            PoolResource large_chunk(big);
+            printf("---- %zu bytes\n", size);
+            test_large_buffers("malloc_resource", &mmr, size);
+            test_large_buffers("PoolResource", &large, size);
+            test_large_buffers("PoolResource chunk=256K", &large_chunk, size);
+        }
         return 0;
 
     return 0;
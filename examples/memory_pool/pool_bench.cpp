@@ -0,0 +1,512 @@
+// 内存池的压力和碎片测试: 回放分配轨迹, 对比各个分配器
+// 轨迹:
+//   frames   协程帧: 一条嵌套的调用链, 严格后进先出
+//   frames1k 协程帧: 1024 条调用链 (连接) 交错进行, 每条链内后进先出
+//   buffers  buffer: 大小偏向小的, 大部分很快释放, 少数活很久
+//   xthread  跨线程: 生产者线程申请, 消费者线程用完以后
+//            直接释放 (只有线程安全的分配器) 或者交回生产者释放
+// 每个 (轨迹, 分配器) 在 fork 出来的子进程里跑, 峰值 RSS 互不影响
+// frag = 峰值 RSS 的增量 / 峰值在用的字节数, 越接近 1 越好
+// (在用的很少时, 主要是页面和 chunk 的固定开销)
+//
+// pool_bench [--ops 2000000] [--traces frames,frames1k,buffers,xthread]
+//            [--allocators malloc,Pool,PoolResource,StackfulPool,unsync_pool,sync_pool]
+
+#include <tinyasync/memory_pool.h>
+
+#include <random>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstring>
+
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace tinyasync;
+
+// m_size == 0: free the slot
+struct Op
+{
+    uint32_t m_slot;
+    uint32_t m_size;
+};
+
+struct Trace
+{
+    std::vector<Op> m_ops;
+    uint32_t m_slots = 0;
+    std::size_t m_max_size = 0;
+    std::size_t m_peak_live = 0;
+    bool m_lifo = false;
+
+    void alloc(uint32_t slot, uint32_t size, std::size_t &live)
+    {
+        m_ops.push_back({ slot, size });
+        m_max_size = std::max<std::size_t>(m_max_size, size);
+        live += size;
+        m_peak_live = std::max(m_peak_live, live);
+    }
+};
+
+// frame sizes of typical coroutines, small ones are more common
+uint32_t frame_size(std::mt19937 &rng)
+{
+    static const uint32_t sizes[] = { 96, 96, 128, 128, 128, 160, 224, 320, 480, 640 };
+    return sizes[rng() % std::size(sizes)];
+}
+
+// 32 bytes .. 2 << max_shift, skewed to small
+uint32_t buffer_size(std::mt19937 &rng, int max_shift)
+{
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    int shift = 5 + (int)((max_shift - 5) * u * u);
+    return (1u << shift) + rng() % (1u << shift);
+}
+
+// each chain calls (allocates a frame) or returns (frees the innermost frame) at random
+Trace make_frames_trace(std::size_t ops, uint32_t chains)
+{
+    Trace trace;
+    trace.m_lifo = chains == 1;
+    const uint32_t max_depth = 24;
+    trace.m_slots = max_depth * chains;
+    std::mt19937 rng(1);
+    std::vector<std::vector<uint32_t> > stacks(chains);
+    std::size_t live = 0;
+    while(trace.m_ops.size() < ops) {
+        uint32_t chain = rng() % chains;
+        auto &sizes = stacks[chain];
+        uint32_t slot = chain * max_depth + (uint32_t)sizes.size();
+        bool call = sizes.empty() || (sizes.size() < max_depth && rng() % 2);
+        if(call) {
+            auto size = frame_size(rng);
+            trace.alloc(slot, size, live);
+            sizes.push_back(size);
+        } else {
+            trace.m_ops.push_back({ slot - 1, 0 });
+            live -= sizes.back();
+            sizes.pop_back();
+        }
+    }
+    for(uint32_t chain = 0; chain < chains; ++chain) {
+        for(auto &sizes = stacks[chain]; !sizes.empty(); sizes.pop_back()) {
+            trace.m_ops.push_back({ chain * max_depth + (uint32_t)sizes.size() - 1, 0 });
+        }
+    }
+    return trace;
+}
+
+Trace make_buffers_trace(std::size_t ops)
+{
+    Trace trace;
+    std::mt19937 rng(2);
+    // op index -> slot to free
+    std::multimap<std::size_t, uint32_t> due;
+    std::vector<uint32_t> free_slots;
+    std::vector<uint32_t> sizes;
+    std::size_t live = 0;
+    for(std::size_t t = 0; trace.m_ops.size() < ops; ++t) {
+        if(!due.empty() && due.begin()->first <= t) {
+            auto slot = due.begin()->second;
+            due.erase(due.begin());
+            trace.m_ops.push_back({ slot, 0 });
+            live -= sizes[slot];
+            free_slots.push_back(slot);
+            continue;
+        }
+        uint32_t slot;
+        if(free_slots.empty()) {
+            slot = (uint32_t)sizes.size();
+            sizes.push_back(0);
+        } else {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        sizes[slot] = buffer_size(rng, 15);
+        trace.alloc(slot, sizes[slot], live);
+        // 95% die young, the rest live for a long time and pin their neighbours
+        std::size_t lifetime = rng() % 100 < 95 ? 1 + rng() % 16 : 10000 + rng() % 200000;
+        due.emplace(t + lifetime, slot);
+    }
+    for(auto &d : due) {
+        trace.m_ops.push_back({ d.second, 0 });
+    }
+    trace.m_slots = (uint32_t)sizes.size();
+    return trace;
+}
+
+struct Malloc : std::pmr::memory_resource
+{
+    void *do_allocate(size_t bytes, size_t alignment) override
+    {
+        return ::aligned_alloc(alignment, (bytes + alignment - 1) & ~(alignment - 1));
+    }
+
+    void do_deallocate(void *p, size_t, size_t) override
+    {
+        ::free(p);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+struct Stackful : std::pmr::memory_resource
+{
+    StackfulPool m_pool;
+
+    Stackful(std::size_t size) : m_pool(size)
+    {
+    }
+
+    void *do_allocate(size_t bytes, size_t alignment) override
+    {
+        return m_pool.allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override
+    {
+        m_pool.deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+// nullptr if the allocator can't replay the trace
+std::unique_ptr<std::pmr::memory_resource> make_resource(std::string const &name, Trace const &trace)
+{
+    if(name == "malloc") {
+        return std::make_unique<Malloc>();
+    } else if(name == "Pool") {
+        // fixed block size, every request takes the largest block
+        return std::make_unique<FixPoolResource>(trace.m_max_size);
+    } else if(name == "PoolResource") {
+        return std::make_unique<PoolResource>();
+    } else if(name == "StackfulPool") {
+        if(!trace.m_lifo) {
+            return nullptr;
+        }
+        return std::make_unique<Stackful>(trace.m_peak_live * 2 + trace.m_slots * 64 + 4096);
+    } else if(name == "unsync_pool") {
+        return std::make_unique<std::pmr::unsynchronized_pool_resource>();
+    } else if(name == "sync_pool") {
+        return std::make_unique<std::pmr::synchronized_pool_resource>();
+    }
+    fprintf(stderr, "unknown allocator %s\n", name.c_str());
+    exit(1);
+}
+
+bool is_thread_safe(std::string const &name)
+{
+    return name == "malloc" || name == "sync_pool";
+}
+
+// write one byte per page, so that the memory is really resident
+inline void touch(void *p, std::size_t size)
+{
+    for(std::size_t off = 0; off < size; off += 4096) {
+        ((volatile char *)p)[off] = 1;
+    }
+}
+
+// ns/op
+double replay(Trace const &trace, std::pmr::memory_resource *mr)
+{
+    std::vector<void *> slots(trace.m_slots);
+    std::vector<uint32_t> sizes(trace.m_slots);
+    auto start = std::chrono::steady_clock::now();
+    for(auto op : trace.m_ops) {
+        if(op.m_size) {
+            void *p = mr->allocate(op.m_size, alignof(std::max_align_t));
+            touch(p, op.m_size);
+            slots[op.m_slot] = p;
+            sizes[op.m_slot] = op.m_size;
+        } else {
+            mr->deallocate(slots[op.m_slot], sizes[op.m_slot], alignof(std::max_align_t));
+        }
+    }
+    auto d = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return d / trace.m_ops.size();
+}
+
+// single producer single consumer ring of pointers
+struct Ring
+{
+    static const std::size_t k_size = 1024;
+    struct Msg
+    {
+        void *m_p;
+        uint32_t m_size;
+    };
+    Msg m_msgs[k_size];
+    alignas(64) std::atomic<std::size_t> m_head = 0;
+    alignas(64) std::atomic<std::size_t> m_tail = 0;
+
+    bool push(Msg msg)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        if(tail - m_head.load(std::memory_order_acquire) == k_size) {
+            return false;
+        }
+        m_msgs[tail % k_size] = msg;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(Msg &msg)
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        if(head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        msg = m_msgs[head % k_size];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// producer allocates messages, consumer frees them (direct) or returns them to the producer
+// ns/op, an op is an alloc or a free
+double cross_thread(std::size_t messages, std::pmr::memory_resource *mr, bool direct, std::size_t &peak_live)
+{
+    Ring to_consumer;
+    Ring to_producer;
+    std::atomic<int64_t> live = 0;
+    std::atomic<bool> done = false;
+
+    std::thread consumer([&]() {
+        Ring::Msg msg;
+        for(;;) {
+            if(!to_consumer.pop(msg)) {
+                if(done.load(std::memory_order_acquire) && !to_consumer.pop(msg)) {
+                    break;
+                }
+                // the two threads may share one cpu
+                std::this_thread::yield();
+                continue;
+            }
+            ((volatile char *)msg.m_p)[msg.m_size - 1];
+            if(direct) {
+                mr->deallocate(msg.m_p, msg.m_size, alignof(std::max_align_t));
+                live.fetch_sub(msg.m_size, std::memory_order_relaxed);
+            } else {
+                while(!to_producer.push(msg)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    });
+
+    std::mt19937 rng(3);
+    int64_t peak = 0;
+    // free what the consumer has returned
+    auto give_back = [&]() {
+        Ring::Msg msg;
+        while(!direct && to_producer.pop(msg)) {
+            mr->deallocate(msg.m_p, msg.m_size, alignof(std::max_align_t));
+            live.fetch_sub(msg.m_size, std::memory_order_relaxed);
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < messages; ++i) {
+        give_back();
+        Ring::Msg msg;
+        msg.m_size = buffer_size(rng, 11);
+        msg.m_p = mr->allocate(msg.m_size, alignof(std::max_align_t));
+        touch(msg.m_p, msg.m_size);
+        peak = std::max(peak, live.fetch_add(msg.m_size, std::memory_order_relaxed) + (int64_t)msg.m_size);
+        while(!to_consumer.push(msg)) {
+            give_back();
+            std::this_thread::yield();
+        }
+    }
+    done.store(true, std::memory_order_release);
+    consumer.join();
+    give_back();
+    auto d = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    peak_live = (std::size_t)peak;
+    return d / (2 * messages);
+}
+
+struct Result
+{
+    bool m_ok = false;
+    double m_ns_per_op = 0;
+    long m_rss_kb = 0; // peak rss - rss before the run
+    std::size_t m_peak_live = 0;
+};
+
+// VmRSS or VmHWM (peak) from /proc/self/status
+long status_kb(char const *key)
+{
+    long kb = 0;
+    FILE *f = fopen("/proc/self/status", "r");
+    if(!f) {
+        return 0;
+    }
+    char line[256];
+    std::size_t len = strlen(key);
+    while(fgets(line, sizeof(line), f)) {
+        if(!strncmp(line, key, len) && line[len] == ':') {
+            kb = atol(line + len + 1);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+// the child inherits the peak of the parent, start a new one
+void reset_peak_rss()
+{
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if(f) {
+        fputs("5", f);
+        fclose(f);
+    }
+}
+
+// run in a child process so that every case starts from the same rss
+template<class F>
+Result run_in_child(F &&f)
+{
+    int fds[2];
+    if(pipe(fds) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    pid_t pid = fork();
+    if(pid == 0) {
+        close(fds[0]);
+        Result result;
+        // heap pages freed by the parent would be reused without raising the rss
+        malloc_trim(0);
+        reset_peak_rss();
+        long before = status_kb("VmRSS");
+        f(result);
+        result.m_rss_kb = status_kb("VmHWM") - before;
+        result.m_ok = true;
+        if(write(fds[1], &result, sizeof(result)) != sizeof(result)) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    Result result;
+    if(read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+        result.m_ok = false;
+    }
+    close(fds[0]);
+    waitpid(pid, nullptr, 0);
+    return result;
+}
+
+void print_result(char const *trace, std::string const &allocator, Result const &r)
+{
+    if(!r.m_ok) {
+        printf("%-14s %-14s %10s\n", trace, allocator.c_str(), "n/a");
+        return;
+    }
+    double frag = r.m_peak_live ? (double)r.m_rss_kb * 1024 / r.m_peak_live : 0;
+    printf("%-14s %-14s %10.2f %12ld %12zu %8.2f\n", trace, allocator.c_str(),
+        r.m_ns_per_op, r.m_rss_kb, r.m_peak_live / 1024, frag);
+}
+
+std::vector<std::string> split(std::string const &s)
+{
+    std::vector<std::string> values;
+    std::size_t begin = 0;
+    for(;;) {
+        auto comma = s.find(',', begin);
+        values.push_back(s.substr(begin, comma - begin));
+        if(comma == std::string::npos) {
+            return values;
+        }
+        begin = comma + 1;
+    }
+}
+
+[[noreturn]] void usage()
+{
+    fprintf(stderr, "usage: pool_bench [--ops 2000000] [--traces frames,frames1k,buffers,xthread] "
+        "[--allocators malloc,Pool,PoolResource,StackfulPool,unsync_pool,sync_pool]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    std::size_t ops = 2000000;
+    std::vector<std::string> traces = { "frames", "frames1k", "buffers", "xthread" };
+    std::vector<std::string> allocators = { "malloc", "Pool", "PoolResource", "StackfulPool", "unsync_pool", "sync_pool" };
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(i + 1 >= argc) {
+            usage();
+        }
+        std::string value = argv[++i];
+        if(arg == "--ops") ops = (std::size_t)atoll(value.c_str());
+        else if(arg == "--traces") traces = split(value);
+        else if(arg == "--allocators") allocators = split(value);
+        else usage();
+    }
+
+    printf("%-14s %-14s %10s %12s %12s %8s\n", "trace", "allocator", "ns/op", "peak_rss_kb", "peak_live_kb", "frag");
+    for(auto const &name : traces) {
+        if(name == "xthread") {
+            // the largest message is 4KB
+            Trace shape;
+            shape.m_max_size = 4096;
+            for(bool direct : { true, false }) {
+                char const *title = direct ? "xthread-free" : "xthread-return";
+                for(auto const &allocator : allocators) {
+                    if(direct && !is_thread_safe(allocator)) {
+                        print_result(title, allocator, Result());
+                        continue;
+                    }
+                    auto r = run_in_child([&](Result &result) {
+                        auto mr = make_resource(allocator, shape);
+                        if(!mr) {
+                            _exit(1);
+                        }
+                        result.m_ns_per_op = cross_thread(ops / 2, mr.get(), direct, result.m_peak_live);
+                    });
+                    print_result(title, allocator, r);
+                }
+            }
+            continue;
+        }
+
+        Trace trace;
+        if(name == "frames") {
+            trace = make_frames_trace(ops, 1);
+        } else if(name == "frames1k") {
+            trace = make_frames_trace(ops, 1024);
+        } else if(name == "buffers") {
+            trace = make_buffers_trace(ops);
+        } else {
+            usage();
+        }
+        for(auto const &allocator : allocators) {
+            auto r = run_in_child([&](Result &result) {
+                auto mr = make_resource(allocator, trace);
+                if(!mr) {
+                    _exit(1);
+                }
+                result.m_ns_per_op = replay(trace, mr.get());
+                result.m_peak_live = trace.m_peak_live;
+            });
+            print_result(name.c_str(), allocator, r);
+        }
+    }
+    return 0;
+}
@@ -18,16 +18,19 @@ size_t block_size;
 struct LB : ListNode
 {
     Buffer buffer;
+    // Session::read 收到的数据, 发完了才还给 IoContext 的 BufferPool
+    PooledBuffer pooled;
     std::byte data[1]; // 技巧,内存申请,指向后面的大片内存
 };
 
 inline LB *allocate(Pool *pool)
 {
-    auto b = (LB *)pool->alloc();
-    if(!b) {
+    auto mem = pool->alloc();
+    if(!mem) {
         printf("memory ex\n");
         exit(1);
     }
+    auto b = new(mem) LB;
     b->buffer.m_data = b->data;
     b->buffer.m_size = block_size;
     return b;
@@ -35,6 +38,7 @@ inline LB *allocate(Pool *pool)
 
 inline void deallocate(Pool *pool, LB *b)
 {
+    b->~LB();
     pool->free(b);
 }
 
@@ -77,12 +81,13 @@ struct Session
         for (; ;) //循环读取
         {
 
-            LB *b = allocate(m_pool); // 产生新的buffer
             // read some
+            // 等数据的时候不占 buffer, 空闲的连接多了也不会占很多内存
+            PooledBuffer pooled;
             std::size_t nread;
             //co_await async_sleep(ctx, std::chrono::milliseconds(100));            
             try {
-                nread = co_await conn.async_read(b->buffer);
+                nread = co_await conn.async_read_pooled(pooled);
             } catch(...) {
                 printf("read exception: %s", to_string(std::current_exception()).c_str());
                 break;
@@ -94,8 +99,10 @@ struct Session
             }
             nread_total += nread;
 
-            b->buffer = b->buffer.sub_buffer(0, nread);
-            m_que.push(b); //哪里dealloc呢
+            LB *b = allocate(m_pool);
+            b->buffer = pooled.buffer();
+            b->pooled = std::move(pooled);
+            m_que.push(b); // send 发完以后 dealloc
             m_on_buffer_has_data.notify_one(); // 如果通知可能会不处理吗,一定会有awaiter吗
 
         }
@@ -166,8 +173,9 @@ struct Session
                 break;             
             }
             nwrite_total += nsent;
+            bool partial = nsent < b->buffer.size();
             deallocate(m_pool, b); //退pool
-            if (nsent < b->buffer.size())
+            if (partial)
             {
                 printf("send peer shutdown\n");
                 break;
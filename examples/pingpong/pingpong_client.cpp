@@ -64,6 +64,20 @@ Task<> connect_(IoContext &ctx)
     printf("line:%d,%.2f M/s bytes read\n",__LINE__, (long long)nread_total/timeout.count()/1E6);
     printf("line:%d,%.2f M/s bytes write\n",__LINE__, (long long)nwrite_total/timeout.count()/1E6);
 
+    uint64_t conn_bytes = 0;
+	for (size_t i = 0; i <  nsess; ++i) {
+        conn_bytes += sesses[i].conn.bytes_received();
+    }
+    auto stats = ctx.stats();
+    printf("line:%d,%llu bytes received by connections\n",__LINE__, (unsigned long long)conn_bytes);
+    printf("line:%d,%llu tasks, %llu epoll_wait, %llu spurious wakeups, %.2f events/wait\n",__LINE__,
+        (unsigned long long)stats.m_tasks_executed, (unsigned long long)stats.m_epoll_waits,
+        (unsigned long long)stats.m_spurious_wakeups, stats.events_per_wait());
+    printf("line:%d,loop turn p50 <%lluus p99 <%lluus\n",__LINE__,
+        (unsigned long long)stats.turn_percentile_us(0.5), (unsigned long long)stats.turn_percentile_us(0.99));
+    printf("line:%d,run queue lag p50 <%lluus p99 <%lluus\n",__LINE__,
+        (unsigned long long)stats.lag_percentile_us(0.5), (unsigned long long)stats.lag_percentile_us(0.99));
+
     co_await async_sleep(ctx, std::chrono::seconds(1));
     ctx.request_abort();
 }
@@ -72,6 +86,7 @@ Task<> connect_(IoContext &ctx)
 void client() {	
 
 	IoContext ctx;
+	ctx.set_stats_enabled(true);
 	co_spawn(connect_(ctx));
 	ctx.run();
 }
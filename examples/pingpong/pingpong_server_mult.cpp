@@ -6,18 +6,14 @@
 
 std::atomic_int32_t nc;
 
+// 每个核一个 Server, 没有共享的状态 (除了连接计数)
 struct Server
 {
-	IoContext m_ctx;
 	Pool m_pool;
-	Acceptor m_acceptor;
-	std::thread m_thread;
 	int m_id;
 
-	Server(int i, Acceptor &acc) 
+	Server(int i) : m_id(i)
 	{
-		m_id = i;
-		m_acceptor = acc.reset_io_context(m_ctx);
 	}
 
 	Task<> start(IoContext &ctx, Session s)
@@ -46,10 +42,13 @@ struct Server
 
 	}
 
-	Task<> listen(IoContext &ctx)
+	// acceptor 是这个核自己的 (SO_REUSEPORT), 连接由内核分过来
+	Task<> listen(IoContext &ctx, Acceptor acceptor)
 	{
+		initialize_pool(m_pool);
+		printf("[%d] start\n", m_id);
 		for (int i = 0; ; ++i) {
-			Connection conn = co_await m_acceptor.async_accept();
+			Connection conn = co_await acceptor.async_accept();
 			++nc;
 			co_spawn(start(ctx, Session(ctx, std::move(conn), &m_pool)));
 			printf("[%d] %d conn\n", m_id, nc.load());
@@ -57,49 +56,35 @@ struct Server
 
 	}
 
-	void serve()
-	{
-		m_thread = std::thread([this]() {
-
-			try {
-				initialize_pool(m_pool);
-				TINYASYNC_GUARD("server():");
-				printf("[%d] start\n", m_id);
-
-				auto &ctx = m_ctx;
-
-				co_spawn(listen(ctx));
-
-				TINYASYNC_LOG("run");
-				ctx.run();
-
-				printf("[%d] finish\n", m_id);
-			} catch(...) {
-				printf("%s\n", to_string(std::current_exception()).c_str());
-			}
-		});
-
-	}
-
 };
 
 
-int main()
+int main(int argc, char *argv[])
 {
     block_size = 1024;
-	Acceptor acceptor(Protocol::ip_v4(), Endpoint(Address::Any(), 8899));
 
 	printf("hardware_concurrency %d\n", (int)std::thread::hardware_concurrency());
-	std::vector<Server> servers;
-	int n = 2;
-	for(int i = 0; i < n; ++i) {
-		servers.push_back(Server(i, acceptor));
-	}
-	for(int i = 0; i < n; ++i) {
-		servers[i].serve();
-	}
-	for(int i = 0; i < n; ++i) {		
-		servers[i].m_thread.join();
+	try {
+		RuntimeConfig config;
+		config.m_threads = argc > 1 ? atoi(argv[1]) : 0;
+		config.m_skip_hyperthreads = true;
+		Runtime runtime(config);
+
+		std::vector<std::unique_ptr<Server>> servers;
+		for(int i = 0; i < runtime.size(); ++i) {
+			servers.push_back(std::make_unique<Server>(i));
+			printf("[%d] cpu %d\n", i, runtime.cpu(i));
+		}
+		for(int i = 0; i < runtime.size(); ++i) {
+			auto server = servers[i].get();
+			runtime.spawn_on(i, [&runtime, server, i](IoContext &ctx) {
+				return server->listen(ctx, runtime.acceptor(i, Protocol::ip_v4(), Endpoint(Address::Any(), 8899)));
+			});
+		}
+		runtime.run();
+	} catch(...) {
+		printf("%s\n", to_string(std::current_exception()).c_str());
+		return 1;
 	}
 
 	printf("done!\n");
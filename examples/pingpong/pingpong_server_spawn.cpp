@@ -49,7 +49,11 @@ Task<> echo(IoContext &ctx, Connection c)
 
 	for(;;) {
 
-		
+		// 发送队列超过 high watermark 时先不读, 慢的客户端不会让挂起的 send 无限增长
+		if(!co_await c.writable()) {
+			break;
+		}
+
 		LB *lb = allocate(&pool);
 		// read some
 		try {
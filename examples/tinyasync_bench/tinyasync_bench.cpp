@@ -0,0 +1,382 @@
+// 回环网络基准: 同一进程里跑 echo server 和 pingpong client
+// 扫描 连接数 x 消息大小 x 线程数 x backend, 输出吞吐和 p50/p99/p999 延迟 (csv 或 json)
+//
+// server 按线程分片: 每个线程一个 IoContext, 监听 port + i, 客户端连接轮流分到各个分片
+// (一个 ctx 给多个线程同时跑, 同一个连接的回调会在不同线程并发, 现在的 ConnImpl 会丢唤醒)
+// backend:
+//   st  单线程 IoContext (NaitveLock, 不加锁)
+//   mt  多线程 IoContext (队列加锁), 同样每个分片一个线程, 用来看锁的开销
+//
+// tinyasync_bench --conns 1,16,64 --sizes 64,4096 --threads 1,2,4 --backends st,mt
+//                 --duration 2 --warmup 0.2 --client-threads 1 --port 18899 --format csv --out result.csv
+
+#ifndef TINYASYNC_BASICS_H
+#include <tinyasync/tinyasync.h>
+#endif
+
+#include <thread>
+#include <algorithm>
+
+using namespace tinyasync;
+
+struct BenchConfig
+{
+    std::vector<int> m_conns = { 1, 16 };
+    std::vector<int> m_sizes = { 64, 4096 };
+    std::vector<int> m_threads = { 1, 2 };
+    std::vector<std::string> m_backends = { "st", "mt" };
+    double m_duration = 1;
+    double m_warmup = 0.2;
+    int m_client_threads = 1;
+    int m_port = 18899;
+    std::string m_format = "csv";
+    std::string m_out;
+};
+
+struct BenchCase
+{
+    std::string m_backend;
+    int m_threads;
+    int m_conns;
+    int m_size;
+};
+
+struct BenchResult
+{
+    BenchCase m_case;
+    double m_seconds = 0;
+    uint64_t m_messages = 0;
+    double m_msgs_per_sec = 0;
+    double m_mb_per_sec = 0;
+    double m_p50_us = 0;
+    double m_p99_us = 0;
+    double m_p999_us = 0;
+};
+
+// ---------------- server ----------------
+
+// one shard of the server
+struct BenchServer
+{
+    IoContext m_ctx;
+    Acceptor m_acceptor;
+    std::thread m_thread;
+    int m_size;
+    int m_expected;
+    int m_accepted = 0;
+    int m_finished = 0;
+
+    BenchServer(BenchCase const &c, int port, int expected)
+        : m_ctx(c.m_backend == "mt" ? IoContext(std::true_type()) : IoContext(std::false_type())),
+          m_acceptor(m_ctx, Protocol::ip_v4(), Endpoint(Address::Any(), port)),
+          m_size(c.m_size),
+          m_expected(expected)
+    {
+    }
+
+    Task<> echo(IoContext &ctx, Connection conn)
+    {
+        conn.set_tcp_no_delay();
+        std::vector<char> buffer(m_size);
+        try {
+            for(;;) {
+                auto nread = co_await conn.async_read(buffer.data(), buffer.size());
+                if(nread == 0) {
+                    break;
+                }
+                size_t sent = 0;
+                while(sent < nread) {
+                    auto nsent = co_await conn.async_send(buffer.data() + sent, nread - sent);
+                    if(nsent == 0) {
+                        break;
+                    }
+                    sent += nsent;
+                }
+            }
+        } catch(...) {
+            // peer reset
+        }
+        // the last connection stops the server
+        if(++m_finished == m_expected) {
+            ctx.request_abort();
+        }
+    }
+
+    Task<> listen(IoContext &ctx)
+    {
+        while(m_accepted < m_expected) {
+            Connection conn = co_await m_acceptor.async_accept();
+            ++m_accepted;
+            co_spawn(echo(ctx, std::move(conn)));
+        }
+    }
+
+    void start()
+    {
+        co_spawn(listen(m_ctx));
+        m_thread = std::thread([this]() {
+            try {
+                m_ctx.run();
+            } catch(...) {
+                fprintf(stderr, "server: %s\n", to_string(std::current_exception()).c_str());
+            }
+        });
+    }
+};
+
+// ---------------- client ----------------
+
+struct ClientStats
+{
+    uint64_t m_messages = 0;
+    std::vector<uint32_t> m_latency_ns;
+};
+
+Task<> ping(Connection &conn, int size, std::chrono::steady_clock::time_point measure_begin, std::chrono::steady_clock::time_point end, ClientStats &stats)
+{
+    std::vector<char> out(size, 'x');
+    std::vector<char> in(size);
+    try {
+        for(;;) {
+            auto t0 = std::chrono::steady_clock::now();
+            if(t0 >= end) {
+                break;
+            }
+            size_t sent = 0;
+            while(sent < (size_t)size) {
+                sent += co_await conn.async_send(out.data() + sent, size - sent);
+            }
+            size_t got = 0;
+            while(got < (size_t)size) {
+                auto nread = co_await conn.async_read(in.data() + got, size - got);
+                if(nread == 0) {
+                    throw std::runtime_error("server closed");
+                }
+                got += nread;
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            if(t0 >= measure_begin) {
+                stats.m_messages += 1;
+                stats.m_latency_ns.push_back((uint32_t)std::min<int64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count(), UINT32_MAX));
+            }
+        }
+    } catch(...) {
+        fprintf(stderr, "client: %s\n", to_string(std::current_exception()).c_str());
+    }
+}
+
+// connection i goes to shard i % nshards
+Task<> client(IoContext &ctx, std::vector<int> ports, int size, BenchConfig const &config, ClientStats &stats)
+{
+    // connect one by one, the listen backlog is small
+    std::vector<Connection> connections;
+    for(int port : ports) {
+        Connection conn = co_await async_connect(ctx, Protocol::ip_v4(), Endpoint(Address(INADDR_LOOPBACK), port));
+        conn.set_tcp_no_delay();
+        connections.push_back(std::move(conn));
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto measure_begin = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(config.m_warmup));
+    auto end = measure_begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(config.m_duration));
+
+    std::vector<Task<> > tasks;
+    for(auto &conn : connections) {
+        tasks.push_back(ping(conn, size, measure_begin, end, stats));
+        tasks.back().resume();
+    }
+    for(auto &task : tasks) {
+        co_await task.join();
+    }
+    // close all, the server stops after the last one
+    connections.clear();
+    ctx.request_abort();
+}
+
+// ---------------- driver ----------------
+
+double percentile_us(std::vector<uint32_t> &samples, double p)
+{
+    if(samples.empty()) {
+        return 0;
+    }
+    size_t k = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k] / 1E3;
+}
+
+BenchResult run_case(BenchCase const &c, BenchConfig const &config)
+{
+    // no idle shard
+    int nshards = std::max(1, std::min(c.m_threads, c.m_conns));
+    std::vector<std::unique_ptr<BenchServer> > servers;
+    for(int i = 0; i < nshards; ++i) {
+        int expected = c.m_conns / nshards + (i < c.m_conns % nshards ? 1 : 0);
+        servers.emplace_back(new BenchServer(c, config.m_port + i, expected));
+    }
+    for(auto &server : servers) {
+        server->start();
+    }
+
+    // spread connections over client threads
+    int nclients = std::max(1, std::min(config.m_client_threads, c.m_conns));
+    std::vector<std::vector<int> > ports(nclients);
+    for(int i = 0; i < c.m_conns; ++i) {
+        ports[i % nclients].push_back(config.m_port + i % nshards);
+    }
+    std::vector<ClientStats> stats(nclients);
+    std::vector<std::thread> clients;
+    for(int i = 0; i < nclients; ++i) {
+        clients.emplace_back([&, i]() {
+            try {
+                IoContext ctx(std::false_type{});
+                co_spawn(client(ctx, ports[i], c.m_size, config, stats[i]));
+                ctx.run();
+            } catch(...) {
+                fprintf(stderr, "client: %s\n", to_string(std::current_exception()).c_str());
+            }
+        });
+    }
+    for(auto &t : clients) {
+        t.join();
+    }
+    for(auto &server : servers) {
+        server->m_thread.join();
+    }
+
+    BenchResult r;
+    r.m_case = c;
+    r.m_seconds = config.m_duration;
+    std::vector<uint32_t> latency;
+    for(auto &s : stats) {
+        r.m_messages += s.m_messages;
+        latency.insert(latency.end(), s.m_latency_ns.begin(), s.m_latency_ns.end());
+    }
+    r.m_msgs_per_sec = r.m_messages / r.m_seconds;
+    // echoed, so bytes in both directions
+    r.m_mb_per_sec = 2.0 * r.m_messages * c.m_size / r.m_seconds / 1E6;
+    r.m_p50_us = percentile_us(latency, 0.5);
+    r.m_p99_us = percentile_us(latency, 0.99);
+    r.m_p999_us = percentile_us(latency, 0.999);
+    return r;
+}
+
+void write_csv(FILE *file, std::vector<BenchResult> const &results)
+{
+    fprintf(file, "backend,threads,conns,msg_size,seconds,messages,msgs_per_sec,mb_per_sec,p50_us,p99_us,p999_us\n");
+    for(auto &r : results) {
+        fprintf(file, "%s,%d,%d,%d,%.3f,%llu,%.1f,%.3f,%.2f,%.2f,%.2f\n",
+            r.m_case.m_backend.c_str(), r.m_case.m_threads, r.m_case.m_conns, r.m_case.m_size,
+            r.m_seconds, (unsigned long long)r.m_messages, r.m_msgs_per_sec, r.m_mb_per_sec,
+            r.m_p50_us, r.m_p99_us, r.m_p999_us);
+    }
+}
+
+void write_json(FILE *file, std::vector<BenchResult> const &results)
+{
+    fprintf(file, "[\n");
+    for(size_t i = 0; i < results.size(); ++i) {
+        auto &r = results[i];
+        fprintf(file, "  {\"backend\":\"%s\",\"threads\":%d,\"conns\":%d,\"msg_size\":%d,\"seconds\":%.3f,"
+            "\"messages\":%llu,\"msgs_per_sec\":%.1f,\"mb_per_sec\":%.3f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"p999_us\":%.2f}%s\n",
+            r.m_case.m_backend.c_str(), r.m_case.m_threads, r.m_case.m_conns, r.m_case.m_size,
+            r.m_seconds, (unsigned long long)r.m_messages, r.m_msgs_per_sec, r.m_mb_per_sec,
+            r.m_p50_us, r.m_p99_us, r.m_p999_us, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "]\n");
+}
+
+std::vector<std::string> split(std::string const &s)
+{
+    std::vector<std::string> items;
+    size_t begin = 0;
+    for(;;) {
+        auto end = s.find(',', begin);
+        items.push_back(s.substr(begin, end - begin));
+        if(end == std::string::npos) {
+            break;
+        }
+        begin = end + 1;
+    }
+    return items;
+}
+
+std::vector<int> split_int(std::string const &s)
+{
+    std::vector<int> items;
+    for(auto &item : split(s)) {
+        items.push_back(atoi(item.c_str()));
+    }
+    return items;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: tinyasync_bench [--conns 1,16] [--sizes 64,4096] [--threads 1,2] [--backends st,mt]\n"
+        "                       [--duration seconds] [--warmup seconds] [--client-threads n]\n"
+        "                       [--port port] [--format csv|json] [--out path]\n"
+        "server shard i listens on port + i\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig config;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(i + 1 >= argc) {
+            usage();
+        }
+        std::string value = argv[++i];
+        if(arg == "--conns") config.m_conns = split_int(value);
+        else if(arg == "--sizes") config.m_sizes = split_int(value);
+        else if(arg == "--threads") config.m_threads = split_int(value);
+        else if(arg == "--backends") config.m_backends = split(value);
+        else if(arg == "--duration") config.m_duration = atof(value.c_str());
+        else if(arg == "--warmup") config.m_warmup = atof(value.c_str());
+        else if(arg == "--client-threads") config.m_client_threads = atoi(value.c_str());
+        else if(arg == "--port") config.m_port = atoi(value.c_str());
+        else if(arg == "--format") config.m_format = value;
+        else if(arg == "--out") config.m_out = value;
+        else usage();
+    }
+    if(config.m_format != "csv" && config.m_format != "json") {
+        usage();
+    }
+
+    std::vector<BenchResult> results;
+    for(auto &backend : config.m_backends) {
+        if(backend != "st" && backend != "mt") {
+            fprintf(stderr, "unknown backend %s\n", backend.c_str());
+            return 1;
+        }
+        for(int threads : config.m_threads) {
+            for(int conns : config.m_conns) {
+                for(int size : config.m_sizes) {
+                    BenchCase c { backend, threads, conns, size };
+                    fprintf(stderr, "running backend=%s threads=%d conns=%d size=%d\n", backend.c_str(), threads, conns, size);
+                    results.push_back(run_case(c, config));
+                }
+            }
+        }
+    }
+
+    FILE *file = stdout;
+    if(!config.m_out.empty()) {
+        file = fopen(config.m_out.c_str(), "w");
+        if(!file) {
+            fprintf(stderr, "can't open %s\n", config.m_out.c_str());
+            return 1;
+        }
+    }
+    if(config.m_format == "json") {
+        write_json(file, results);
+    } else {
+        write_csv(file, results);
+    }
+    if(file != stdout) {
+        fclose(file);
+    }
+    return 0;
+}
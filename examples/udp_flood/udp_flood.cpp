@@ -0,0 +1,208 @@
+// 回环 UDP 洪水测试: 一个线程发, 一个线程收, 各自一个 IoContext
+// batch = 1 用 async_send_to/async_recv_from (每个包一次系统调用)
+// batch > 1 用 async_send_batch/async_recv_batch (sendmmsg/recvmmsg)
+// segments > 1 用 GSO 发 (一个大 buffer 由内核切成 segments 个包), 接收端打开 GRO
+// 接收端来不及收时内核会丢包, 所以同时输出发送和接收的速率
+//
+// udp_flood --batches 1,8,32 --sizes 64,1400 --segments 1,16 --duration 1
+
+#include <tinyasync/tinyasync.h>
+
+#include <thread>
+
+using namespace tinyasync;
+
+struct FloodConfig
+{
+    std::vector<int> m_batches = { 1, 32 };
+    std::vector<int> m_sizes = { 64, 1400 };
+    std::vector<int> m_segments = { 1 };
+    double m_duration = 1;
+};
+
+struct FloodResult
+{
+    int m_batch;
+    int m_size;
+    int m_segments;
+    double m_seconds = 0;
+    uint64_t m_sent = 0;
+    uint64_t m_received = 0;
+    uint64_t m_send_calls = 0;
+    uint64_t m_recv_calls = 0;
+};
+
+// a datagram of 0 bytes stops the receiver
+Task<> receiver(IoContext &ctx, UdpSocket &sock, int batch, int size, bool gro, FloodResult &result, Name = "receiver")
+{
+    // coalesced datagrams need a large buffer
+    std::size_t buffer_size = gro ? k_udp_max_payload : size;
+    std::vector<char> buffer(batch * buffer_size);
+    std::vector<Datagram> dgs(batch);
+    for(int i = 0; i < batch; ++i) {
+        dgs[i].m_data = buffer.data() + i * buffer_size;
+        dgs[i].m_size = buffer_size;
+    }
+
+    for(bool stop = false; !stop; ) {
+        if(batch == 1 && !gro) {
+            Endpoint from;
+            std::size_t nbytes = co_await sock.async_recv_from(buffer.data(), size, from);
+            result.m_recv_calls += 1;
+            if(nbytes == 0) {
+                break;
+            }
+            result.m_received += 1;
+        } else {
+            std::size_t n = co_await sock.async_recv_batch(dgs);
+            result.m_recv_calls += 1;
+            for(std::size_t i = 0; i < n; ++i) {
+                if(dgs[i].m_bytes == 0) {
+                    stop = true;
+                    break;
+                }
+                result.m_received += dgs[i].segment_count();
+            }
+        }
+    }
+    ctx.request_abort();
+}
+
+Task<> sender(IoContext &ctx, Endpoint to, int batch, int size, int segments, double duration, FloodResult &result, Name = "sender")
+{
+    UdpSocket sock(ctx, Protocol::udp_v4());
+    std::vector<char> payload(size * segments, 'x');
+    std::vector<Datagram> dgs(batch);
+    for(auto &dg : dgs) {
+        dg.m_data = payload.data();
+        dg.m_size = payload.size();
+        dg.m_segment_size = segments > 1 ? size : 0;
+        dg.m_endpoint = to;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(duration));
+    for(;;) {
+        // check the clock every 64 calls
+        for(int i = 0; i < 64; ++i) {
+            if(batch == 1 && segments == 1) {
+                co_await sock.async_send_to(payload.data(), size, to);
+                result.m_sent += 1;
+            } else if(batch == 1) {
+                co_await sock.async_send_segments(payload.data(), payload.size(), size, to);
+                result.m_sent += segments;
+            } else {
+                result.m_sent += segments * co_await sock.async_send_batch(dgs);
+            }
+            result.m_send_calls += 1;
+        }
+        if(std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+    }
+    result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ctx.request_abort();
+}
+
+FloodResult run_case(int batch, int size, int segments, double duration)
+{
+    FloodResult result;
+    result.m_batch = batch;
+    result.m_size = size;
+    result.m_segments = segments;
+
+    IoContext recv_ctx(std::false_type{});
+    UdpSocket recv_sock(recv_ctx, Protocol::udp_v4(), Endpoint(Address(INADDR_LOOPBACK), 0));
+    recv_sock.set_recv_buffer_size(4 * 1024 * 1024);
+    Endpoint to = recv_sock.local_endpoint();
+    bool gro = segments > 1;
+    if(gro && !recv_sock.enable_gro()) {
+        fprintf(stderr, "UDP_GRO is not supported\n");
+        exit(1);
+    }
+
+    std::atomic<bool> received_all = false;
+    std::thread recv_thread([&]() {
+        co_spawn(receiver(recv_ctx, recv_sock, batch, size, gro, result));
+        recv_ctx.run();
+        received_all = true;
+    });
+
+    {
+        IoContext send_ctx(std::false_type{});
+        co_spawn(sender(send_ctx, to, batch, size, segments, duration, result));
+        send_ctx.run();
+    }
+
+    // the stop datagram may be dropped too, send until the receiver is done
+    int stop_sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_storage addr;
+    socklen_t addr_len = endpoint_to_sockaddr(to, addr);
+    while(!received_all) {
+        ::sendto(stop_sock, "", 0, 0, (sockaddr *)&addr, addr_len);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ::close(stop_sock);
+    recv_thread.join();
+    return result;
+}
+
+[[noreturn]] void usage()
+{
+    fprintf(stderr, "usage: udp_flood [--batches 1,32] [--sizes 64,1400] [--segments 1,16] [--duration 1]\n");
+    exit(1);
+}
+
+std::vector<int> split_int(std::string const &s)
+{
+    std::vector<int> values;
+    std::size_t begin = 0;
+    for(;;) {
+        auto comma = s.find(',', begin);
+        values.push_back(atoi(s.substr(begin, comma - begin).c_str()));
+        if(comma == std::string::npos) {
+            return values;
+        }
+        begin = comma + 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    FloodConfig config;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(i + 1 >= argc) {
+            usage();
+        }
+        std::string value = argv[++i];
+        if(arg == "--batches") config.m_batches = split_int(value);
+        else if(arg == "--sizes") config.m_sizes = split_int(value);
+        else if(arg == "--segments") config.m_segments = split_int(value);
+        else if(arg == "--duration") config.m_duration = atof(value.c_str());
+        else usage();
+    }
+
+    printf("%6s %6s %6s %14s %14s %8s %12s %12s\n",
+        "batch", "size", "segs", "sent_pps", "recv_pps", "loss%", "send_calls", "recv_calls");
+    for(int size : config.m_sizes) {
+        for(int segments : config.m_segments) {
+            for(int batch : config.m_batches) {
+                if(batch < 1 || size < 1 || segments < 1) {
+                    usage();
+                }
+                segments = std::min<int>(segments, udp_max_gso_segments(size));
+                auto r = run_case(batch, size, segments, config.m_duration);
+                printf("%6d %6d %6d %14.0f %14.0f %8.2f %12llu %12llu\n",
+                    r.m_batch, r.m_size, r.m_segments,
+                    r.m_sent / r.m_seconds,
+                    r.m_received / r.m_seconds,
+                    r.m_sent ? 100.0 * (r.m_sent - r.m_received) / r.m_sent : 0.0,
+                    (unsigned long long)r.m_send_calls,
+                    (unsigned long long)r.m_recv_calls);
+            }
+        }
+    }
+    return 0;
+}
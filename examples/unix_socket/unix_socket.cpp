@@ -0,0 +1,230 @@
+// unix domain socket 示例
+// 1. pingpong 延迟: TCP 回环 vs unix stream vs unix seqpacket, 同一个线程里一端发一端回
+// 2. 传递描述符: 前端线程 accept TCP 连接, 通过 unix socket (SCM_RIGHTS) 交给 worker 线程,
+//    worker 用 adopt_connection 接管后回显
+//
+// unix_socket [rounds] [clients]
+
+#include <tinyasync/tinyasync.h>
+
+#include <thread>
+
+using namespace tinyasync;
+
+constexpr std::size_t k_msg_size = 64;
+
+// read exactly bytes, false on eof
+Task<bool> read_all(Connection &conn, char *buf, std::size_t bytes)
+{
+    while(bytes) {
+        std::size_t nread = co_await conn.async_read(buf, bytes);
+        if(!nread) {
+            co_return false;
+        }
+        buf += nread;
+        bytes -= nread;
+    }
+    co_return true;
+}
+
+Task<> send_all(Connection &conn, char const *buf, std::size_t bytes)
+{
+    while(bytes) {
+        std::size_t sent = co_await conn.async_send(buf, bytes);
+        buf += sent;
+        bytes -= sent;
+    }
+}
+
+Task<> echo(Connection conn, Name = "echo")
+{
+    char buf[k_msg_size];
+    for(;;) {
+        std::size_t nread = co_await conn.async_read(buf, sizeof(buf));
+        if(!nread) {
+            break;
+        }
+        co_await send_all(conn, buf, nread);
+    }
+}
+
+Task<> pingpong_server(Acceptor &acceptor, Name = "pingpong_server")
+{
+    Connection conn = co_await acceptor.async_accept();
+    co_await echo(std::move(conn));
+}
+
+Task<> pingpong_client(IoContext &ctx, Protocol protocol, Endpoint endpoint, int rounds, double &rtt_us, Name = "pingpong_client")
+{
+    Connection conn = co_await async_connect(ctx, protocol, endpoint);
+    if(protocol.m_family != AF_UNIX) {
+        conn.set_tcp_no_delay();
+    }
+    char buf[k_msg_size] = {};
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < rounds; ++i) {
+        co_await send_all(conn, buf, sizeof(buf));
+        co_await read_all(conn, buf, sizeof(buf));
+    }
+    auto d = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    rtt_us = d / rounds;
+    ctx.request_abort();
+}
+
+double pingpong(Protocol protocol, Endpoint endpoint, int rounds)
+{
+    IoContext ctx(std::false_type{});
+    Acceptor acceptor(ctx, protocol, endpoint);
+    double rtt_us = 0;
+    co_spawn(pingpong_server(acceptor));
+    co_spawn(pingpong_client(ctx, protocol, endpoint, rounds, rtt_us));
+    ctx.run();
+    return rtt_us;
+}
+
+// worker: 从控制连接收描述符, 每收到一个就起一个回显协程
+// 前端关闭控制连接, 并且所有回显都结束后退出
+Task<> worker(IoContext &ctx, Endpoint front, int &handled, Name = "worker")
+{
+    Connection control = co_await async_connect(ctx, Protocol::unix_seqpacket(), front);
+    int active = 0;
+    bool front_closed = false;
+    auto session = [&](Connection conn) -> Task<> {
+        co_await echo(std::move(conn));
+        if(--active == 0 && front_closed) {
+            ctx.request_abort();
+        }
+    };
+
+    for(;;) {
+        char tag;
+        int fds[1];
+        int nfds = 0;
+        std::size_t nread = co_await control.async_read_fds(&tag, 1, fds, 1, nfds);
+        if(!nread) {
+            break;
+        }
+        if(nfds == 1) {
+            ++handled;
+            ++active;
+            co_spawn(session(adopt_connection(ctx, fds[0])));
+        }
+    }
+    front_closed = true;
+    if(active == 0) {
+        ctx.request_abort();
+    }
+}
+
+// front: 接受 worker 的控制连接, 然后把 TCP 连接轮流交给 worker
+Task<> front(IoContext &ctx, Acceptor &control_acceptor, Acceptor &tcp_acceptor, int workers, int clients, Name = "front")
+{
+    std::vector<Connection> controls;
+    for(int i = 0; i < workers; ++i) {
+        controls.push_back(co_await control_acceptor.async_accept());
+    }
+
+    for(int i = 0; i < clients; ++i) {
+        Connection conn = co_await tcp_acceptor.async_accept();
+        // the front's copy is closed after sending, the worker's copy keeps the connection
+        NativeSocket fd = conn.release_handle();
+        char tag = 'c';
+        co_await controls[i % workers].async_send_fds(&tag, 1, &fd, 1);
+        ::close(fd);
+    }
+    ctx.request_abort();
+}
+
+Task<> client(IoContext &ctx, Endpoint endpoint, int rounds, int &done, int &failed, Name = "client")
+{
+    Connection conn = co_await async_connect(ctx, Protocol::ip_v4(), endpoint);
+    conn.set_tcp_no_delay();
+    char out[k_msg_size];
+    char in[k_msg_size];
+    for(int i = 0; i < rounds; ++i) {
+        memset(out, 'a' + i % 26, sizeof(out));
+        co_await send_all(conn, out, sizeof(out));
+        if(!co_await read_all(conn, in, sizeof(in)) || memcmp(in, out, sizeof(in))) {
+            ++failed;
+            break;
+        }
+    }
+    if(++done == 0) {
+        ctx.request_abort();
+    }
+}
+
+void handoff(int workers, int clients, int rounds)
+{
+    Endpoint control_endpoint = Endpoint::unix_path("@tinyasync_unix_socket_front");
+    Endpoint tcp_endpoint(Address(INADDR_LOOPBACK), 8903);
+
+    IoContext front_ctx(std::false_type{});
+    Acceptor control_acceptor(front_ctx, Protocol::unix_seqpacket(), control_endpoint);
+    Acceptor tcp_acceptor(front_ctx, Protocol::ip_v4(), tcp_endpoint);
+
+    std::vector<int> handled(workers);
+    std::vector<std::thread> worker_threads;
+    for(int i = 0; i < workers; ++i) {
+        worker_threads.emplace_back([&, i]() {
+            IoContext ctx(std::false_type{});
+            co_spawn(worker(ctx, control_endpoint, handled[i]));
+            ctx.run();
+        });
+    }
+
+    std::thread front_thread([&]() {
+        co_spawn(front(front_ctx, control_acceptor, tcp_acceptor, workers, clients));
+        front_ctx.run();
+    });
+
+    // clients connect one by one, the listen backlog is small
+    int done = -clients;
+    int failed = 0;
+    auto start = std::chrono::steady_clock::now();
+    {
+        IoContext ctx(std::false_type{});
+        auto run_clients = [&]() -> Task<> {
+            for(int i = 0; i < clients; ++i) {
+                co_spawn(client(ctx, tcp_endpoint, rounds, done, failed));
+                co_await async_sleep(ctx, std::chrono::milliseconds(1));
+            }
+        };
+        co_spawn(run_clients());
+        ctx.run();
+    }
+    auto d = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    front_thread.join();
+    for(auto &t : worker_threads) {
+        t.join();
+    }
+
+    printf("%d clients, %d failed, %.0f msgs/s\n", clients, failed, clients * (double)rounds / d);
+    for(int i = 0; i < workers; ++i) {
+        printf("worker %d handled %d connections\n", i, handled[i]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+    int clients = argc > 2 ? atoi(argv[2]) : 8;
+
+    try {
+        printf("%-16s %10s\n", "transport", "rtt_us");
+        printf("%-16s %10.2f\n", "tcp loopback",
+            pingpong(Protocol::ip_v4(), Endpoint(Address(INADDR_LOOPBACK), 8902), rounds));
+        printf("%-16s %10.2f\n", "unix stream",
+            pingpong(Protocol::unix_stream(), Endpoint::unix_path("/tmp/tinyasync_unix_socket.sock"), rounds));
+        printf("%-16s %10.2f\n", "unix seqpacket",
+            pingpong(Protocol::unix_seqpacket(), Endpoint::unix_path("@tinyasync_unix_socket_seqpacket"), rounds));
+        ::unlink("/tmp/tinyasync_unix_socket.sock");
+
+        handoff(2, clients, rounds / 10);
+    } catch(...) {
+        printf("%s\n", to_string(std::current_exception()).c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+// 慢的读端: 生产者每条消息 co_spawn 一个发送协程 (像 pingpong_server_spawn)
+// unbounded: 一直 spawn, 发不出去的发送挂起, 它们的 buffer 越积越多
+// writable: spawn 之前 co_await conn.writable(), 发送队列停在 high watermark 附近
+// socket 的发送/接收缓冲设得很小, 内核里攒不了多少
+//
+// write_backpressure [messages]
+
+#include <tinyasync/tinyasync.h>
+
+using namespace tinyasync;
+
+constexpr std::size_t k_msg_size = 4 * 1024;
+constexpr int k_socket_buffer = 64 * 1024;
+
+struct State
+{
+    // spawned sends not finished yet, each holds a message
+    int m_pending = 0;
+    int m_peak_pending = 0;
+    std::size_t m_peak_queued = 0;
+    std::size_t m_received = 0;
+};
+
+void set_socket_buffer(Connection &conn, int opt)
+{
+    int size = k_socket_buffer;
+    if(::setsockopt(conn.native_handle(), SOL_SOCKET, opt, &size, sizeof(size)) < 0) {
+        throw_errno("can't set socket buffer");
+    }
+}
+
+Task<> send_one(Connection &conn, std::unique_ptr<char[]> msg, State &state, Name = "send_one")
+{
+    char const *data = msg.get();
+    std::size_t remain = k_msg_size;
+    try {
+        while(remain) {
+            std::size_t sent = co_await conn.async_send(data, remain);
+            if(!sent) {
+                break;
+            }
+            data += sent;
+            remain -= sent;
+        }
+    } catch(...) {
+    }
+    --state.m_pending;
+}
+
+Task<> producer(IoContext &ctx, Acceptor &acceptor, bool bounded, int messages, State &state, Name = "producer")
+{
+    Connection conn = co_await acceptor.async_accept();
+    set_socket_buffer(conn, SO_SNDBUF);
+    for(int i = 0; i < messages; ++i) {
+        if(bounded && !co_await conn.writable()) {
+            break;
+        }
+        std::unique_ptr<char[]> msg(new char[k_msg_size]);
+        memset(msg.get(), 'a' + i % 26, k_msg_size);
+        ++state.m_pending;
+        state.m_peak_pending = std::max(state.m_peak_pending, state.m_pending);
+        co_spawn(send_one(conn, std::move(msg), state));
+        state.m_peak_queued = std::max(state.m_peak_queued, conn.queued_bytes());
+    }
+    while(state.m_pending) {
+        co_await async_sleep(ctx, std::chrono::milliseconds(1));
+    }
+    // the reader sees eof
+    conn.safe_close();
+}
+
+Task<> slow_reader(IoContext &ctx, Endpoint endpoint, State &state, Name = "slow_reader")
+{
+    Connection conn = co_await async_connect(ctx, Protocol::ip_v4(), endpoint);
+    set_socket_buffer(conn, SO_RCVBUF);
+    std::vector<char> buffer(k_socket_buffer);
+    for(;;) {
+        std::size_t nread = co_await conn.async_read(buffer.data(), buffer.size());
+        if(!nread) {
+            break;
+        }
+        state.m_received += nread;
+        co_await async_sleep(ctx, std::chrono::milliseconds(1));
+    }
+    ctx.request_abort();
+}
+
+void run(bool bounded, int messages, uint16_t port)
+{
+    State state;
+    IoContext ctx(std::false_type{});
+    Endpoint endpoint(Address(INADDR_LOOPBACK), port);
+    Acceptor acceptor(ctx, Protocol::ip_v4(), endpoint);
+    co_spawn(producer(ctx, acceptor, bounded, messages, state));
+    co_spawn(slow_reader(ctx, endpoint, state));
+    auto start = std::chrono::steady_clock::now();
+    ctx.run();
+    double d = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-10s %10d %14d %16zu %14zu %8.2f\n", bounded ? "writable" : "unbounded", messages,
+        state.m_peak_pending, state.m_peak_queued / 1024, state.m_received / 1024, d);
+}
+
+int main(int argc, char *argv[])
+{
+    int messages = argc > 1 ? atoi(argv[1]) : 4000;
+    try {
+        printf("%-10s %10s %14s %16s %14s %8s\n", "mode", "messages", "peak_pending", "peak_queued_kb", "received_kb", "seconds");
+        run(false, messages, 8909);
+        run(true, messages, 8910);
+    } catch(...) {
+        printf("%s\n", to_string(std::current_exception()).c_str());
+        return 1;
+    }
+    return 0;
+}
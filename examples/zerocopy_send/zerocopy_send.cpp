@@ -0,0 +1,114 @@
+// 大响应的发送: async_send (拷贝到内核) vs async_send_zerocopy (MSG_ZEROCOPY)
+// 服务端所有连接共用同一个响应 buffer (fan-out), 客户端发 1 字节请求, 收完整个响应算一次
+// 注意: 回环上内核总是拷贝 (copied 是拷贝完成的 MSG_ZEROCOPY 发送次数), 真实网卡上才能看到零拷贝的效果
+//
+// zerocopy_send [port]
+
+#include <tinyasync/tinyasync.h>
+
+using namespace tinyasync;
+
+struct SharedResponse
+{
+    std::vector<char> m_data;
+    bool m_zerocopy = false;
+    uint64_t m_sends = 0;
+    uint64_t m_copied = 0;
+};
+
+Task<> serve(Connection conn, SharedResponse &resp, Name = "serve")
+{
+    for(;;) {
+        char req;
+        std::size_t nread = co_await conn.async_read(&req, 1);
+        if(!nread) {
+            break;
+        }
+        ConstBuffer buffer((std::byte const *)resp.m_data.data(), resp.m_data.size());
+        if(resp.m_zerocopy) {
+            uint64_t copied = conn.zerocopy_copied();
+            co_await conn.async_send_zerocopy(buffer);
+            resp.m_copied += conn.zerocopy_copied() - copied;
+        } else {
+            char const *data = resp.m_data.data();
+            std::size_t remain = resp.m_data.size();
+            while(remain) {
+                std::size_t sent = co_await conn.async_send(data, remain);
+                data += sent;
+                remain -= sent;
+            }
+        }
+        resp.m_sends += 1;
+    }
+}
+
+Task<> listen(Acceptor &acceptor, SharedResponse &resp, Name = "listen")
+{
+    for(;;) {
+        Connection conn = co_await acceptor.async_accept();
+        co_spawn(serve(std::move(conn), resp));
+    }
+}
+
+Task<> client(IoContext &ctx, Endpoint endpoint, std::size_t size, int requests, int &running, Name = "client")
+{
+    Connection conn = co_await async_connect(ctx, Protocol::ip_v4(), endpoint);
+    std::vector<char> buffer(256 * 1024);
+    for(int i = 0; i < requests; ++i) {
+        char req = 'r';
+        co_await conn.async_send(&req, 1);
+        std::size_t remain = size;
+        while(remain) {
+            std::size_t nread = co_await conn.async_read(buffer.data(), std::min(remain, buffer.size()));
+            if(!nread) {
+                throw_error("connection closed", 0);
+            }
+            remain -= nread;
+        }
+    }
+    if(--running == 0) {
+        ctx.request_abort();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // 每个大小发送的总字节数大致相同
+    std::size_t const total = 512 * 1024 * 1024;
+    int const clients = 4;
+    std::size_t const sizes[] = { 8 * 1024, 64 * 1024, 1024 * 1024, 4 * 1024 * 1024 };
+
+    uint16_t port = 8904;
+    if(argc > 1) {
+        port = (uint16_t)atoi(argv[1]);
+    }
+
+    printf("%10s %9s %10s %10s %10s\n", "size", "mode", "MB/s", "sends", "copied");
+    for(std::size_t size : sizes) {
+        for(bool zerocopy : { false, true }) {
+            // server and clients share one single threaded IoContext
+            // a pending MSG_ZEROCOPY send is completed when the client has read the data
+            SharedResponse resp;
+            resp.m_data.assign(size, 'z');
+            resp.m_zerocopy = zerocopy;
+            int requests = std::max<int>(1, (int)(total / size / clients));
+
+            IoContext ctx(std::false_type{});
+            Acceptor acceptor(ctx, Protocol::ip_v4(), Endpoint(Address(INADDR_LOOPBACK), port));
+            co_spawn(listen(acceptor, resp));
+            int running = clients;
+            for(int i = 0; i < clients; ++i) {
+                co_spawn(client(ctx, Endpoint(Address(INADDR_LOOPBACK), port), size, requests, running));
+            }
+            auto start = std::chrono::steady_clock::now();
+            ctx.run();
+            double d = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            printf("%10zu %9s %10.0f %10llu %10llu\n", size, zerocopy ? "zerocopy" : "copy",
+                (double)size * requests * clients / d / (1024 * 1024),
+                (unsigned long long)resp.m_sends,
+                (unsigned long long)resp.m_copied);
+        }
+    }
+    return 0;
+}
@@ -5,11 +5,43 @@ namespace tinyasync {
 
     struct Protocol
     {
+        // AF_INET, AF_INET6 or AF_UNIX
+        int m_family;
+        // SOCK_STREAM, SOCK_DGRAM or SOCK_SEQPACKET
+        int m_type;
 
         static Protocol ip_v4()
         {
-            return {};
+            return { AF_INET, SOCK_STREAM };
+        }
+
+        static Protocol ip_v6()
+        {
+            return { AF_INET6, SOCK_STREAM };
+        }
+
+        static Protocol udp_v4()
+        {
+            return { AF_INET, SOCK_DGRAM };
         }
+
+        static Protocol udp_v6()
+        {
+            return { AF_INET6, SOCK_DGRAM };
+        }
+
+#ifdef __unix__
+        static Protocol unix_stream()
+        {
+            return { AF_UNIX, SOCK_STREAM };
+        }
+
+        // 保留消息边界的可靠连接, 一次 recv 最多收一条消息
+        static Protocol unix_seqpacket()
+        {
+            return { AF_UNIX, SOCK_SEQPACKET };
+        }
+#endif
     };
 
     static_assert(is_trivial_parameter_in_itanium_abi<Protocol>::value);
@@ -17,6 +49,51 @@ namespace tinyasync {
     enum class AddressType {
         IpV4,
         IpV6,
+        Unix,
+    };
+
+#ifdef __unix__
+    constexpr std::size_t k_unix_path_max = sizeof(sockaddr_un::sun_path);
+#else
+    constexpr std::size_t k_unix_path_max = 108;
+#endif
+
+    // AF_UNIX 路径放在 Address 外面, Address 里只存编号
+    // 这样 Address 保持 20 字节 (in6_addr + type) 并且 trivial
+    // 进程内每个不同的路径只存一份, 不释放
+    class UnixPathTable
+    {
+        std::mutex m_mutex;
+        // deque: push_back 不会移动已有的 string
+        std::deque<std::string> m_paths;
+        std::unordered_map<std::string_view, uint32_t> m_ids;
+
+    public:
+        static UnixPathTable &instance()
+        {
+            static UnixPathTable table;
+            return table;
+        }
+
+        uint32_t intern(std::string_view path)
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            auto it = m_ids.find(path);
+            if(it != m_ids.end()) {
+                return it->second;
+            }
+            uint32_t id = (uint32_t)m_paths.size();
+            m_paths.emplace_back(path);
+            m_ids.emplace(m_paths.back(), id);
+            return id;
+        }
+
+        // valid for the life of the process
+        char const *path(uint32_t id)
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            return m_paths[id].c_str();
+        }
     };
 
     struct Address
@@ -54,6 +131,8 @@ namespace tinyasync {
             } else if (m_address_type == AddressType::IpV6) {
                 inet_ntop(AF_INET6, &m_addr6, buf, sizeof(buf));
                 return buf;
+            } else if (m_address_type == AddressType::Unix) {
+                return unix_path();
             }
 #endif
             return "";
@@ -64,17 +143,44 @@ namespace tinyasync {
             return {};
         }
 
+        // AF_UNIX 地址, 端口无意义
+        // 以 '@' 开头的是 linux 的抽象名字空间, 不在文件系统里创建文件
+        static Address unix_path(std::string_view path)
+        {
+            if(path.empty() || path.size() >= k_unix_path_max) {
+                throw_error(format("bad unix socket path (%d bytes)", (int)path.size()), 0);
+            }
+            Address addr;
+            addr.m_address_type = AddressType::Unix;
+            addr.m_unix_path_id = UnixPathTable::instance().intern(path);
+            return addr;
+        }
+
+        // null terminated
+        char const *unix_path() const
+        {
+            TINYASYNC_ASSERT(m_address_type == AddressType::Unix);
+            return UnixPathTable::instance().path(m_unix_path_id);
+        }
+
+        bool is_abstract_unix_path() const
+        {
+            return m_address_type == AddressType::Unix && unix_path()[0] == '@';
+        }
+
         union
         {
             uint32_t m_int4;
             in_addr m_addr4;
             in6_addr m_addr6;
-
+            // see UnixPathTable
+            uint32_t m_unix_path_id;
         };
         AddressType m_address_type;
     };
     static_assert(is_trivial_parameter_in_itanium_abi<Address>::value);
     static_assert(has_trivial_five<Address>::value);
+    static_assert(sizeof(Address) <= 20);
 
     struct Endpoint
     {
@@ -87,6 +193,11 @@ namespace tinyasync {
         {
         }
 
+        static Endpoint unix_path(std::string_view path)
+        {
+            return Endpoint(Address::unix_path(path), 0);
+        }
+
         Address address() const noexcept {
             return m_address;
         }
@@ -155,14 +266,14 @@ namespace tinyasync {
             flags = WSA_FLAG_OVERLAPPED;
         }
 
-        auto socket_ = ::WSASocketW(AF_INET, SOCK_STREAM, 0, NULL, 0, flags);
+        auto socket_ = ::WSASocketW(protocol.m_family, protocol.m_type, 0, NULL, 0, flags);
         if (socket_ == INVALID_SOCKET) {
             throw_WASError("can't create socket");
         }
 
 #elif defined(__unix__)
         // PF means protocol
-        auto socket_ = ::socket(PF_INET, SOCK_STREAM, 0);
+        auto socket_ = ::socket(protocol.m_family, protocol.m_type, 0);
         if (socket_ == -1) {
             throw_errno("can't create socket");
         }
@@ -175,6 +286,73 @@ namespace tinyasync {
 
     }
 
+#ifdef __unix__
+    // @return the length of addr
+    inline socklen_t endpoint_to_sockaddr(Endpoint const &endpoint, sockaddr_storage &addr)
+    {
+        memset(&addr, 0, sizeof(addr));
+        auto address_type = endpoint.address().m_address_type;
+        if(address_type == AddressType::IpV4) {
+            auto &addr4 = (sockaddr_in &)addr;
+            addr4.sin_family = AF_INET;
+            addr4.sin_port = htons(endpoint.port());
+            addr4.sin_addr = endpoint.address().m_addr4;
+            return sizeof(sockaddr_in);
+        } else if(address_type == AddressType::IpV6) {
+            auto &addr6 = (sockaddr_in6 &)addr;
+            addr6.sin6_family = AF_INET6;
+            addr6.sin6_port = htons(endpoint.port());
+            addr6.sin6_addr = endpoint.address().m_addr6;
+            return sizeof(sockaddr_in6);
+        } else {
+            auto &addrun = (sockaddr_un &)addr;
+            addrun.sun_family = AF_UNIX;
+            auto path = endpoint.address().unix_path();
+            std::size_t len = strlen(path);
+            memcpy(addrun.sun_path, path, len);
+            if(path[0] == '@') {
+                // 抽象名字: 第一个字节是 0, 名字不以 0 结尾, 长度算到最后一个字符
+                addrun.sun_path[0] = 0;
+                return (socklen_t)(offsetof(sockaddr_un, sun_path) + len);
+            }
+            return (socklen_t)(offsetof(sockaddr_un, sun_path) + len + 1);
+        }
+    }
+
+    // addr_len is needed by AF_UNIX, the abstract name is not null terminated
+    inline Endpoint endpoint_from_sockaddr(sockaddr_storage const &addr, socklen_t addr_len = sizeof(sockaddr_storage))
+    {
+        Address address;
+        if(addr.ss_family == AF_INET6) {
+            auto &addr6 = (sockaddr_in6 const &)addr;
+            address.m_addr6 = addr6.sin6_addr;
+            address.m_address_type = AddressType::IpV6;
+            return Endpoint(address, ntohs(addr6.sin6_port));
+        } else if(addr.ss_family == AF_UNIX) {
+            auto &addrun = (sockaddr_un const &)addr;
+            address.m_address_type = AddressType::Unix;
+            std::size_t len = 0;
+            if(addr_len > offsetof(sockaddr_un, sun_path)) {
+                len = std::min<std::size_t>(addr_len - offsetof(sockaddr_un, sun_path), k_unix_path_max - 1);
+            }
+            // unnamed socket (e.g. the client side) has an empty path
+            char path[k_unix_path_max];
+            if(len && addrun.sun_path[0] == 0) {
+                memcpy(path, addrun.sun_path, len);
+                path[0] = '@';
+            } else {
+                len = strnlen(addrun.sun_path, len);
+                memcpy(path, addrun.sun_path, len);
+            }
+            address.m_unix_path_id = UnixPathTable::instance().intern(std::string_view(path, len));
+            return Endpoint(address, 0);
+        }
+        auto &addr4 = (sockaddr_in const &)addr;
+        address.m_addr4 = addr4.sin_addr;
+        return Endpoint(address, ntohs(addr4.sin_port));
+    }
+#endif
+
     inline void bind_socket(NativeSocket socket, Endpoint const& endpoint)
     {
 
@@ -183,6 +361,7 @@ namespace tinyasync {
 
 
         int binderr;
+#ifdef _WIN32
         if(endpoint.address().m_address_type == AddressType::IpV4)
         {
             sockaddr_in serveraddr;
@@ -200,6 +379,11 @@ namespace tinyasync {
             serveraddr.sin6_addr = endpoint.address().m_addr6;
             binderr = ::bind(socket, (sockaddr*)&serveraddr, sizeof(serveraddr));
         }
+#elif defined(__unix__)
+        sockaddr_storage serveraddr;
+        socklen_t addr_len = endpoint_to_sockaddr(endpoint, serveraddr);
+        binderr = ::bind(socket, (sockaddr*)&serveraddr, addr_len);
+#endif
 
 #ifdef _WIN32
 
@@ -216,6 +400,34 @@ namespace tinyasync {
     }
 
 
+#ifdef __unix__
+    // 一次 sendmsg/recvmsg 最多传递的文件描述符个数 (内核上限 SCM_MAX_FD 是 253)
+    constexpr int k_max_pass_fds = 64;
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+    // 小于这个大小时 MSG_ZEROCOPY 的页面固定和完成通知比拷贝还贵
+    constexpr std::size_t k_zerocopy_threshold = 16 * 1024;
+
+    // 发送 IoBuf 链时一次 sendmsg 最多的节数
+    constexpr int k_max_iobuf_iov = 64;
+#endif
+
+    // 连接的发送队列超过 high watermark 后 writable() 挂起, 降到 low watermark 以下再唤醒
+    constexpr std::size_t k_default_low_watermark = 32 * 1024;
+    constexpr std::size_t k_default_high_watermark = 64 * 1024;
+
     template<class Awaiter, class Buffer>
     class DataAwaiterMixin {
     public:
@@ -254,6 +466,74 @@ namespace tinyasync {
 
         AsyncReceiveAwaiter(ConnImpl& conn, void* b, std::size_t n,bool timeOutFlag);
 
+#ifdef __unix__
+        // SCM_RIGHTS: 收到的文件描述符写到 m_fds, 个数写到 *m_nfds
+        // 多出 m_max_fds 的描述符直接关闭
+        int *m_fds = nullptr;
+        int m_max_fds = 0;
+        int *m_nfds = nullptr;
+        AsyncReceiveAwaiter(ConnImpl& conn, void* b, std::size_t n, int *fds, int max_fds, int &nfds);
+
+        // async_read_pooled: 挂起时不占 buffer, 可读了才从 ctx 的 BufferPool 拿一个
+        PooledBuffer *m_pooled = nullptr;
+        AsyncReceiveAwaiter(ConnImpl& conn, PooledBuffer &out);
+
+        ssize_t recv_pooled(NativeSocket conn_handle)
+        {
+            auto &pool = m_ctx->m_buffer_pool;
+            std::byte *data = pool.alloc();
+            auto nbytes = ::recv(conn_handle, data, m_buffer_size, 0);
+            if(nbytes > 0) {
+                m_pooled->reset(&pool, data, (std::size_t)nbytes);
+            } else {
+                // EAGAIN, eof or error, give the buffer back at once
+                int err = errno;
+                pool.free(data);
+                errno = err;
+            }
+            return nbytes;
+        }
+
+        ssize_t recv_some(NativeSocket conn_handle)
+        {
+            if(m_pooled) {
+                return recv_pooled(conn_handle);
+            }
+            if(!m_fds) {
+                return ::recv(conn_handle, m_buffer_addr, m_buffer_size, 0);
+            }
+
+            iovec iov = { m_buffer_addr, m_buffer_size };
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * k_max_pass_fds)];
+            msghdr msg = {};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            auto nbytes = ::recvmsg(conn_handle, &msg, MSG_CMSG_CLOEXEC);
+            if(nbytes < 0) {
+                return nbytes;
+            }
+            for(auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                    continue;
+                }
+                int n = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                int const *fds = (int const *)CMSG_DATA(cmsg);
+                for(int i = 0; i < n; ++i) {
+                    int fd;
+                    memcpy(&fd, fds + i, sizeof(int));
+                    if(*m_nfds < m_max_fds) {
+                        m_fds[(*m_nfds)++] = fd;
+                    } else {
+                        ::close(fd);
+                    }
+                }
+            }
+            return nbytes;
+        }
+#endif
+
         // static AsyncReceiveAwaiter *from_node(ListNode *node) {
         //     return (AsyncReceiveAwaiter *)((char*)node - offsetof(AsyncReceiveAwaiter, m_node));
         // }
@@ -303,6 +583,55 @@ namespace tinyasync {
         friend class ConnImpl;
         AsyncSendAwaiter(ConnImpl& conn, void const* b, std::size_t n);
 
+#ifdef __unix__
+        // gather write, m_buffer_size is the total bytes
+        // iov must be alive until resumed
+        iovec const *m_iov = nullptr;
+        int m_iovcnt = 0;
+        AsyncSendAwaiter(ConnImpl& conn, iovec const* iov, int iovcnt);
+
+        // SCM_RIGHTS: 描述符随第一个字节一起发出去, 发送后调用方可以关闭自己的副本
+        int const *m_fds = nullptr;
+        int m_nfds = 0;
+
+        // MSG_ZEROCOPY: 每次成功的发送加一, 内核按这个序号发完成通知
+        uint32_t *m_zerocopy_sent = nullptr;
+        AsyncSendAwaiter(ConnImpl& conn, void const* b, std::size_t n, int const *fds, int nfds);
+
+        ssize_t send_some(NativeSocket conn_handle)
+        {
+            if(m_zerocopy_sent) {
+                auto nbytes = ::send(conn_handle, m_buffer_addr, m_buffer_size, MSG_ZEROCOPY | MSG_NOSIGNAL);
+                if(nbytes > 0) {
+                    ++*m_zerocopy_sent;
+                } else if(nbytes == -1 && errno == ENOBUFS) {
+                    // optmem_max 用完了, 这一段先拷贝发送
+                    nbytes = ::send(conn_handle, m_buffer_addr, m_buffer_size, MSG_NOSIGNAL);
+                }
+                return nbytes;
+            }
+            if(m_iov || m_fds) {
+                iovec single = { (void*)m_buffer_addr, m_buffer_size };
+                msghdr msg = {};
+                msg.msg_iov = m_iov ? (iovec*)m_iov : &single;
+                msg.msg_iovlen = m_iov ? m_iovcnt : 1;
+                alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * k_max_pass_fds)];
+                if(m_fds) {
+                    msg.msg_control = control;
+                    msg.msg_controllen = CMSG_SPACE(sizeof(int) * m_nfds);
+                    auto cmsg = CMSG_FIRSTHDR(&msg);
+                    cmsg->cmsg_level = SOL_SOCKET;
+                    cmsg->cmsg_type = SCM_RIGHTS;
+                    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * m_nfds);
+                    memcpy(CMSG_DATA(cmsg), m_fds, sizeof(int) * m_nfds);
+                }
+                // a closed peer gets EPIPE instead of SIGPIPE
+                return ::sendmsg(conn_handle, &msg, MSG_NOSIGNAL);
+            }
+            return ::send(conn_handle, m_buffer_addr, m_buffer_size, 0);
+        }
+#endif
+
         bool await_ready();
 
         template<class Promise>
@@ -317,32 +646,126 @@ namespace tinyasync {
 
     };
 
-    class ConnImpl
+#ifdef __unix__
+    // 等待 MSG_ZEROCOPY 的完成通知, 通知之前内核还在引用用户的 buffer
+    class TINYASYNC_NODISCARD ZeroCopyAwaiter
+    {
+    public:
+        friend class ConnImpl;
+        // 和 WritableAwaiter 一样用 post task 唤醒, 不嵌套 resume
+        PostTask m_post_task;
+        ZeroCopyAwaiter *m_next = nullptr;
+        ConnImpl *m_conn;
+        // 等到第 m_target 次发送的通知
+        uint32_t m_target;
+        bool m_closed = false;
+        std::coroutine_handle<TaskPromiseBase> m_suspend_coroutine;
+
+        ZeroCopyAwaiter(ConnImpl &conn, uint32_t target) : m_conn(&conn), m_target(target)
+        {
+        }
+
+        bool await_ready();
+
+        template<class Promise>
+        inline bool await_suspend(std::coroutine_handle<Promise> suspend_coroutine) {
+            std::coroutine_handle<TaskPromiseBase> h = suspend_coroutine.promise().coroutine_handle_base();
+            return await_suspend(h);
+        }
+
+        bool await_suspend(std::coroutine_handle<TaskPromiseBase> h);
+        void await_resume();
+
+        static void on_zerocopy_done(PostTask *task);
+    };
+#endif
+
+    // 等连接的发送队列降下来, 见 Connection::writable()
+    class TINYASYNC_NODISCARD WritableAwaiter
+    {
+    public:
+        friend class ConnImpl;
+        // 队列降下来时用 post task 唤醒, 不在发送的 resume 里嵌套 resume
+        PostTask m_post_task;
+        WritableAwaiter *m_next = nullptr;
+        ConnImpl *m_conn;
+        bool m_closed = false;
+        std::coroutine_handle<TaskPromiseBase> m_suspend_coroutine;
+
+        WritableAwaiter(ConnImpl &conn) : m_conn(&conn)
+        {
+        }
+
+        bool await_ready();
+
+        template<class Promise>
+        inline bool await_suspend(std::coroutine_handle<Promise> suspend_coroutine) {
+            std::coroutine_handle<TaskPromiseBase> h = suspend_coroutine.promise().coroutine_handle_base();
+            return await_suspend(h);
+        }
+
+        bool await_suspend(std::coroutine_handle<TaskPromiseBase> h);
+        bool await_resume();
+
+        static void on_writable(PostTask *task);
+    };
+
+    // 从 IoCtx 的 m_conn_slab 申请 (create/release), 不用 new/delete
+    // 按 cache line 对齐, 热的字段都在第一条 cache line 里
+    class alignas(64) ConnImpl
     {
         friend class Connection;
         friend class AsyncReceiveAwaiter;
         friend class AsyncSendAwaiter;
         friend class AsyncCloseAwaiter;
         friend class ConnCallback;
+        friend class WritableAwaiter;
 
 
-        IoCtxBase* m_ctx;
-        NativeSocket m_conn_handle;        
+        // 第一条 cache line: on_callback 和 await_suspend 每次都要碰的字段
         Callback m_callback;
         AsyncReceiveAwaiter* m_recv_awaiter = nullptr; // 一个链表
         AsyncSendAwaiter* m_send_awaiter = nullptr;
-        PostTask m_post_task;
-
+        IoCtxBase* m_ctx;
+        NativeSocket m_conn_handle;
         // one for connection
         // one for close
-        int m_ref_cnt = 2;
-        bool m_added_to_event_pool = false;
-
-        bool m_recv_shutdown = false;
-        bool m_send_shutdown = false;
+        uint8_t m_ref_cnt = 2;
         bool m_ready_to_send = true;
         bool m_ready_to_recv = true;
+        bool m_recv_shutdown = false;
+        bool m_send_shutdown = false;
+        bool m_added_to_event_pool = false;
         bool m_tcp_nodelay = false;
+        // 超过 high watermark 后一直到降到 low watermark 之前是 true
+        bool m_write_blocked = false;
+#ifdef __unix__
+        // SO_ZEROCOPY 设置成功
+        bool m_zerocopy_enabled = false;
+#endif
+        // only touched by the thread handling this connection
+        uint64_t m_bytes_received = 0;
+        uint64_t m_bytes_sent = 0;
+
+        // 下面的只在 close, 发送队列满, zerocopy 的时候用
+        PostTask m_post_task;
+
+        // 发送队列: 挂起等 EPOLLOUT 的 async_send 的字节数
+        std::size_t m_queued_bytes = 0;
+        std::size_t m_low_watermark = k_default_low_watermark;
+        std::size_t m_high_watermark = k_default_high_watermark;
+        WritableAwaiter *m_writable_awaiter = nullptr;
+
+#ifdef __unix__
+        friend class ZeroCopyAwaiter;
+        // SO_ZEROCOPY 设置失败, 和 m_zerocopy_enabled 都没有就是还没试过
+        bool m_zerocopy_unsupported = false;
+        // MSG_ZEROCOPY 发送次数, 收到完成通知的次数, 以及内核其实拷贝了的次数 (比如回环)
+        uint32_t m_zerocopy_sent = 0;
+        uint32_t m_zerocopy_done = 0;
+        uint64_t m_zerocopy_copied = 0;
+        ZeroCopyAwaiter *m_zerocopy_awaiter = nullptr;
+#endif
 
     public:
 
@@ -456,6 +879,42 @@ namespace tinyasync {
             return { *this, buffer, bytes ,true};
         }
 
+        void set_write_watermarks(std::size_t low, std::size_t high)
+        {
+            if(low > high) {
+                throw_error(format("low watermark %zu is above high watermark %zu", low, high), 0);
+            }
+            m_low_watermark = low;
+            m_high_watermark = high;
+            if(m_queued_bytes > m_high_watermark) {
+                m_write_blocked = true;
+            } else if(m_write_blocked && m_queued_bytes <= m_low_watermark) {
+                m_write_blocked = false;
+                wakeup_writable_awaiters();
+            }
+        }
+
+        void add_queued_bytes(std::size_t n)
+        {
+            m_queued_bytes += n;
+            if(m_queued_bytes > m_high_watermark) {
+                m_write_blocked = true;
+            }
+        }
+
+        void sub_queued_bytes(std::size_t n)
+        {
+            TINYASYNC_ASSERT(n <= m_queued_bytes);
+            m_queued_bytes -= n;
+            // a closed connection wakes them in wakeup_awaiter_on_close
+            if(m_write_blocked && m_queued_bytes <= m_low_watermark && m_conn_handle != NULL_SOCKET) {
+                m_write_blocked = false;
+                wakeup_writable_awaiters();
+            }
+        }
+
+        void wakeup_writable_awaiters();
+
         AsyncSendAwaiter async_send(void const* buffer, std::size_t bytes)
         {
             TINYASYNC_GUARD("Connection.send(): ");
@@ -463,6 +922,106 @@ namespace tinyasync {
             return { *this, buffer, bytes };
         }
 
+#ifdef __unix__
+        AsyncSendAwaiter async_sendv(iovec const* iov, int iovcnt)
+        {
+            return { *this, iov, iovcnt };
+        }
+
+        AsyncSendAwaiter async_send_fds(void const* buffer, std::size_t bytes, int const* fds, int nfds)
+        {
+            return { *this, buffer, bytes, fds, nfds };
+        }
+
+        AsyncReceiveAwaiter async_read_fds(void* buffer, std::size_t bytes, int* fds, int max_fds, int &nfds)
+        {
+            return { *this, buffer, bytes, fds, max_fds, nfds };
+        }
+
+        AsyncReceiveAwaiter async_read_pooled(PooledBuffer &out)
+        {
+            return { *this, out };
+        }
+
+        // 设置一次 SO_ZEROCOPY, 不支持 (老内核, unix socket) 返回 false
+        bool enable_zerocopy()
+        {
+            if(!m_zerocopy_enabled && !m_zerocopy_unsupported) {
+                int on = 1;
+                if(::setsockopt(m_conn_handle, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0) {
+                    m_zerocopy_enabled = true;
+                } else {
+                    m_zerocopy_unsupported = true;
+                }
+            }
+            return m_zerocopy_enabled;
+        }
+
+        AsyncSendAwaiter async_send_zerocopy_some(void const* buffer, std::size_t bytes)
+        {
+            AsyncSendAwaiter awaiter = { *this, buffer, bytes };
+            awaiter.m_zerocopy_sent = &m_zerocopy_sent;
+            return awaiter;
+        }
+
+        // 从 error queue 读完成通知, 只更新计数
+        void drain_zerocopy()
+        {
+            for(;;) {
+                alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+                msghdr msg = {};
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+                if(::recvmsg(m_conn_handle, &msg, MSG_ERRQUEUE) == -1) {
+                    // EAGAIN, the queue is empty
+                    break;
+                }
+                for(auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                    bool recverr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                        || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+                    if(!recverr) {
+                        continue;
+                    }
+                    sock_extended_err serr;
+                    memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+                    if(serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                        continue;
+                    }
+                    // [ee_info, ee_data] 这个区间的发送都完成了
+                    uint32_t n = serr.ee_data - serr.ee_info + 1;
+                    m_zerocopy_done += n;
+                    if(serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                        m_zerocopy_copied += n;
+                    }
+                }
+            }
+        }
+
+        // 等到了的 ZeroCopyAwaiter 用 post task 唤醒
+        void wakeup_zerocopy_awaiters();
+#endif
+
+        static ConnImpl *create(IoCtxBase &ctx, NativeSocket conn_sock, bool added_event_poll)
+        {
+            void *p = ctx.m_conn_slab.alloc(sizeof(ConnImpl));
+            try {
+                return new(p) ConnImpl(ctx, conn_sock, added_event_poll);
+            } catch(...) {
+                ctx.m_conn_slab.free(p, sizeof(ConnImpl));
+                throw;
+            }
+        }
+
+        // the connection and the close task each hold a reference
+        void release()
+        {
+            if(!--m_ref_cnt) {
+                auto ctx = m_ctx;
+                this->~ConnImpl();
+                ctx->m_conn_slab.free(this, sizeof(ConnImpl));
+            }
+        }
+
         static void wakeup_awaiter_on_close(PostTask *posttask)
         {
             using this_type = ConnImpl;
@@ -490,10 +1049,27 @@ namespace tinyasync {
                 awaiter = next;
             }
 
-            conn->m_ref_cnt--;
-            if(!conn->m_ref_cnt) {
-                delete conn;
+            auto writable_awaiter = conn->m_writable_awaiter;
+            conn->m_writable_awaiter = nullptr;
+            while(writable_awaiter) {
+                auto next = writable_awaiter->m_next;
+                writable_awaiter->m_closed = true;
+                TINYASYNC_RESUME(writable_awaiter->m_suspend_coroutine);
+                writable_awaiter = next;
             }
+
+#ifdef __unix__
+            auto zerocopy_awaiter = conn->m_zerocopy_awaiter;
+            conn->m_zerocopy_awaiter = nullptr;
+            while(zerocopy_awaiter) {
+                auto next = zerocopy_awaiter->m_next;
+                zerocopy_awaiter->m_closed = true;
+                TINYASYNC_RESUME(zerocopy_awaiter->m_suspend_coroutine);
+                zerocopy_awaiter = next;
+            }
+#endif
+
+            conn->release();
         }
 
         bool is_any_shutdown() const
@@ -536,7 +1112,7 @@ namespace tinyasync {
                 shutdown_recv_send();
             } else if(!is_send_shutdown()) {
                 shutdown_send();
-            } else {
+            } else if(!is_recv_shutdown()) {
                 shutdown_recv();
             } 
         }
@@ -581,6 +1157,7 @@ namespace tinyasync {
         {
             TINYASYNC_GUARD("Connection:close(): ");
             auto conn_handle = m_conn_handle;
+            TINYASYNC_TRACE_EVENT(Close, conn_handle, this);
 
             if(close_socket(conn_handle) < 0) {
                 TINYASYNC_LOG("close error");
@@ -599,10 +1176,33 @@ namespace tinyasync {
             // we should never recv any epoll_event
             // thus we can delete connection
             m_post_task.set_callback(wakeup_awaiter_on_close);
-            m_ctx->post_task(&m_post_task);
+            m_ctx->defer_task(&m_post_task);
 
         }
 
+        // 交出 socket, 不 shutdown 也不 close, 例如通过 unix socket 传给别的线程/进程
+        // 之后和 close() 一样, 挂起的 awaiter 收到 ENOTSOCK
+        NativeSocket release_handle()
+        {
+            auto conn_handle = m_conn_handle;
+            TINYASYNC_ASSERT(conn_handle);
+#ifdef __unix__
+            if(m_added_to_event_pool) {
+                if(epoll_ctl(m_ctx->event_poll_handle(), EPOLL_CTL_DEL, conn_handle, NULL) == -1) {
+                    throw_errno(format("can't remove (from epoll) socket %s", socket_c_str(conn_handle)));
+                }
+            }
+#endif
+            m_conn_handle = NULL_SOCKET;
+            m_send_shutdown = true;
+            m_recv_shutdown = true;
+            m_added_to_event_pool = false;
+
+            m_post_task.set_callback(wakeup_awaiter_on_close);
+            m_ctx->defer_task(&m_post_task);
+            return conn_handle;
+        }
+
         ~ConnImpl() noexcept
         {
             TINYASYNC_GUARD("ConnImpl::~ConnImpl() ");
@@ -612,9 +1212,16 @@ namespace tinyasync {
 
     };
 
+#ifdef __unix__
+    static_assert(sizeof(ConnImpl) % 64 == 0 && sizeof(ConnImpl) <= SlabPool::k_max_size);
+#endif
+
     inline void ConnImpl::on_callback(Callback *callback, IoEvent& evt)
     {
         TINYASYNC_GUARD("ConnCallback.callback(): ");
+#ifdef __unix__
+        static_assert(offsetof(ConnImpl, m_bytes_sent) + sizeof(uint64_t) <= 64, "hot fields of ConnImpl don't fit in a cache line");
+#endif
         ConnImpl* conn = (ConnImpl*)((char*)callback - offsetof(ConnImpl, m_callback));
         auto conn_handle = conn->m_conn_handle;        
 
@@ -656,8 +1263,13 @@ namespace tinyasync {
             conn->m_ready_to_send = true;
         }
 
+        if((events & EPOLLERR) && conn->m_zerocopy_enabled) {
+            // MSG_ZEROCOPY 完成通知在 error queue 里
+            conn->drain_zerocopy();
+            conn->wakeup_zerocopy_awaiters();
+        }
+
         auto recv_awaiter = conn->m_recv_awaiter;
-        auto send_awaiter = conn->m_send_awaiter;
 
         if ((events & EPOLLIN) && recv_awaiter) {
             // we want to read and it's ready to read
@@ -669,7 +1281,11 @@ namespace tinyasync {
                 TINYASYNC_LOG("ready to read for conn_handle %d, %d bytes at %p reading",
                     conn_handle, (int)awaiter->m_buffer_size, awaiter->m_buffer_addr);
 
-                int nbytes = ::recv(conn_handle, awaiter->m_buffer_addr, (int)awaiter->m_buffer_size, 0);
+                int nbytes = (int)awaiter->recv_some(conn_handle);
+                TINYASYNC_TRACE_EVENT(Recv, conn_handle, awaiter);
+                if(nbytes > 0) {
+                    conn->m_bytes_received += nbytes;
+                }
 
                 TINYASYNC_LOG("recv %d bytes", nbytes);
 
@@ -688,10 +1304,23 @@ namespace tinyasync {
                     break;
                 }
 
-                awaiter = awaiter->m_next;
+                // the resumed awaiter is popped and its frame may be gone, start from the head again
+                // the close task keeps conn alive until it runs
+                if(conn->m_conn_handle == NULL_SOCKET) {
+                    return;
+                }
+                awaiter = conn->m_recv_awaiter;
             } while(awaiter);
 
         }
+
+        if(conn->m_conn_handle == NULL_SOCKET) {
+            // closed by a resumed reader
+            return;
+        }
+
+        // the resumed readers may have sent
+        auto send_awaiter = conn->m_send_awaiter;
         
         if((events & EPOLLOUT) && send_awaiter)
         {
@@ -707,7 +1336,11 @@ namespace tinyasync {
                 TINYASYNC_LOG("ready to send for conn_handle %d, %d bytes at %p sending",
                     conn_handle, (int)awaiter->m_buffer_size, awaiter->m_buffer_addr);
 
-                int nbytes = ::send(conn_handle, awaiter->m_buffer_addr, (int)awaiter->m_buffer_size, 0);
+                int nbytes = (int)awaiter->send_some(conn_handle);
+                TINYASYNC_TRACE_EVENT(Send, conn_handle, awaiter);
+                if(nbytes > 0) {
+                    conn->m_bytes_sent += nbytes;
+                }
 
                 TINYASYNC_LOG("sent %d bytes", nbytes);
 
@@ -725,11 +1358,14 @@ namespace tinyasync {
                     break;
                 }
 
-                awaiter = awaiter->m_next;
+                if(conn->m_conn_handle == NULL_SOCKET) {
+                    return;
+                }
+                awaiter = conn->m_send_awaiter;
             } while(awaiter);
         }
         
-        if(!(   events & (EPOLLIN|EPOLLOUT) )) {
+        if(!(   events & (EPOLLIN|EPOLLOUT) ) && !conn->m_zerocopy_enabled) {
             TINYASYNC_LOG("not processed event for conn_handle %x", errno, conn->m_conn_handle);
             fprintf(stderr, "%s\n", ioe2str(evt).c_str());
             exit(1);
@@ -757,6 +1393,24 @@ namespace tinyasync {
         m_timeout_flag = timeOutFlag;
     }
 
+#ifdef __unix__
+    AsyncReceiveAwaiter::AsyncReceiveAwaiter(ConnImpl& conn, void* b, std::size_t n, int *fds, int max_fds, int &nfds)
+        : AsyncReceiveAwaiter::AsyncReceiveAwaiter(conn, b, n)
+    {
+        m_fds = fds;
+        m_max_fds = max_fds;
+        m_nfds = &nfds;
+        nfds = 0;
+    }
+
+    AsyncReceiveAwaiter::AsyncReceiveAwaiter(ConnImpl& conn, PooledBuffer &out)
+        : AsyncReceiveAwaiter::AsyncReceiveAwaiter(conn, nullptr, conn.m_ctx->m_buffer_pool.buffer_size())
+    {
+        m_pooled = &out;
+        out.reset();
+    }
+#endif
+
 
     bool AsyncReceiveAwaiter::await_ready()
     {
@@ -808,7 +1462,8 @@ namespace tinyasync {
 #elif defined(__unix__)
 
     if(conn->m_ready_to_recv) {
-        auto nbytes = ::recv(conn_handle, m_buffer_addr, m_buffer_size, 0);
+        auto nbytes = recv_some(conn_handle);
+        TINYASYNC_TRACE_EVENT(Recv, conn_handle, this);
         if(nbytes == -1) {
             if(errno == EAGAIN || errno == EWOULDBLOCK) {
                 conn->m_ready_to_recv = false;
@@ -816,6 +1471,7 @@ namespace tinyasync {
                 throw_errno("recv error");
             }
         } else {
+            conn->m_bytes_received += nbytes;
             m_suspend_return = false;
             m_bytes_transfer = (std::ptrdiff_t)nbytes;
             return false;
@@ -927,6 +1583,32 @@ namespace tinyasync {
         m_bytes_transfer = 0;
     }
 
+#ifdef __unix__
+    AsyncSendAwaiter::AsyncSendAwaiter(ConnImpl& conn, iovec const* iov, int iovcnt)
+        : AsyncSendAwaiter(conn, (void const*)nullptr, 0)
+    {
+        m_iov = iov;
+        m_iovcnt = iovcnt;
+        for(int i = 0; i < iovcnt; ++i) {
+            m_buffer_size += iov[i].iov_len;
+        }
+    }
+
+    AsyncSendAwaiter::AsyncSendAwaiter(ConnImpl& conn, void const* b, std::size_t n, int const *fds, int nfds)
+        : AsyncSendAwaiter(conn, b, n)
+    {
+        // 流式 socket 不能只发描述符不发数据
+        TINYASYNC_ASSERT(n > 0);
+        if(nfds < 0 || nfds > k_max_pass_fds) {
+            throw_error(format("can't pass %d fds, at most %d", nfds, k_max_pass_fds), 0);
+        }
+        if(nfds) {
+            m_fds = fds;
+            m_nfds = nfds;
+        }
+    }
+#endif
+
     bool AsyncSendAwaiter::await_ready()
     {
         auto conn = m_conn;
@@ -978,7 +1660,8 @@ namespace tinyasync {
 
 #elif defined(__unix__)
         if(conn->m_ready_to_send) {
-            auto nbytes = ::send(conn_handle, m_buffer_addr, m_buffer_size, 0);
+            auto nbytes = send_some(conn_handle);
+            TINYASYNC_TRACE_EVENT(Send, conn_handle, this);
             if(nbytes == -1) {
                 if(errno == EAGAIN) {
                     conn->m_ready_to_send = false;
@@ -986,6 +1669,7 @@ namespace tinyasync {
                     throw_errno("send error");
                 }
             } else {
+                conn->m_bytes_sent += nbytes;
                 m_bytes_transfer = (std::ptrdiff_t)nbytes;
                 m_suspend_return = false;
                 return false;
@@ -997,6 +1681,7 @@ namespace tinyasync {
         this->m_next = m_conn->m_send_awaiter;
         m_conn->m_send_awaiter = this;
         TINYASYNC_LOG("set send_awaiter of conn(%p) to %p", m_conn, m_conn->m_send_awaiter);
+        m_conn->add_queued_bytes(m_buffer_size);
         m_suspend_return = true;
         return true;
 #endif
@@ -1017,6 +1702,9 @@ namespace tinyasync {
         if(m_suspend_return) {
             // pop from front of list
             m_conn->m_send_awaiter = m_conn->m_send_awaiter->m_next;
+#ifdef __unix__
+            m_conn->sub_queued_bytes(m_buffer_size);
+#endif
         }
 
         if (nbytes < 0) {
@@ -1035,12 +1723,127 @@ namespace tinyasync {
         return m_bytes_transfer;
     }
 
+#ifdef __unix__
+    bool ZeroCopyAwaiter::await_ready()
+    {
+        auto conn = m_conn;
+        if(!conn->native_handle()) {
+            m_closed = true;
+            return true;
+        }
+        return (int32_t)(conn->m_zerocopy_done - m_target) >= 0;
+    }
+
+    bool ZeroCopyAwaiter::await_suspend(std::coroutine_handle<TaskPromiseBase> h)
+    {
+        auto conn = m_conn;
+        // the notification may be queued before any EPOLLERR is handled
+        // the other awaiters it wakes up are resumed later by post tasks
+        conn->drain_zerocopy();
+        conn->wakeup_zerocopy_awaiters();
+        if((int32_t)(conn->m_zerocopy_done - m_target) >= 0) {
+            return false;
+        }
+        m_suspend_coroutine = h;
+        m_next = conn->m_zerocopy_awaiter;
+        conn->m_zerocopy_awaiter = this;
+        return true;
+    }
+
+    inline void ZeroCopyAwaiter::on_zerocopy_done(PostTask *task)
+    {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+        auto awaiter = (ZeroCopyAwaiter *)((char *)task - offsetof(ZeroCopyAwaiter, m_post_task));
+#pragma GCC diagnostic pop
+        TINYASYNC_RESUME(awaiter->m_suspend_coroutine);
+    }
+
+    inline void ConnImpl::wakeup_zerocopy_awaiters()
+    {
+        ZeroCopyAwaiter **pre = &m_zerocopy_awaiter;
+        for(auto awaiter = m_zerocopy_awaiter; awaiter; awaiter = *pre) {
+            if((int32_t)(m_zerocopy_done - awaiter->m_target) >= 0) {
+                *pre = awaiter->m_next;
+                awaiter->m_post_task.set_callback(ZeroCopyAwaiter::on_zerocopy_done);
+                m_ctx->post_task(&awaiter->m_post_task);
+            } else {
+                pre = &awaiter->m_next;
+            }
+        }
+    }
+
+    void ZeroCopyAwaiter::await_resume()
+    {
+        if(m_closed) {
+            errno = ENOTSOCK;
+            throw_errno("ZeroCopyAwaiter::await_resume(): connection closed");
+        }
+    }
+#endif
+
+    inline void ConnImpl::wakeup_writable_awaiters()
+    {
+        auto awaiter = m_writable_awaiter;
+        m_writable_awaiter = nullptr;
+        while(awaiter) {
+            auto next = awaiter->m_next;
+            awaiter->m_post_task.set_callback(WritableAwaiter::on_writable);
+            m_ctx->post_task(&awaiter->m_post_task);
+            awaiter = next;
+        }
+    }
+
+    inline bool WritableAwaiter::await_ready()
+    {
+        auto conn = m_conn;
+        if(!conn->native_handle() || conn->is_send_shutdown()) {
+            m_closed = true;
+            return true;
+        }
+        return !conn->m_write_blocked;
+    }
+
+    inline bool WritableAwaiter::await_suspend(std::coroutine_handle<TaskPromiseBase> h)
+    {
+        auto conn = m_conn;
+        m_suspend_coroutine = h;
+        m_next = conn->m_writable_awaiter;
+        conn->m_writable_awaiter = this;
+        return true;
+    }
+
+    inline bool WritableAwaiter::await_resume()
+    {
+        return !m_closed;
+    }
+
+    inline void WritableAwaiter::on_writable(PostTask *task)
+    {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+        auto awaiter = (WritableAwaiter *)((char *)task - offsetof(WritableAwaiter, m_post_task));
+#pragma GCC diagnostic pop
+        TINYASYNC_RESUME(awaiter->m_suspend_coroutine);
+    }
+
     class Connection
     {
         // use unique_ptr because
         // 1. fast move/swap
         // 2. reference stable, usefull for callbacks
-        std::unique_ptr<ConnImpl> m_impl;
+        // close the socket and drop the connection's reference
+        // the close task drops the other one after all epoll_events are handled
+        struct ConnImplDeleter
+        {
+            void operator()(ConnImpl *impl) const
+            {
+                impl->safe_shutdown_recv_send();
+                impl->safe_close();
+                impl->release();
+            }
+        };
+        std::unique_ptr<ConnImpl, ConnImplDeleter> m_impl;
     public:
     
         Connection() = default;
@@ -1049,23 +1852,7 @@ namespace tinyasync {
 
         Connection(IoCtxBase &ctx, NativeSocket conn_sock, bool added_event_poll)
         {
-            m_impl.reset(new ConnImpl(ctx, conn_sock, added_event_poll));
-        }
-
-        ~Connection()
-        {
-            auto impl = m_impl.release();
-            if(impl) {
-                impl->safe_shutdown_recv_send();
-                impl->safe_close();
-                
-                impl->m_ref_cnt--;
-                if(!impl->m_ref_cnt) {      
-                    // ensure no epoll_event
-                    // we can free connimpl          
-                    delete impl;
-                }
-            }
+            m_impl.reset(ConnImpl::create(ctx, conn_sock, added_event_poll));
         }
 
         void set_tcp_no_delay(bool b = true) {
@@ -1079,6 +1866,17 @@ namespace tinyasync {
             return !impl->m_conn_handle;
         }
 
+        // bytes received/sent since the connection was established
+        uint64_t bytes_received() {
+            auto impl = m_impl.get();
+            return impl->m_bytes_received;
+        }
+
+        uint64_t bytes_sent() {
+            auto impl = m_impl.get();
+            return impl->m_bytes_sent;
+        }
+
         bool is_recv_shutdown() {
             auto impl = m_impl.get();
             return impl->is_recv_shutdown();
@@ -1148,6 +1946,13 @@ namespace tinyasync {
             return impl->m_conn_handle;
         }
 
+        // the caller owns the returned socket, the connection is closed
+        NativeSocket release_handle() {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(impl);
+            return impl->release_handle();
+        }
+
         AsyncReceiveAwaiter async_read(void* buffer, std::size_t bytes)
         {
             auto impl = m_impl.get();
@@ -1183,6 +1988,156 @@ namespace tinyasync {
             return impl->async_send(buffer.data(), buffer.size());
         }        
 
+        // 发送队列 (挂起等 EPOLLOUT 的 async_send 的字节数) 超过 high watermark 后挂起,
+        // 降到 low watermark 再返回; 返回 false 表示连接已经关闭
+        // 生产者每次发送之前 co_await writable(), 慢的对端不会让内存无限增长
+        WritableAwaiter writable()
+        {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(impl);
+            return { *impl };
+        }
+
+        void set_write_watermarks(std::size_t low, std::size_t high)
+        {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(impl);
+            impl->set_write_watermarks(low, high);
+        }
+
+        std::size_t queued_bytes() const
+        {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(impl);
+            return impl->m_queued_bytes;
+        }
+
+#ifdef __unix__
+        // one sendmsg for all buffers, may send only part of them
+        // iov must be alive until resumed
+        AsyncSendAwaiter async_sendv(iovec const* iov, int iovcnt)
+        {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(m_impl.get());
+            return impl->async_sendv(iov, iovcnt);
+        }
+
+        // 发送整条 IoBuf 链, 每次 sendmsg 最多 k_max_iobuf_iov 节, 返回发出的字节数
+        // chain 不会被修改, 同一个 chain 或它的 clone 可以同时发给多个连接, 数据不拷贝
+        // chain must be alive until completed
+        Task<std::size_t> async_sendv(IoBuf const &chain)
+        {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(impl);
+            std::size_t total = chain.chain_size();
+            std::size_t sent = 0;
+            iovec iov[k_max_iobuf_iov];
+            while(sent < total) {
+                int iovcnt = chain.fill_iovec(iov, k_max_iobuf_iov, sent);
+                std::size_t nsent = co_await impl->async_sendv(iov, iovcnt);
+                if(!nsent) {
+                    break;
+                }
+                sent += nsent;
+            }
+            co_return sent;
+        }
+
+        // 读到 chain 最后一节的 tailroom 里并 append, 返回读到的字节数, 0 是对端关闭
+        // 没有 tailroom 时从 IoContext 的 BufferPool 拿一节接在最后
+        // 读的时候这一节从链上摘下来独占, 这期间 clone() 不到它, 读完再接回去
+        // chain 在读完之前不要 append_chain()
+        Task<std::size_t> async_read_append(IoBuf &chain)
+        {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(impl);
+            IoBuf seg;
+            bool taken = chain.last()->tailroom() != 0;
+            if(taken) {
+                seg = chain.take_last();
+            } else {
+                seg = IoBuf::create(impl->m_ctx->m_buffer_pool);
+            }
+            Buffer tail = seg.writable_tail();
+            std::size_t nread;
+            try {
+                nread = co_await impl->async_read(tail.data(), tail.size());
+            } catch(...) {
+                if(taken) {
+                    chain.append_chain(std::move(seg));
+                }
+                throw;
+            }
+            seg.append(nread);
+            // an empty new segment is dropped
+            if(taken || nread) {
+                chain.append_chain(std::move(seg));
+            }
+            co_return nread;
+        }
+
+        // unix socket only, pass fds (SCM_RIGHTS) along with the data
+        // the receiver gets its own copies, the caller still owns fds
+        AsyncSendAwaiter async_send_fds(void const* buffer, std::size_t bytes, int const* fds, int nfds)
+        {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(m_impl.get());
+            return impl->async_send_fds(buffer, bytes, fds, nfds);
+        }
+
+        // 大块数据用 MSG_ZEROCOPY 发送, 内核直接引用 buffer 的页面, 不拷贝
+        // 全部发出并且收到内核不再引用 buffer 的通知后才返回, 在此之前 buffer 不能修改或释放
+        // 小于 threshold 或 socket 不支持 SO_ZEROCOPY 时是普通的拷贝发送
+        // 回环和没有 scatter-gather 的网卡上内核仍然会拷贝, 见 zerocopy_copied()
+        Task<std::size_t> async_send_zerocopy(ConstBuffer buffer, std::size_t threshold = k_zerocopy_threshold)
+        {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(impl);
+            bool zerocopy = buffer.size() >= threshold && impl->enable_zerocopy();
+            char const *data = (char const *)buffer.data();
+            std::size_t remain = buffer.size();
+            while(remain) {
+                std::size_t sent;
+                if(zerocopy) {
+                    sent = co_await impl->async_send_zerocopy_some(data, remain);
+                } else {
+                    sent = co_await impl->async_send(data, remain);
+                }
+                data += sent;
+                remain -= sent;
+            }
+            if(zerocopy) {
+                co_await ZeroCopyAwaiter(*impl, impl->m_zerocopy_sent);
+            }
+            co_return buffer.size();
+        }
+
+        // MSG_ZEROCOPY sends the kernel completed by copying
+        uint64_t zerocopy_copied() {
+            auto impl = m_impl.get();
+            return impl->m_zerocopy_copied;
+        }
+
+        // unix socket only, received fds are stored in fds[0, nfds)
+        // they are close-on-exec and owned by the caller
+        AsyncReceiveAwaiter async_read_fds(void* buffer, std::size_t bytes, int* fds, int max_fds, int &nfds)
+        {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(m_impl.get());
+            return impl->async_read_fds(buffer, bytes, fds, max_fds, nfds);
+        }
+
+        // read without holding a buffer while waiting
+        // when data arrives a buffer is taken from IoContext::buffer_pool() and moved into out
+        // returns the bytes read, 0 (out is empty) on eof
+        AsyncReceiveAwaiter async_read_pooled(PooledBuffer &out)
+        {
+            auto impl = m_impl.get();
+            TINYASYNC_ASSERT(m_impl.get());
+            return impl->async_read_pooled(out);
+        }
+#endif
+
         
     };
 
@@ -1343,9 +2298,9 @@ namespace tinyasync {
             init(nullptr, protocol, endpoint);
         }
 
-        AcceptorImpl(IoCtxBase& ctx, Protocol const& protocol, Endpoint const& endpoint) : AcceptorImpl(ctx)
+        AcceptorImpl(IoCtxBase& ctx, Protocol const& protocol, Endpoint const& endpoint, bool reuse_port = false) : AcceptorImpl(ctx)
         {
-            init(&ctx, protocol, endpoint);
+            init(&ctx, protocol, endpoint, reuse_port);
         }
 
         AcceptorImpl(AcceptorImpl const&) = delete;
@@ -1357,7 +2312,7 @@ namespace tinyasync {
             reset();            
         }
 
-        void init(IoCtxBase *, Protocol const& protocol, Endpoint const& endpoint)
+        void init(IoCtxBase *, Protocol const& protocol, Endpoint const& endpoint, bool reuse_port = false)
         {
             try {
                 // one effort triple successes
@@ -1366,6 +2321,17 @@ namespace tinyasync {
                 int on  =1;
                 // 使用 ctrl + c 停止程序的运行也不会出现 bind error
                 ::setsockopt(m_socket,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+#ifdef __unix__
+                // 多个 socket 绑定同一个端口, 内核按四元组把新连接分给它们
+                if(reuse_port && ::setsockopt(m_socket, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+                    throw_errno("can't set SO_REUSEPORT");
+                }
+                // SO_REUSEADDR 对 unix socket 无效, 上次运行留下的文件要先删掉
+                if(endpoint.address().m_address_type == AddressType::Unix
+                    && !endpoint.address().is_abstract_unix_path()) {
+                    ::unlink(endpoint.address().unix_path());
+                }
+#endif
                 bind_socket(m_socket, endpoint);
                 m_endpoint = endpoint;
                 listen();
@@ -1548,6 +2514,7 @@ namespace tinyasync {
         if (node) {
             // it's ready to accept
             auto conn_sock = ::accept(acceptor->m_socket, NULL, NULL);
+            TINYASYNC_TRACE_EVENT(Accept, conn_sock, acceptor);
             if (conn_sock == -1) {
                 if(errno == EAGAIN || errno == EWOULDBLOCK) {
                     return;                    
@@ -1573,9 +2540,10 @@ namespace tinyasync {
     {
 
     public:
-        Acceptor(IoContext& ctx, Protocol protocol, Endpoint endpoint)
+        // reuse_port: 每个 IoContext 一个 Acceptor 监听同一个端口, 见 Runtime::acceptor
+        Acceptor(IoContext& ctx, Protocol protocol, Endpoint endpoint, bool reuse_port = false)
         {
-            m_impl.reset(new AcceptorImpl(*ctx.get_io_ctx_base(), protocol, endpoint));
+            m_impl.reset(new AcceptorImpl(*ctx.get_io_ctx_base(), protocol, endpoint, reuse_port));
         }
 
         Acceptor(Protocol protocol, Endpoint endpoint)
@@ -1611,6 +2579,14 @@ namespace tinyasync {
         std::unique_ptr<AcceptorImpl> m_impl;
     };
 
+    // 接管一个已经连接好的 socket, 例如 async_read_fds 收到的
+    // 设为非阻塞, 之后由 Connection 负责关闭
+    inline Connection adopt_connection(IoContext& ctx, NativeSocket conn_sock)
+    {
+        setnonblocking(conn_sock);
+        return { *ctx.get_io_ctx_base(), conn_sock, false };
+    }
+
 
 
 
@@ -1745,6 +2721,7 @@ namespace tinyasync {
             auto connfd = m_socket;
 
             int connerr;
+#ifdef _WIN32
             if(endpoint.address().m_address_type == AddressType::IpV4) {
 
                 sockaddr_in serveraddr;
@@ -1765,6 +2742,12 @@ namespace tinyasync {
                 NativeSocket connfd = m_socket;
                 connerr = ::connect(connfd, (sockaddr*)&serveraddr, sizeof(serveraddr));
             }
+#elif defined(__unix__)
+            sockaddr_storage serveraddr;
+            socklen_t addr_len = endpoint_to_sockaddr(endpoint, serveraddr);
+            connerr = ::connect(connfd, (sockaddr*)&serveraddr, addr_len);
+#endif
+            TINYASYNC_TRACE_EVENT(Connect, m_socket, this);
 
 
             bool connected = false;
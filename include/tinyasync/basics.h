@@ -30,6 +30,7 @@ namespace std {
 #include <utility>
 #include <map>
 #include <unordered_map>
+#include <deque>
 #include <string>
 #include <vector>
 #include <type_traits>
@@ -45,6 +46,8 @@ namespace std {
 #include <mutex>
 #include <atomic>
 #include <chrono>
+#include <thread>
+#include <bit>
 #include <functional>
 #include <new>
 #include <mutex>
@@ -66,12 +69,15 @@ namespace std {
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <cxxabi.h>
 #include <sys/eventfd.h>
+#include <sys/random.h>
 #include <netinet/tcp.h>
+#include <linux/errqueue.h>
 #include <pthread.h>
 
 using SystemHandle = int;
@@ -910,4 +916,8 @@ namespace tinyasync {
 }
 
 
+// TINYASYNC_TRACE_EVENT, used by task.h and io_context.h
+#include "trace.h"
+#include "coro_profile.h"
+
 #endif
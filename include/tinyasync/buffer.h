@@ -131,6 +131,511 @@ namespace tinyasync
         }
     };
 
+    // async_read_pooled 收到的数据, buffer 来自 IoContext 的 BufferPool
+    // 析构或 reset() 时还回去, 不能比 IoContext 活得长
+    class PooledBuffer
+    {
+        BufferPool *m_pool = nullptr;
+        std::byte *m_data = nullptr;
+        std::size_t m_size = 0;
+
+    public:
+        PooledBuffer() = default;
+        PooledBuffer(PooledBuffer const &) = delete;
+        PooledBuffer &operator=(PooledBuffer const &) = delete;
+
+        PooledBuffer(PooledBuffer &&r) noexcept
+            : m_pool(r.m_pool), m_data(r.m_data), m_size(r.m_size)
+        {
+            r.m_pool = nullptr;
+            r.m_data = nullptr;
+            r.m_size = 0;
+        }
+
+        PooledBuffer &operator=(PooledBuffer &&r) noexcept
+        {
+            if(this != &r) {
+                reset();
+                std::swap(m_pool, r.m_pool);
+                std::swap(m_data, r.m_data);
+                std::swap(m_size, r.m_size);
+            }
+            return *this;
+        }
+
+        ~PooledBuffer()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            if(m_data) {
+                m_pool->free(m_data);
+                m_pool = nullptr;
+                m_data = nullptr;
+                m_size = 0;
+            }
+        }
+
+        // take the ownership of data from pool, size bytes are filled
+        void reset(BufferPool *pool, std::byte *data, std::size_t size)
+        {
+            reset();
+            m_pool = pool;
+            m_data = data;
+            m_size = size;
+        }
+
+        std::byte *data() const
+        {
+            return m_data;
+        }
+
+        std::size_t size() const
+        {
+            return m_size;
+        }
+
+        Buffer buffer() const
+        {
+            return { m_data, m_size };
+        }
+
+        explicit operator bool() const
+        {
+            return m_data != nullptr;
+        }
+    };
+
+    // IoBuf 的存储块, 头部是引用计数, 后面紧跟数据
+    // 来自 BufferPool 时整块是 pool 的一个 buffer, 否则用 operator new
+    // 单线程 ctx 的 pool 不加锁, 来自它的 IoBuf (包括 clone) 不能跨线程, 最后一个引用要在 ctx 的线程里释放
+    // debug 版本里 BufferPool 会检查
+    struct IoBufStorage
+    {
+        std::atomic<uint32_t> m_refs;
+        BufferPool *m_pool;
+        std::size_t m_capacity;
+
+        std::byte *data()
+        {
+            return (std::byte *)(this + 1);
+        }
+
+        static IoBufStorage *create(std::size_t capacity)
+        {
+            void *p = ::operator new(sizeof(IoBufStorage) + capacity);
+            return new(p) IoBufStorage{ {1}, nullptr, capacity };
+        }
+
+        static IoBufStorage *create(BufferPool &pool)
+        {
+            TINYASYNC_ASSERT(pool.buffer_size() > sizeof(IoBufStorage));
+            void *p = pool.alloc();
+            return new(p) IoBufStorage{ {1}, &pool, pool.buffer_size() - sizeof(IoBufStorage) };
+        }
+
+        void add_ref()
+        {
+            m_refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release()
+        {
+            if(m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                auto pool = m_pool;
+                this->~IoBufStorage();
+                if(pool) {
+                    pool->free((std::byte *)this);
+                } else {
+                    ::operator delete((void *)this);
+                }
+            }
+        }
+    };
+
+    // 引用计数的 buffer 链
+    // 每一节是一个 IoBufStorage 里的 [data(), data() + size()), 前面是 headroom, 后面是 tailroom
+    // clone()/slice() 只增加引用计数, 不拷贝数据, 可以把同一份数据发给多个连接
+    // 头节点是值, 后面的节点由前一个节点拥有
+    // 后面的节点来自每个线程的节点缓存, clone()/slice() 一般不用 malloc
+    // 存储被共享时 headroom()/tailroom() 是 0, 不能再往里写
+    class IoBuf
+    {
+        IoBufStorage *m_storage = nullptr;
+        std::byte *m_data = nullptr;
+        std::size_t m_size = 0;
+        IoBuf *m_next = nullptr;
+
+        IoBuf(IoBufStorage *storage, std::byte *data, std::size_t size)
+            : m_storage(storage), m_data(data), m_size(size)
+        {
+        }
+
+        struct FreeNode
+        {
+            FreeNode *m_next;
+        };
+
+        // 空闲节点, 节点可以在别的线程释放, 放进那个线程的缓存
+        struct NodeCache
+        {
+            // 超过这么多的空闲节点还给系统
+            static const std::size_t k_max_cached = 256;
+            FreeNode *m_free = nullptr;
+            std::size_t m_cached = 0;
+            // thread exit 后 (static 对象析构时) 直接 delete
+            bool m_destroyed = false;
+
+            ~NodeCache()
+            {
+                while(m_free) {
+                    FreeNode *node = m_free;
+                    m_free = node->m_next;
+                    ::operator delete((void *)node);
+                }
+                m_destroyed = true;
+            }
+        };
+
+        static NodeCache &node_cache()
+        {
+            static thread_local NodeCache cache;
+            return cache;
+        }
+
+        static IoBuf *new_node(IoBuf &&buf)
+        {
+            static_assert(sizeof(IoBuf) >= sizeof(FreeNode));
+            auto &cache = node_cache();
+            void *p;
+            if(cache.m_free) {
+                p = cache.m_free;
+                cache.m_free = cache.m_free->m_next;
+                --cache.m_cached;
+            } else {
+                p = ::operator new(sizeof(IoBuf));
+            }
+            return new(p) IoBuf(std::move(buf));
+        }
+
+        // node->m_next 已经摘下来了
+        static void delete_node(IoBuf *node)
+        {
+            TINYASYNC_ASSERT(!node->m_next);
+            node->~IoBuf();
+            auto &cache = node_cache();
+            if(cache.m_destroyed || cache.m_cached >= NodeCache::k_max_cached) {
+                ::operator delete((void *)node);
+                return;
+            }
+            cache.m_free = new((void *)node) FreeNode{ cache.m_free };
+            ++cache.m_cached;
+        }
+
+        IoBuf clone_one_range(std::size_t offset, std::size_t size) const
+        {
+            TINYASYNC_ASSERT(offset + size <= m_size);
+            if(m_storage) {
+                m_storage->add_ref();
+            }
+            return IoBuf(m_storage, m_data + offset, size);
+        }
+
+        IoBuf *tail()
+        {
+            IoBuf *p = this;
+            while(p->m_next) {
+                p = p->m_next;
+            }
+            return p;
+        }
+
+    public:
+        IoBuf() = default;
+        IoBuf(IoBuf const &) = delete;
+        IoBuf &operator=(IoBuf const &) = delete;
+
+        IoBuf(IoBuf &&r) noexcept
+            : m_storage(r.m_storage), m_data(r.m_data), m_size(r.m_size), m_next(r.m_next)
+        {
+            r.m_storage = nullptr;
+            r.m_data = nullptr;
+            r.m_size = 0;
+            r.m_next = nullptr;
+        }
+
+        IoBuf &operator=(IoBuf &&r) noexcept
+        {
+            if(this != &r) {
+                // r 可能是这条链上的节点 (buf = std::move(*buf.next())), 先把它取空再 reset()
+                IoBufStorage *storage = r.m_storage;
+                std::byte *data = r.m_data;
+                std::size_t size = r.m_size;
+                IoBuf *next = r.m_next;
+                r.m_storage = nullptr;
+                r.m_data = nullptr;
+                r.m_size = 0;
+                r.m_next = nullptr;
+
+                reset();
+                m_storage = storage;
+                m_data = data;
+                m_size = size;
+                m_next = next;
+            }
+            return *this;
+        }
+
+        ~IoBuf()
+        {
+            reset();
+        }
+
+        // 释放整条链
+        void reset()
+        {
+            // unlink first, a long chain is not destroyed recursively
+            IoBuf *next = m_next;
+            m_next = nullptr;
+            while(next) {
+                IoBuf *node = next;
+                next = node->m_next;
+                node->m_next = nullptr;
+                delete_node(node);
+            }
+            if(m_storage) {
+                m_storage->release();
+            }
+            m_storage = nullptr;
+            m_data = nullptr;
+            m_size = 0;
+        }
+
+        // 空的一节, capacity 字节里前 headroom 字节留作 headroom
+        static IoBuf create(std::size_t capacity, std::size_t headroom = 0)
+        {
+            TINYASYNC_ASSERT(headroom <= capacity);
+            auto storage = IoBufStorage::create(capacity);
+            return IoBuf(storage, storage->data() + headroom, 0);
+        }
+
+        // 存储来自 pool, 不能比 pool 活得长
+        static IoBuf create(BufferPool &pool, std::size_t headroom = 0)
+        {
+            auto storage = IoBufStorage::create(pool);
+            TINYASYNC_ASSERT(headroom <= storage->m_capacity);
+            return IoBuf(storage, storage->data() + headroom, 0);
+        }
+
+        static IoBuf copy_buffer(ConstBuffer buffer, std::size_t headroom = 0, std::size_t tailroom = 0)
+        {
+            IoBuf buf = create(headroom + buffer.size() + tailroom, headroom);
+            memcpy(buf.m_data, buffer.data(), buffer.size());
+            buf.m_size = buffer.size();
+            return buf;
+        }
+
+        // 这一节的数据
+        std::byte *data() const
+        {
+            return m_data;
+        }
+
+        std::size_t size() const
+        {
+            return m_size;
+        }
+
+        ConstBuffer buffer() const
+        {
+            return { m_data, m_size };
+        }
+
+        IoBuf *next() const
+        {
+            return m_next;
+        }
+
+        bool is_shared() const
+        {
+            return m_storage && m_storage->m_refs.load(std::memory_order_acquire) > 1;
+        }
+
+        std::size_t headroom() const
+        {
+            if(!m_storage || is_shared()) {
+                return 0;
+            }
+            return m_data - m_storage->data();
+        }
+
+        std::size_t tailroom() const
+        {
+            if(!m_storage || is_shared()) {
+                return 0;
+            }
+            return m_storage->data() + m_storage->m_capacity - (m_data + m_size);
+        }
+
+        IoBuf const *last() const
+        {
+            IoBuf const *p = this;
+            while(p->m_next) {
+                p = p->m_next;
+            }
+            return p;
+        }
+
+        // 把最后一节从链上摘下来, 只有一节时整个移走, 留下空的头节点
+        // 用 append_chain() 接回去
+        IoBuf take_last()
+        {
+            if(!m_next) {
+                return std::move(*this);
+            }
+            IoBuf *prev = this;
+            while(prev->m_next->m_next) {
+                prev = prev->m_next;
+            }
+            IoBuf last = std::move(*prev->m_next);
+            delete_node(prev->m_next);
+            prev->m_next = nullptr;
+            return last;
+        }
+
+        // 可以写的 tailroom, 写完用 append(n) 提交
+        Buffer writable_tail() const
+        {
+            return { m_data + m_size, tailroom() };
+        }
+
+        // 数据向后扩展 n 字节 (tailroom 里已经写好的)
+        void append(std::size_t n)
+        {
+            TINYASYNC_ASSERT(n <= tailroom());
+            m_size += n;
+        }
+
+        // 数据向前扩展 n 字节, 用来在前面补协议头
+        void prepend(std::size_t n)
+        {
+            TINYASYNC_ASSERT(n <= headroom());
+            m_data -= n;
+            m_size += n;
+        }
+
+        void trim_start(std::size_t n)
+        {
+            TINYASYNC_ASSERT(n <= m_size);
+            m_data += n;
+            m_size -= n;
+        }
+
+        void trim_end(std::size_t n)
+        {
+            TINYASYNC_ASSERT(n <= m_size);
+            m_size -= n;
+        }
+
+        // 把 other 整条链接到最后
+        void append_chain(IoBuf other)
+        {
+            if(!m_storage && !m_next) {
+                *this = std::move(other);
+                return;
+            }
+            tail()->m_next = new_node(std::move(other));
+        }
+
+        // 链上所有数据的字节数
+        std::size_t chain_size() const
+        {
+            std::size_t size = 0;
+            for(IoBuf const *p = this; p; p = p->next()) {
+                size += p->m_size;
+            }
+            return size;
+        }
+
+        std::size_t chain_count() const
+        {
+            std::size_t n = 0;
+            for(IoBuf const *p = this; p; p = p->next()) {
+                ++n;
+            }
+            return n;
+        }
+
+        // 共享整条链, 不拷贝数据
+        IoBuf clone() const
+        {
+            IoBuf head = clone_one_range(0, m_size);
+            IoBuf *last = &head;
+            for(IoBuf const *p = next(); p; p = p->next()) {
+                last->m_next = new_node(p->clone_one_range(0, p->m_size));
+                last = last->m_next;
+            }
+            return head;
+        }
+
+        // 共享链上 [offset, offset + size) 的数据, 不拷贝
+        IoBuf slice(std::size_t offset, std::size_t size) const
+        {
+            IoBuf head;
+            IoBuf *last = nullptr;
+            for(IoBuf const *p = this; p && size; p = p->next()) {
+                if(offset >= p->m_size) {
+                    offset -= p->m_size;
+                    continue;
+                }
+                std::size_t n = std::min(size, p->m_size - offset);
+                IoBuf part = p->clone_one_range(offset, n);
+                if(last) {
+                    last->m_next = new_node(std::move(part));
+                    last = last->m_next;
+                } else {
+                    head = std::move(part);
+                    last = &head;
+                }
+                offset = 0;
+                size -= n;
+            }
+            TINYASYNC_ASSERT(size == 0);
+            return head;
+        }
+
+        // 拷贝整条链的数据到 out, out 至少 chain_size() 字节
+        void copy_to(void *out) const
+        {
+            auto dst = (std::byte *)out;
+            for(IoBuf const *p = this; p; p = p->next()) {
+                memcpy(dst, p->m_data, p->m_size);
+                dst += p->m_size;
+            }
+        }
+
+#ifdef __unix__
+        // 从链上第 offset 字节开始填 iovec, 跳过空的节, 返回填了几个
+        int fill_iovec(iovec *iov, int max_iov, std::size_t offset = 0) const
+        {
+            int n = 0;
+            for(IoBuf const *p = this; p && n < max_iov; p = p->next()) {
+                if(offset >= p->m_size) {
+                    offset -= p->m_size;
+                    continue;
+                }
+                iov[n].iov_base = p->m_data + offset;
+                iov[n].iov_len = p->m_size - offset;
+                ++n;
+                offset = 0;
+            }
+            return n;
+        }
+#endif
+    };
+
 
 } // namespace tinyasync
 
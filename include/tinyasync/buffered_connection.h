@@ -0,0 +1,332 @@
+#ifndef TINYASYNC_BUFFERED_CONNECTION_H
+#define TINYASYNC_BUFFERED_CONNECTION_H
+
+#include <string_view>
+
+namespace tinyasync
+{
+
+    struct BufferedConfig
+    {
+        // 读缓冲的大小, 也是 async_read_until 能返回的最长一段
+        std::size_t m_read_buffer_size = 16 * 1024;
+        // 写缓冲攒到这么多立即发送, 否则等这一轮 run loop 结束再一起发
+        std::size_t m_write_high_watermark = 64 * 1024;
+    };
+
+    struct BufferedStats
+    {
+        // 实际的 recv/send 次数
+        uint64_t m_reads = 0;
+        uint64_t m_sends = 0;
+        // 调用方的 async_write 次数
+        uint64_t m_writes = 0;
+    };
+
+    // 写的一侧, BufferedConnection 和后台 flush 的任务/协程各持有一个引用
+    // BufferedConnection 析构时后台 flush 可能还挂在 send 里, 醒来以后只碰这里的东西
+    // 一个 BufferedConnection 同一时间只在一个线程上使用, 引用计数不用 atomic
+    struct BufferedWriter
+    {
+        int m_ref_cnt = 1;
+        Connection m_conn;
+        // BufferedConnection 析构时关闭连接并置位
+        bool m_closed = false;
+        uint64_t m_sends = 0;
+
+        // 攒着的, 和正在发送的
+        std::vector<std::byte> m_wbuf;
+        std::vector<std::byte> m_sending;
+        bool m_flushing = false;
+        bool m_flush_scheduled = false;
+        // 后台 flush 的异常, 下一次 async_write/async_flush 抛出
+        std::exception_ptr m_write_error;
+        Event m_flush_done;
+        int m_flush_waiters = 0;
+
+        BufferedWriter(IoContext &ctx, Connection conn) : m_conn(std::move(conn)), m_flush_done(ctx)
+        {
+        }
+
+        void add_ref()
+        {
+            ++m_ref_cnt;
+        }
+
+        void release()
+        {
+            if(!--m_ref_cnt) {
+                delete this;
+            }
+        }
+
+        void check_write_error()
+        {
+            if(m_write_error) {
+                std::rethrow_exception(std::exchange(m_write_error, nullptr));
+            }
+        }
+
+        Task<> send_all(std::byte const *data, std::size_t size)
+        {
+            while(size) {
+                if(m_closed) {
+                    throw_error("BufferedConnection: connection closed", 0);
+                }
+                std::size_t sent = co_await m_conn.async_send(data, size);
+                ++m_sends;
+                if(!sent) {
+                    throw_error("BufferedConnection: connection closed", 0);
+                }
+                data += sent;
+                size -= sent;
+            }
+        }
+
+        Task<> async_flush()
+        {
+            check_write_error();
+            while(m_flushing) {
+                ++m_flush_waiters;
+                co_await m_flush_done;
+                --m_flush_waiters;
+            }
+            while(!m_wbuf.empty()) {
+                // writes during the send go to the other buffer
+                m_flushing = true;
+                std::swap(m_wbuf, m_sending);
+                try {
+                    co_await send_all(m_sending.data(), m_sending.size());
+                } catch(...) {
+                    m_sending.clear();
+                    m_flushing = false;
+                    if(m_flush_waiters) {
+                        m_flush_done.notify_all();
+                    }
+                    throw;
+                }
+                m_sending.clear();
+                m_flushing = false;
+                if(m_flush_waiters) {
+                    m_flush_done.notify_all();
+                }
+            }
+        }
+
+        // 持有一个引用, 结束时释放
+        static Task<> deferred_flush(BufferedWriter *self)
+        {
+            try {
+                co_await self->async_flush();
+            } catch(...) {
+                self->m_write_error = std::current_exception();
+            }
+            self->release();
+        }
+    };
+
+    // 延迟 flush 的任务, 持有 writer 的一个引用, 跑完删除自己
+    struct DeferredFlush : PostTask
+    {
+        BufferedWriter *m_writer;
+    };
+
+    // Connection 上加一层读缓冲和写缓冲, 很多次小的读写合并成一次系统调用
+    // 读: 一次 recv 尽量读满读缓冲, async_read_until/async_read_line/peek 都在缓冲里找
+    // 写: async_write 只拷贝到写缓冲, 第一次写的时候 defer 一个 flush 到 run queue 最后,
+    //     这一轮里所有的写合并成一次 send (类似 TCP_CORK); 超过 high watermark 时立即发送
+    // 一个 BufferedConnection 同一时间只在一个线程上使用
+    class BufferedConnection
+    {
+        BufferedWriter *m_writer;
+        IoContext *m_ctx;
+        BufferedConfig m_config;
+        BufferedStats m_stats;
+
+        // [m_rbegin, m_rend) 是读进来还没被取走的数据
+        std::unique_ptr<std::byte[]> m_rbuf;
+        std::size_t m_rbegin = 0;
+        std::size_t m_rend = 0;
+
+        static void on_deferred_flush(PostTask *task)
+        {
+            auto flush = (DeferredFlush *)task;
+            auto writer = flush->m_writer;
+            delete flush;
+            writer->m_flush_scheduled = false;
+            if(writer->m_closed) {
+                writer->release();
+                return;
+            }
+            // the coroutine takes over the reference
+            co_spawn(BufferedWriter::deferred_flush(writer));
+        }
+
+        void schedule_flush()
+        {
+            auto writer = m_writer;
+            if(!writer->m_flush_scheduled) {
+                writer->m_flush_scheduled = true;
+                auto flush = new DeferredFlush();
+                writer->add_ref();
+                flush->m_writer = writer;
+                flush->set_callback(on_deferred_flush);
+                m_ctx->defer_task(flush);
+            }
+        }
+
+    public:
+        BufferedConnection(IoContext &ctx, Connection conn, BufferedConfig const &config = {})
+            : m_writer(new BufferedWriter(ctx, std::move(conn))), m_ctx(&ctx), m_config(config),
+            m_rbuf(new std::byte[config.m_read_buffer_size])
+        {
+            TINYASYNC_ASSERT(m_config.m_read_buffer_size > 0);
+        }
+
+        BufferedConnection(BufferedConnection const &) = delete;
+        BufferedConnection &operator=(BufferedConnection const &) = delete;
+
+        // 还没发出去的数据丢掉, 要发完先 co_await async_flush()
+        // 关闭连接, 后台还在发送的 flush 醒来后失败, 最后一个引用释放 writer
+        ~BufferedConnection()
+        {
+            auto writer = m_writer;
+            writer->m_closed = true;
+            writer->m_conn = Connection();
+            writer->release();
+        }
+
+        Connection &connection()
+        {
+            return m_writer->m_conn;
+        }
+
+        BufferedStats stats() const
+        {
+            BufferedStats stats = m_stats;
+            stats.m_sends = m_writer->m_sends;
+            return stats;
+        }
+
+        // 已经读进来还没取走的数据
+        ConstBuffer peek() const
+        {
+            return { m_rbuf.get() + m_rbegin, m_rend - m_rbegin };
+        }
+
+        void consume(std::size_t n)
+        {
+            TINYASYNC_ASSERT(n <= m_rend - m_rbegin);
+            m_rbegin += n;
+            if(m_rbegin == m_rend) {
+                m_rbegin = 0;
+                m_rend = 0;
+            }
+        }
+
+        // 再读一次到读缓冲, 返回读到的字节数, 0 是对端关闭或者缓冲满了
+        Task<std::size_t> async_fill()
+        {
+            if(m_rbegin && m_rend == m_config.m_read_buffer_size) {
+                memmove(m_rbuf.get(), m_rbuf.get() + m_rbegin, m_rend - m_rbegin);
+                m_rend -= m_rbegin;
+                m_rbegin = 0;
+            }
+            std::size_t room = m_config.m_read_buffer_size - m_rend;
+            if(!room) {
+                co_return 0;
+            }
+            std::size_t nread = co_await m_writer->m_conn.async_read(m_rbuf.get() + m_rend, room);
+            ++m_stats.m_reads;
+            m_rend += nread;
+            co_return nread;
+        }
+
+        // 先从读缓冲拿, 缓冲空了再读; 比读缓冲大的请求直接读到 buffer 里
+        Task<std::size_t> async_read(void *buffer, std::size_t bytes)
+        {
+            if(m_rbegin == m_rend) {
+                if(bytes >= m_config.m_read_buffer_size) {
+                    std::size_t nread = co_await m_writer->m_conn.async_read(buffer, bytes);
+                    ++m_stats.m_reads;
+                    co_return nread;
+                }
+                if(!co_await async_fill()) {
+                    co_return 0;
+                }
+            }
+            std::size_t n = std::min(bytes, m_rend - m_rbegin);
+            memcpy(buffer, m_rbuf.get() + m_rbegin, n);
+            consume(n);
+            co_return n;
+        }
+
+        // 返回到 delim 为止 (包括 delim) 的数据, 在下一次读之前有效
+        // 空的 view 表示对端关闭, 没有 delim 的剩余数据还可以用 peek() 拿到
+        // 读缓冲满了还没有 delim 抛异常
+        Task<std::string_view> async_read_until(std::string_view delim)
+        {
+            TINYASYNC_ASSERT(!delim.empty());
+            std::size_t searched = 0;
+            for(;;) {
+                std::string_view data((char const *)m_rbuf.get() + m_rbegin, m_rend - m_rbegin);
+                auto pos = data.find(delim, searched);
+                if(pos != std::string_view::npos) {
+                    std::size_t n = pos + delim.size();
+                    // consume() may reset the offsets, the data is still there
+                    consume(n);
+                    co_return data.substr(0, n);
+                }
+                if(data.size() >= delim.size()) {
+                    searched = data.size() - delim.size() + 1;
+                }
+                if(data.size() == m_config.m_read_buffer_size) {
+                    throw_error(format("BufferedConnection: no delimiter in %d bytes", (int)data.size()), 0);
+                }
+                if(!co_await async_fill()) {
+                    co_return std::string_view();
+                }
+            }
+        }
+
+        // 一行, 包括结尾的 \n
+        Task<std::string_view> async_read_line()
+        {
+            return async_read_until("\n");
+        }
+
+        // 拷贝到写缓冲, 这一轮 run loop 结束后一起发送
+        // 写缓冲超过 high watermark 时等发送完再返回
+        Task<> async_write(ConstBuffer buffer)
+        {
+            auto writer = m_writer;
+            writer->check_write_error();
+            ++m_stats.m_writes;
+            if(writer->m_wbuf.empty() && !writer->m_flushing && buffer.size() >= m_config.m_write_high_watermark) {
+                // nothing to merge with, skip the copy
+                co_await writer->send_all(buffer.data(), buffer.size());
+                co_return;
+            }
+            writer->m_wbuf.insert(writer->m_wbuf.end(), buffer.data(), buffer.data() + buffer.size());
+            if(writer->m_wbuf.size() >= m_config.m_write_high_watermark) {
+                co_await writer->async_flush();
+            } else {
+                schedule_flush();
+            }
+        }
+
+        Task<> async_write(void const *data, std::size_t bytes)
+        {
+            return async_write(ConstBuffer((std::byte const *)data, bytes));
+        }
+
+        // 发送写缓冲里的所有数据, 返回时都已经交给内核
+        Task<> async_flush()
+        {
+            return m_writer->async_flush();
+        }
+    };
+
+} // namespace tinyasync
+
+#endif
@@ -0,0 +1,361 @@
+#ifndef TINYASYNC_CORO_PROFILE_H
+#define TINYASYNC_CORO_PROFILE_H
+
+// 协程帧和挂起点分析
+// 定义 TINYASYNC_CORO_PROFILE 后打开, 否则什么也不做
+// 按协程的 Name 参数归类 (没有 Name 的按帧大小归到 "<unnamed:N>")
+// 统计: 帧大小, 存活帧数, 分配来源, 运行/挂起时间 (运行/挂起时间只统计 Task)
+// coro_profile_report() 打印排好序的报表
+
+#ifdef TINYASYNC_CORO_PROFILE
+
+#include <algorithm>
+
+namespace tinyasync
+{
+    enum class CoroAllocSource
+    {
+        // std::allocator, global operator new
+        GlobalNew,
+        // the allocator from get_allocator_for_task() of the first argument
+        TaskAllocator,
+        Count,
+    };
+
+    inline char const *coro_alloc_source_name(CoroAllocSource source)
+    {
+        switch (source)
+        {
+        case CoroAllocSource::GlobalNew: return "new";
+        case CoroAllocSource::TaskAllocator: return "task_allocator";
+        case CoroAllocSource::Count: break;
+        }
+        return "unknown";
+    }
+
+    inline uint64_t coro_profile_now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    template<class T>
+    inline void coro_profile_max(std::atomic<T> &max, T value)
+    {
+        T old = max.load(std::memory_order_relaxed);
+        while(old < value && !max.compare_exchange_weak(old, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    // coroutines of one name may run in different threads
+    struct CoroProfileEntry
+    {
+        std::string m_name;
+        std::atomic<uint64_t> m_frames = 0;
+        std::atomic<uint64_t> m_frame_bytes = 0;
+        std::atomic<uint64_t> m_max_frame_size = 0;
+        std::atomic<int64_t> m_live_frames = 0;
+        std::atomic<int64_t> m_live_bytes = 0;
+        std::atomic<int64_t> m_peak_live_frames = 0;
+        std::atomic<uint64_t> m_allocs[(int)CoroAllocSource::Count] = {};
+        std::atomic<uint64_t> m_suspends = 0;
+        std::atomic<uint64_t> m_running_ns = 0;
+        std::atomic<uint64_t> m_suspended_ns = 0;
+        std::atomic<uint64_t> m_max_suspended_ns = 0;
+    };
+
+    // plain copy of CoroProfileEntry
+    struct CoroProfileStats
+    {
+        std::string m_name;
+        uint64_t m_frames;
+        uint64_t m_frame_bytes;
+        uint64_t m_max_frame_size;
+        int64_t m_live_frames;
+        int64_t m_live_bytes;
+        int64_t m_peak_live_frames;
+        uint64_t m_allocs[(int)CoroAllocSource::Count];
+        uint64_t m_suspends;
+        uint64_t m_running_ns;
+        uint64_t m_suspended_ns;
+        uint64_t m_max_suspended_ns;
+
+        uint64_t avg_frame_size() const
+        {
+            return m_frames ? m_frame_bytes / m_frames : 0;
+        }
+    };
+
+    enum class CoroProfileSort
+    {
+        // peak live frames * max frame size
+        PeakBytes,
+        LiveBytes,
+        FrameBytes,
+        RunningTime,
+        SuspendedTime,
+    };
+
+    class CoroProfileRegistry
+    {
+        std::mutex m_mutex;
+        // entries are never freed, frames keep pointers to them
+        std::unordered_map<std::string, CoroProfileEntry *> m_entries;
+
+    public:
+        CoroProfileEntry *entry(std::string const &name)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto &entry = m_entries[name];
+            if(!entry) {
+                entry = new CoroProfileEntry();
+                entry->m_name = name;
+            }
+            return entry;
+        }
+
+        std::vector<CoroProfileStats> snapshot()
+        {
+            std::vector<CoroProfileStats> stats;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto relaxed = std::memory_order_relaxed;
+            for(auto &kv : m_entries) {
+                auto &e = *kv.second;
+                CoroProfileStats s;
+                s.m_name = e.m_name;
+                s.m_frames = e.m_frames.load(relaxed);
+                s.m_frame_bytes = e.m_frame_bytes.load(relaxed);
+                s.m_max_frame_size = e.m_max_frame_size.load(relaxed);
+                s.m_live_frames = e.m_live_frames.load(relaxed);
+                s.m_live_bytes = e.m_live_bytes.load(relaxed);
+                s.m_peak_live_frames = e.m_peak_live_frames.load(relaxed);
+                for(int i = 0; i < (int)CoroAllocSource::Count; ++i) {
+                    s.m_allocs[i] = e.m_allocs[i].load(relaxed);
+                }
+                s.m_suspends = e.m_suspends.load(relaxed);
+                s.m_running_ns = e.m_running_ns.load(relaxed);
+                s.m_suspended_ns = e.m_suspended_ns.load(relaxed);
+                s.m_max_suspended_ns = e.m_max_suspended_ns.load(relaxed);
+                stats.push_back(std::move(s));
+            }
+            return stats;
+        }
+
+        static CoroProfileRegistry &instance()
+        {
+            static CoroProfileRegistry registry;
+            return registry;
+        }
+    };
+
+    inline Name const *coro_profile_name(Name const &name)
+    {
+        return &name;
+    }
+
+    template<class T>
+    inline Name const *coro_profile_name(T const &)
+    {
+        return nullptr;
+    }
+
+    // hand over the entry from operator new to the promise constructor
+    // they run one after another on the same thread
+    inline thread_local CoroProfileEntry *t_coro_profile_new = nullptr;
+
+    // called by operator new of the promise with the arguments of the coroutine
+    template<class... Args>
+    CoroProfileEntry *coro_profile_on_alloc(std::size_t frame_size, CoroAllocSource source, Args const &... args)
+    {
+        Name const *name = nullptr;
+        ((name = name ? name : coro_profile_name(args)), ...);
+
+        CoroProfileEntry *entry = CoroProfileRegistry::instance().entry(
+            name ? name->m_name : format("<unnamed:%d>", (int)frame_size));
+
+        auto relaxed = std::memory_order_relaxed;
+        entry->m_frames.fetch_add(1, relaxed);
+        entry->m_frame_bytes.fetch_add(frame_size, relaxed);
+        coro_profile_max<uint64_t>(entry->m_max_frame_size, frame_size);
+        entry->m_allocs[(int)source].fetch_add(1, relaxed);
+        entry->m_live_bytes.fetch_add(frame_size, relaxed);
+        auto live = entry->m_live_frames.fetch_add(1, relaxed) + 1;
+        coro_profile_max<int64_t>(entry->m_peak_live_frames, live);
+
+        t_coro_profile_new = entry;
+        return entry;
+    }
+
+    inline void coro_profile_on_free(CoroProfileEntry *entry, std::size_t frame_size)
+    {
+        auto relaxed = std::memory_order_relaxed;
+        entry->m_live_frames.fetch_sub(1, relaxed);
+        entry->m_live_bytes.fetch_sub(frame_size, relaxed);
+    }
+
+    // lives in the promise of Task
+    // a coroutine is suspended since it's created, until initial_suspend resumes
+    struct CoroProfileFrame
+    {
+        CoroProfileEntry *m_entry;
+        uint64_t m_last = coro_profile_now();
+
+        CoroProfileFrame() : m_entry(std::exchange(t_coro_profile_new, nullptr))
+        {
+        }
+
+        // suspended -> running
+        void on_run()
+        {
+            if(m_entry) {
+                auto now = coro_profile_now();
+                auto d = now - m_last;
+                m_last = now;
+                m_entry->m_suspended_ns.fetch_add(d, std::memory_order_relaxed);
+                coro_profile_max<uint64_t>(m_entry->m_max_suspended_ns, d);
+            }
+        }
+
+        // running -> suspended
+        // call it before the awaiter's await_suspend, the coroutine may be resumed in another thread
+        void on_suspend(bool final = false)
+        {
+            if(m_entry) {
+                auto now = coro_profile_now();
+                m_entry->m_running_ns.fetch_add(now - m_last, std::memory_order_relaxed);
+                m_last = now;
+                if(!final) {
+                    m_entry->m_suspends.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // await_suspend returned false, on_suspend() was not a suspension
+        // the time since then is still running time
+        void on_suspend_cancelled()
+        {
+            if(m_entry) {
+                m_entry->m_suspends.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    template<class Awaitable, class = void>
+    struct CoroProfileAwaiterOf
+    {
+        using type = Awaitable &&;
+        static Awaitable &&get(Awaitable &&awaitable)
+        {
+            return std::forward<Awaitable>(awaitable);
+        }
+    };
+
+    template<class Awaitable>
+    struct CoroProfileAwaiterOf<Awaitable, std::void_t<decltype(std::declval<Awaitable>().operator co_await())> >
+    {
+        using type = decltype(std::declval<Awaitable>().operator co_await());
+        static type get(Awaitable &&awaitable)
+        {
+            return std::forward<Awaitable>(awaitable).operator co_await();
+        }
+    };
+
+    // await_transform of Task wraps every co_await with this
+    template<class Awaitable>
+    struct CoroProfileAwaiter
+    {
+        using awaiter_of = CoroProfileAwaiterOf<Awaitable>;
+
+        CoroProfileFrame *m_profile;
+        typename awaiter_of::type m_awaiter;
+        // on_suspend() was called and the coroutine was really suspended
+        // ready awaiters skip await_suspend, they must not count as suspended time
+        bool m_suspended = false;
+
+        CoroProfileAwaiter(CoroProfileFrame *profile, Awaitable &&awaitable)
+            : m_profile(profile), m_awaiter(awaiter_of::get(std::forward<Awaitable>(awaitable)))
+        {
+        }
+
+        bool await_ready()
+        {
+            return m_awaiter.await_ready();
+        }
+
+        template<class Promise>
+        decltype(auto) await_suspend(std::coroutine_handle<Promise> h)
+        {
+            // set before await_suspend, after that the coroutine may be resumed in another thread
+            m_suspended = true;
+            m_profile->on_suspend();
+            if constexpr (std::is_same_v<decltype(m_awaiter.await_suspend(h)), bool>) {
+                bool suspend = m_awaiter.await_suspend(h);
+                if(!suspend) {
+                    m_suspended = false;
+                    m_profile->on_suspend_cancelled();
+                }
+                return suspend;
+            } else {
+                return m_awaiter.await_suspend(h);
+            }
+        }
+
+        decltype(auto) await_resume()
+        {
+            if(m_suspended) {
+                m_profile->on_run();
+            }
+            return m_awaiter.await_resume();
+        }
+    };
+
+    inline std::vector<CoroProfileStats> coro_profile_snapshot(CoroProfileSort sort = CoroProfileSort::PeakBytes)
+    {
+        auto stats = CoroProfileRegistry::instance().snapshot();
+        auto key = [sort](CoroProfileStats const &s) -> uint64_t {
+            switch (sort)
+            {
+            case CoroProfileSort::PeakBytes: return s.m_peak_live_frames * s.m_max_frame_size;
+            case CoroProfileSort::LiveBytes: return s.m_live_bytes;
+            case CoroProfileSort::FrameBytes: return s.m_frame_bytes;
+            case CoroProfileSort::RunningTime: return s.m_running_ns;
+            case CoroProfileSort::SuspendedTime: return s.m_suspended_ns;
+            }
+            return 0;
+        };
+        std::sort(stats.begin(), stats.end(), [&](CoroProfileStats const &l, CoroProfileStats const &r) {
+            return key(l) > key(r);
+        });
+        return stats;
+    }
+
+    inline void coro_profile_report(FILE *file = stdout, CoroProfileSort sort = CoroProfileSort::PeakBytes)
+    {
+        auto stats = coro_profile_snapshot(sort);
+        fprintf(file, "%-32s %10s %8s %8s %8s %8s %12s %10s %10s %12s %12s %12s\n",
+            "name", "frames", "avg_size", "max_size", "live", "peak", "live_bytes",
+            coro_alloc_source_name(CoroAllocSource::GlobalNew),
+            coro_alloc_source_name(CoroAllocSource::TaskAllocator),
+            "suspends", "running_ms", "suspend_ms");
+        for(auto &s : stats) {
+            fprintf(file, "%-32s %10llu %8llu %8llu %8lld %8lld %12lld %10llu %10llu %12llu %12.3f %12.3f\n",
+                s.m_name.c_str(),
+                (unsigned long long)s.m_frames,
+                (unsigned long long)s.avg_frame_size(),
+                (unsigned long long)s.m_max_frame_size,
+                (long long)s.m_live_frames,
+                (long long)s.m_peak_live_frames,
+                (long long)s.m_live_bytes,
+                (unsigned long long)s.m_allocs[(int)CoroAllocSource::GlobalNew],
+                (unsigned long long)s.m_allocs[(int)CoroAllocSource::TaskAllocator],
+                (unsigned long long)s.m_suspends,
+                s.m_running_ns / 1E6,
+                s.m_suspended_ns / 1E6);
+        }
+    }
+
+} // namespace tinyasync
+
+#endif // TINYASYNC_CORO_PROFILE
+
+#endif
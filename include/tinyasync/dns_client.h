@@ -0,0 +1,993 @@
+#ifndef TINYASYNC_DNS_CLIENT_H
+#define TINYASYNC_DNS_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+
+namespace tinyasync
+{
+    // 非阻塞的 UDP DNS 客户端, 直接挂在 IoCtx 的 epoll 上
+    // 不需要工作线程, 不调用 getaddrinfo
+    //     /etc/hosts 和 /etc/resolv.conf
+    //     同名的请求合并成一个 (coalescing)
+    //     按 TTL 过期的 LRU cache
+    //     返回全部 A/AAAA 记录
+    //     每次请求一个新的 socket, 随机源端口 + getrandom 的 id, 防 cache poisoning
+
+    class DnsClient;
+
+    enum class DnsErrc
+    {
+        ok = 0,
+        not_found,      // NXDOMAIN or no A/AAAA record
+        server_failure,
+        refused,
+        format_error,
+        timeout,
+        bad_name,
+        no_nameserver,
+    };
+
+    inline char const *dns_errc_string(DnsErrc errc)
+    {
+        switch (errc)
+        {
+        case DnsErrc::ok: return "ok";
+        case DnsErrc::not_found: return "not found";
+        case DnsErrc::server_failure: return "server failure";
+        case DnsErrc::refused: return "refused";
+        case DnsErrc::format_error: return "format error";
+        case DnsErrc::timeout: return "timeout";
+        case DnsErrc::bad_name: return "bad name";
+        case DnsErrc::no_nameserver: return "no nameserver";
+        }
+        return "unknown";
+    }
+
+    inline bool parse_address(char const *str, Address &addr)
+    {
+        if(strchr(str, ':')) {
+            if(inet_pton(AF_INET6, str, &addr.m_addr6) != 1) {
+                return false;
+            }
+            addr.m_address_type = AddressType::IpV6;
+        } else {
+            if(inet_pton(AF_INET, str, &addr.m_addr4) != 1) {
+                return false;
+            }
+            addr.m_address_type = AddressType::IpV4;
+        }
+        return true;
+    }
+
+    // dns names are case insensitive, and "a.com." is "a.com"
+    inline std::string dns_normalize_name(char const *name)
+    {
+        std::string str = name;
+        for(auto &c : str) {
+            if(c >= 'A' && c <= 'Z') {
+                c = c - 'A' + 'a';
+            }
+        }
+        if(!str.empty() && str.back() == '.') {
+            str.pop_back();
+        }
+        return str;
+    }
+
+    struct DnsConfig
+    {
+        std::vector<Endpoint> m_nameservers;
+        // per attempt, resolv.conf "options timeout:n"
+        std::chrono::milliseconds m_timeout = std::chrono::seconds(5);
+        // resolv.conf "options attempts:n"
+        int m_attempts = 2;
+        std::unordered_map<std::string, std::vector<Address> > m_hosts;
+        std::size_t m_cache_capacity = 1024;
+
+        void add_nameserver(Endpoint const &endpoint)
+        {
+            m_nameservers.push_back(endpoint);
+        }
+
+        void add_host(char const *name, Address const &address)
+        {
+            m_hosts[dns_normalize_name(name)].push_back(address);
+        }
+
+        // missing file is not an error
+        void load_resolv_conf(char const *path = "/etc/resolv.conf")
+        {
+            std::ifstream file(path);
+            std::string line;
+            for(; std::getline(file, line); ) {
+                std::istringstream is(line);
+                std::string key;
+                if(!(is >> key) || key[0] == '#' || key[0] == ';') {
+                    continue;
+                }
+                if(key == "nameserver") {
+                    std::string value;
+                    Address addr;
+                    // drop "%scope" of link local address
+                    if(is >> value && parse_address(value.substr(0, value.find('%')).c_str(), addr)) {
+                        m_nameservers.push_back(Endpoint(addr, 53));
+                    }
+                } else if(key == "options") {
+                    std::string opt;
+                    for(; is >> opt; ) {
+                        if(opt.compare(0, 8, "timeout:") == 0) {
+                            m_timeout = std::chrono::seconds(std::max(1, atoi(opt.c_str() + 8)));
+                        } else if(opt.compare(0, 9, "attempts:") == 0) {
+                            m_attempts = std::max(1, atoi(opt.c_str() + 9));
+                        }
+                    }
+                }
+            }
+        }
+
+        // missing file is not an error
+        void load_hosts(char const *path = "/etc/hosts")
+        {
+            std::ifstream file(path);
+            std::string line;
+            for(; std::getline(file, line); ) {
+                line = line.substr(0, line.find('#'));
+                std::istringstream is(line);
+                std::string ip;
+                Address addr;
+                if(!(is >> ip) || !parse_address(ip.c_str(), addr)) {
+                    continue;
+                }
+                std::string name;
+                for(; is >> name; ) {
+                    add_host(name.c_str(), addr);
+                }
+            }
+        }
+
+        static DnsConfig system()
+        {
+            DnsConfig config;
+            config.load_resolv_conf();
+            config.load_hosts();
+            if(config.m_nameservers.empty()) {
+                // same as glibc
+                config.m_nameservers.push_back(Endpoint(Address(INADDR_LOOPBACK), 53));
+            }
+            return config;
+        }
+    };
+
+    struct DnsLookupResult
+    {
+        DnsErrc errc() const
+        {
+            return m_errc;
+        }
+
+        bool ok() const
+        {
+            return m_errc == DnsErrc::ok;
+        }
+
+        // all A and AAAA records, A first
+        std::vector<Address> const &addresses() const
+        {
+            return m_addresses;
+        }
+
+        // the first address, only if ok()
+        Address address() const
+        {
+            return m_addresses.front();
+        }
+
+    private:
+        friend class DnsClient;
+        DnsErrc m_errc = DnsErrc::ok;
+        std::vector<Address> m_addresses;
+    };
+
+    struct [[nodiscard]] DnsLookupAwaiter
+    {
+        DnsClient *m_client;
+        std::string m_name;
+        DnsLookupResult m_result;
+        DnsLookupAwaiter *m_next = nullptr;
+        std::coroutine_handle<TaskPromiseBase> m_suspend_coroutine;
+        PostTask m_local_task;
+
+        DnsLookupAwaiter(DnsClient &client, char const *name)
+        {
+            m_client = &client;
+            m_name = dns_normalize_name(name);
+            m_local_task.set_callback(do_local_task);
+        }
+
+        // lookup done
+        // resume our coroutine
+        static void do_local_task(PostTask *posttask)
+        {
+            TINYASYNC_POINT_FROM_MEMBER(awaiter, posttask, DnsLookupAwaiter, m_local_task);
+            TINYASYNC_RESUME(awaiter->m_suspend_coroutine);
+        }
+
+        // ip literal, /etc/hosts or cache
+        bool await_ready();
+
+        template<class P>
+        bool await_suspend(std::coroutine_handle<P> h) {
+            auto suspend_coroutine = h.promise().coroutine_handle_base();
+            return await_suspend(suspend_coroutine);
+        }
+
+        bool await_suspend(std::coroutine_handle<TaskPromiseBase> h);
+
+        DnsLookupResult await_resume()
+        {
+            return std::move(m_result);
+        }
+    };
+
+    struct DnsClientStats
+    {
+        std::size_t m_lookups = 0;
+        std::size_t m_hosts_hits = 0;
+        std::size_t m_cache_hits = 0;
+        // joined an in-flight query of the same name
+        std::size_t m_coalesced = 0;
+        std::size_t m_packets_sent = 0;
+        std::size_t m_packets_received = 0;
+        std::size_t m_retransmits = 0;
+    };
+
+    class DnsSocketCallback : public CallbackImplBase
+    {
+    public:
+        DnsClient *m_client;
+        std::size_t m_slot;
+
+        DnsSocketCallback(DnsClient *client, std::size_t slot) :
+            CallbackImplBase(this), m_client(client), m_slot(slot)
+        {
+        }
+        void on_callback(IoEvent &evt);
+    };
+
+    class DnsTimerCallback : public CallbackImplBase
+    {
+    public:
+        DnsClient *m_client;
+
+        DnsTimerCallback(DnsClient *client) : CallbackImplBase(this), m_client(client)
+        {
+        }
+        void on_callback(IoEvent &evt);
+    };
+
+    // one client per IoContext
+    // callbacks may run on any thread of the ctx, state is protected by m_lock
+    class DnsClient
+    {
+        friend struct DnsLookupAwaiter;
+        friend class DnsSocketCallback;
+        friend class DnsTimerCallback;
+
+        using SteadyClock = std::chrono::steady_clock;
+
+        static const uint16_t k_type_a = 1;
+        static const uint16_t k_type_aaaa = 28;
+        static const uint16_t k_class_in = 1;
+        static const std::size_t k_max_packet = 1232;
+        // the timer ticks while any query is in flight
+        static constexpr std::chrono::milliseconds k_tick = std::chrono::milliseconds(50);
+        static constexpr uint32_t k_max_ttl = 24 * 3600;
+
+        // a name being resolved, shared by all awaiters of the name
+        struct Query
+        {
+            std::string m_name;
+            // [0] for A, [1] for AAAA
+            uint16_t m_ids[2];
+            bool m_done[2] = { false, false };
+            DnsErrc m_errc[2] = { DnsErrc::ok, DnsErrc::ok };
+            std::vector<Address> m_addresses[2];
+            uint32_t m_ttl = k_max_ttl;
+            std::size_t m_server;
+            std::size_t m_slot;
+            int m_attempt = 0;
+            SteadyClock::time_point m_deadline;
+            DnsLookupAwaiter *m_waiters = nullptr;
+            // list of finished queries
+            Query *m_next_done = nullptr;
+        };
+
+        struct CacheEntry
+        {
+            std::string m_name;
+            std::vector<Address> m_addresses;
+            SteadyClock::time_point m_expire;
+        };
+
+        // 每个请求一个 udp socket, 随机的源端口, 连到这次尝试的 nameserver; 重试时换新的 socket
+        // 伪造的回答要同时猜中端口和 id (各 16 位)
+        // slot 和 client 活得一样长, 晚到的事件不会碰到已经释放的 callback
+        struct Slot
+        {
+            NativeSocket m_socket = NULL_SOCKET;
+            Query *m_query = nullptr;
+            std::unique_ptr<DnsSocketCallback> m_callback;
+        };
+
+        IoCtxBase *m_ctx;
+        DnsConfig m_config;
+        std::vector<Endpoint> m_servers;
+        std::vector<std::unique_ptr<Slot>> m_slots;
+        std::vector<std::size_t> m_free_slots;
+        // ip_local_port_range
+        uint16_t m_port_low = 32768;
+        uint16_t m_port_high = 60999;
+        NativeHandle m_timer_handle = NULL_HANDLE;
+        DnsTimerCallback m_timer_callback = this;
+        bool m_timer_armed = false;
+
+        DefaultSpinLock m_lock;
+        std::unordered_map<std::string, Query *> m_inflight;
+        std::list<CacheEntry> m_lru;
+        std::unordered_map<std::string, std::list<CacheEntry>::iterator> m_cache;
+        // from getrandom, for query ids and source ports
+        uint16_t m_random[32];
+        std::size_t m_random_left = 0;
+        std::size_t m_next_server = 0;
+        DnsClientStats m_stats;
+
+    public:
+
+        DnsClient(IoContext &ctx, DnsConfig config = DnsConfig::system())
+            : m_ctx(ctx.get_io_ctx_base()), m_config(std::move(config))
+        {
+            m_servers = m_config.m_nameservers;
+            if(FILE *f = fopen("/proc/sys/net/ipv4/ip_local_port_range", "r")) {
+                int low, high;
+                if(fscanf(f, "%d %d", &low, &high) == 2 && 1024 <= low && low < high && high <= 65535) {
+                    m_port_low = (uint16_t)low;
+                    m_port_high = (uint16_t)high;
+                }
+                fclose(f);
+            }
+            try {
+
+                m_timer_handle = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+                if(m_timer_handle == -1) {
+                    m_timer_handle = NULL_HANDLE;
+                    throw_errno("DnsClient: can't create timer");
+                }
+                epoll_event evt;
+                evt.data.ptr = static_cast<Callback *>(&m_timer_callback);
+                evt.events = EPOLLIN;
+                if(epoll_ctl(m_ctx->event_poll_handle(), EPOLL_CTL_ADD, m_timer_handle, &evt) == -1) {
+                    throw_errno("DnsClient: can't bind timer fd with epoll");
+                }
+            } catch(...) {
+                close_all();
+                throw;
+            }
+        }
+
+        DnsClient(DnsClient &&) = delete;
+
+        // all lookups should have been done
+        ~DnsClient()
+        {
+            TINYASYNC_ASSERT(m_inflight.empty());
+            close_all();
+        }
+
+        DnsLookupAwaiter lookup(char const *name)
+        {
+            return { *this, name };
+        }
+
+        DnsClientStats stats()
+        {
+            std::lock_guard<DefaultSpinLock> guard(m_lock);
+            return m_stats;
+        }
+
+        void clear_cache()
+        {
+            std::lock_guard<DefaultSpinLock> guard(m_lock);
+            m_cache.clear();
+            m_lru.clear();
+        }
+
+    private:
+
+        void close_all()
+        {
+            for(auto &slot : m_slots) {
+                close_socket(*slot);
+            }
+            if(m_timer_handle != NULL_HANDLE) {
+                epoll_ctl(m_ctx->event_poll_handle(), EPOLL_CTL_DEL, m_timer_handle, NULL);
+                ::close(m_timer_handle);
+                m_timer_handle = NULL_HANDLE;
+            }
+        }
+
+        void close_socket(Slot &slot)
+        {
+            if(slot.m_socket != NULL_SOCKET) {
+                epoll_ctl(m_ctx->event_poll_handle(), EPOLL_CTL_DEL, slot.m_socket, NULL);
+                ::close(slot.m_socket);
+                slot.m_socket = NULL_SOCKET;
+            }
+        }
+
+        // under m_lock
+        std::size_t acquire_slot(Query *query)
+        {
+            std::size_t idx;
+            if(!m_free_slots.empty()) {
+                idx = m_free_slots.back();
+                m_free_slots.pop_back();
+            } else {
+                idx = m_slots.size();
+                auto slot = std::make_unique<Slot>();
+                slot->m_callback.reset(new DnsSocketCallback(this, idx));
+                m_slots.push_back(std::move(slot));
+            }
+            m_slots[idx]->m_query = query;
+            return idx;
+        }
+
+        // under m_lock
+        void release_slot(std::size_t idx)
+        {
+            auto &slot = *m_slots[idx];
+            close_socket(slot);
+            slot.m_query = nullptr;
+            m_free_slots.push_back(idx);
+        }
+
+        // under m_lock
+        // a fresh socket on a random source port, connected to the nameserver
+        // @return false on failure, the query times out and retries
+        bool open_socket(Slot &slot, Endpoint const &endpoint)
+        {
+            close_socket(slot);
+
+            bool v6 = endpoint.address().m_address_type == AddressType::IpV6;
+            NativeSocket fd = ::socket(v6 ? AF_INET6 : AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if(fd == -1) {
+                TINYASYNC_LOG("can't create socket %d", errno);
+                return false;
+            }
+            slot.m_socket = fd;
+
+            bool bound = false;
+            for(int i = 0; i < 8 && !bound; ++i) {
+                uint16_t port = m_port_low + next_random() % (m_port_high - m_port_low + 1);
+                bound = bind_port(fd, v6, port);
+                if(!bound && errno != EADDRINUSE) {
+                    break;
+                }
+            }
+            // the kernel picks a random one too
+            if(!bound && !bind_port(fd, v6, 0)) {
+                TINYASYNC_LOG("can't bind socket %d", errno);
+                close_socket(slot);
+                return false;
+            }
+
+            // connected udp socket, only receive from the nameserver
+            sockaddr_storage serveraddr;
+            socklen_t addr_len = endpoint_to_sockaddr(endpoint, serveraddr);
+            if(::connect(fd, (sockaddr *)&serveraddr, addr_len) == -1) {
+                TINYASYNC_LOG("can't connect to nameserver %d", errno);
+                close_socket(slot);
+                return false;
+            }
+
+            epoll_event evt;
+            evt.data.ptr = static_cast<Callback *>(slot.m_callback.get());
+            evt.events = EPOLLIN;
+            if(epoll_ctl(m_ctx->event_poll_handle(), EPOLL_CTL_ADD, fd, &evt) == -1) {
+                TINYASYNC_LOG("can't bind socket with epoll %d", errno);
+                close_socket(slot);
+                return false;
+            }
+            return true;
+        }
+
+        static bool bind_port(NativeSocket fd, bool v6, uint16_t port)
+        {
+            if(v6) {
+                sockaddr_in6 addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin6_family = AF_INET6;
+                addr.sin6_port = htons(port);
+                addr.sin6_addr = in6addr_any;
+                return ::bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0;
+            } else {
+                sockaddr_in addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin_family = AF_INET;
+                addr.sin_port = htons(port);
+                addr.sin_addr.s_addr = htonl(INADDR_ANY);
+                return ::bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0;
+            }
+        }
+
+        // answer without network
+        bool lookup_local(DnsLookupAwaiter &awaiter)
+        {
+            auto &result = awaiter.m_result;
+
+            Address addr;
+            if(parse_address(awaiter.m_name.c_str(), addr)) {
+                result.m_addresses.push_back(addr);
+                return true;
+            }
+
+            std::lock_guard<DefaultSpinLock> guard(m_lock);
+            m_stats.m_lookups += 1;
+
+            auto host = m_config.m_hosts.find(awaiter.m_name);
+            if(host != m_config.m_hosts.end()) {
+                m_stats.m_hosts_hits += 1;
+                result.m_addresses = host->second;
+                return true;
+            }
+
+            auto it = m_cache.find(awaiter.m_name);
+            if(it != m_cache.end()) {
+                auto entry = it->second;
+                if(entry->m_expire > SteadyClock::now()) {
+                    m_stats.m_cache_hits += 1;
+                    // most recently used to front
+                    m_lru.splice(m_lru.begin(), m_lru, entry);
+                    result.m_addresses = entry->m_addresses;
+                    return true;
+                }
+                m_cache.erase(it);
+                m_lru.erase(entry);
+            }
+            return false;
+        }
+
+        // under m_lock
+        void cache_insert(std::string const &name, std::vector<Address> const &addresses, uint32_t ttl)
+        {
+            if(ttl == 0 || m_config.m_cache_capacity == 0) {
+                return;
+            }
+            auto expire = SteadyClock::now() + std::chrono::seconds(std::min(ttl, k_max_ttl));
+            auto it = m_cache.find(name);
+            if(it != m_cache.end()) {
+                it->second->m_addresses = addresses;
+                it->second->m_expire = expire;
+                m_lru.splice(m_lru.begin(), m_lru, it->second);
+                return;
+            }
+            m_lru.push_front(CacheEntry{ name, addresses, expire });
+            m_cache[name] = m_lru.begin();
+            if(m_lru.size() > m_config.m_cache_capacity) {
+                m_cache.erase(m_lru.back().m_name);
+                m_lru.pop_back();
+            }
+        }
+
+        // @return false if the lookup is done without suspending
+        bool enqueue(DnsLookupAwaiter &awaiter)
+        {
+            TINYASYNC_GUARD("DnsClient::enqueue(): ");
+
+            if(m_servers.empty()) {
+                awaiter.m_result.m_errc = DnsErrc::no_nameserver;
+                return false;
+            }
+
+            uint8_t packet[k_max_packet];
+            if(build_query(packet, 0, awaiter.m_name, k_type_a) == 0) {
+                awaiter.m_result.m_errc = DnsErrc::bad_name;
+                return false;
+            }
+
+            std::unique_lock<DefaultSpinLock> guard(m_lock);
+
+            auto it = m_inflight.find(awaiter.m_name);
+            if(it != m_inflight.end()) {
+                TINYASYNC_LOG("coalesce %s", awaiter.m_name.c_str());
+                m_stats.m_coalesced += 1;
+                awaiter.m_next = it->second->m_waiters;
+                it->second->m_waiters = &awaiter;
+                return true;
+            }
+
+            Query *query = new Query();
+            query->m_name = awaiter.m_name;
+            query->m_waiters = &awaiter;
+            query->m_server = m_next_server++ % m_servers.size();
+            query->m_slot = acquire_slot(query);
+            m_inflight[query->m_name] = query;
+
+            send_query(query);
+
+            if(!m_timer_armed) {
+                set_timer(true);
+            }
+            return true;
+        }
+
+        // under m_lock
+        void send_query(Query *query)
+        {
+            query->m_attempt += 1;
+            query->m_deadline = SteadyClock::now() + m_config.m_timeout;
+
+            // new port and new ids for every attempt
+            auto &slot = *m_slots[query->m_slot];
+            if(!open_socket(slot, m_servers[query->m_server])) {
+                return;
+            }
+            do {
+                query->m_ids[0] = next_random();
+                query->m_ids[1] = next_random();
+            } while(query->m_ids[0] == query->m_ids[1]);
+
+            uint8_t packet[k_max_packet];
+            uint16_t const types[2] = { k_type_a, k_type_aaaa };
+            for(int i = 0; i < 2; ++i) {
+                if(query->m_done[i]) {
+                    continue;
+                }
+                std::size_t size = build_query(packet, query->m_ids[i], query->m_name, types[i]);
+                // if it fails, the query times out and retries
+                ::send(slot.m_socket, packet, size, MSG_NOSIGNAL);
+                m_stats.m_packets_sent += 1;
+            }
+        }
+
+        // under m_lock
+        // query ids and source ports must not be predictable, take them from the kernel CSPRNG
+        uint16_t next_random()
+        {
+            if(m_random_left == 0) {
+                // requests up to 256 bytes are never interrupted or partial
+                if(::getrandom(m_random, sizeof(m_random), 0) != (ssize_t)sizeof(m_random)) {
+                    throw_errno("DnsClient: getrandom failed");
+                }
+                m_random_left = sizeof(m_random) / sizeof(m_random[0]);
+            }
+            return m_random[--m_random_left];
+        }
+
+        void set_timer(bool arm)
+        {
+            itimerspec time;
+            memset(&time, 0, sizeof(time));
+            if(arm) {
+                time.it_value = to_timespec(k_tick);
+                time.it_interval = to_timespec(k_tick);
+            }
+            timerfd_settime(m_timer_handle, 0, &time, NULL);
+            m_timer_armed = arm;
+        }
+
+        // @return size of packet, 0 if name is invalid
+        static std::size_t build_query(uint8_t *packet, uint16_t id, std::string const &name, uint16_t type)
+        {
+            if(name.empty() || name.size() > 253) {
+                return 0;
+            }
+            uint8_t *p = packet;
+            *p++ = id >> 8;
+            *p++ = id & 0xff;
+            // standard query, recursion desired
+            *p++ = 0x01;
+            *p++ = 0x00;
+            // qdcount = 1, ancount = nscount = arcount = 0
+            *p++ = 0; *p++ = 1;
+            *p++ = 0; *p++ = 0;
+            *p++ = 0; *p++ = 0;
+            *p++ = 0; *p++ = 0;
+
+            std::size_t begin = 0;
+            for(;;) {
+                std::size_t end = name.find('.', begin);
+                if(end == std::string::npos) {
+                    end = name.size();
+                }
+                std::size_t len = end - begin;
+                if(len == 0 || len > 63) {
+                    return 0;
+                }
+                *p++ = (uint8_t)len;
+                memcpy(p, name.data() + begin, len);
+                p += len;
+                if(end == name.size()) {
+                    break;
+                }
+                begin = end + 1;
+            }
+            *p++ = 0;
+            *p++ = type >> 8;
+            *p++ = type & 0xff;
+            *p++ = k_class_in >> 8;
+            *p++ = k_class_in & 0xff;
+            return p - packet;
+        }
+
+        static uint16_t read16(uint8_t const *p)
+        {
+            return (uint16_t(p[0]) << 8) | p[1];
+        }
+
+        static uint32_t read32(uint8_t const *p)
+        {
+            return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+        }
+
+        // @return offset after the name, 0 if malformed
+        static std::size_t skip_name(uint8_t const *packet, std::size_t size, std::size_t off)
+        {
+            for(; off < size;) {
+                uint8_t len = packet[off];
+                if(len == 0) {
+                    return off + 1;
+                } else if((len & 0xc0) == 0xc0) {
+                    // compression pointer ends the name
+                    return off + 2 <= size ? off + 2 : 0;
+                } else if(len & 0xc0) {
+                    return 0;
+                }
+                off += 1 + len;
+            }
+            return 0;
+        }
+
+        // question name must be the one we asked
+        static bool match_name(uint8_t const *packet, std::size_t size, std::size_t off, std::string const &name)
+        {
+            std::string str;
+            for(; off < size;) {
+                uint8_t len = packet[off];
+                if(len == 0) {
+                    return dns_normalize_name(str.c_str()) == name;
+                }
+                if((len & 0xc0) || off + 1 + len > size) {
+                    return false;
+                }
+                if(!str.empty()) {
+                    str.push_back('.');
+                }
+                str.append((char const *)packet + off + 1, len);
+                off += 1 + len;
+            }
+            return false;
+        }
+
+        // run in ctx thread
+        // the event may be late, the slot may have a new socket or no query now
+        void on_readable(std::size_t slot_idx)
+        {
+            TINYASYNC_GUARD("DnsClient::on_readable(): ");
+
+            uint8_t packet[k_max_packet];
+            Query *done = nullptr;
+
+            std::unique_lock<DefaultSpinLock> guard(m_lock);
+            auto &slot = *m_slots[slot_idx];
+            while(slot.m_query && slot.m_socket != NULL_SOCKET) {
+                auto nbytes = ::recv(slot.m_socket, packet, sizeof(packet), 0);
+                if(nbytes == -1) {
+                    if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                        break;
+                    }
+                    // e.g. ECONNREFUSED, nameserver is not running
+                    TINYASYNC_LOG("recv error %d", errno);
+                    continue;
+                }
+
+                m_stats.m_packets_received += 1;
+                Query *query = slot.m_query;
+                if(on_response(query, packet, nbytes)) {
+                    // releases the slot
+                    finish_locked(query);
+                    done = query;
+                }
+            }
+            guard.unlock();
+
+            complete(done);
+        }
+
+        // under m_lock
+        // @return true if all answers of the query arrived
+        bool on_response(Query *query, uint8_t const *packet, std::size_t size)
+        {
+            if(size < 12) {
+                return false;
+            }
+            uint16_t id = read16(packet);
+            uint8_t flags1 = packet[2];
+            uint8_t rcode = packet[3] & 0x0f;
+            uint16_t qdcount = read16(packet + 4);
+            uint16_t ancount = read16(packet + 6);
+
+            // not a response, or not an id of this attempt
+            if(!(flags1 & 0x80) || qdcount != 1) {
+                return false;
+            }
+            int idx = query->m_ids[0] == id ? 0 : query->m_ids[1] == id ? 1 : -1;
+            if(idx < 0 || query->m_done[idx] || !match_name(packet, size, 12, query->m_name)) {
+                return false;
+            }
+
+            std::size_t off = skip_name(packet, size, 12);
+            if(off == 0 || off + 4 > size) {
+                return false;
+            }
+            off += 4;
+
+            DnsErrc errc = DnsErrc::ok;
+            switch (rcode)
+            {
+            case 0: break;
+            case 1: errc = DnsErrc::format_error; break;
+            case 3: errc = DnsErrc::not_found; break;
+            case 5: errc = DnsErrc::refused; break;
+            default: errc = DnsErrc::server_failure; break;
+            }
+
+            auto &addresses = query->m_addresses[idx];
+            for(uint16_t i = 0; i < ancount && errc == DnsErrc::ok; ++i) {
+                off = skip_name(packet, size, off);
+                if(off == 0 || off + 10 > size) {
+                    errc = DnsErrc::format_error;
+                    break;
+                }
+                uint16_t type = read16(packet + off);
+                uint16_t klass = read16(packet + off + 2);
+                uint32_t ttl = read32(packet + off + 4);
+                uint16_t rdlength = read16(packet + off + 8);
+                off += 10;
+                if(off + rdlength > size) {
+                    errc = DnsErrc::format_error;
+                    break;
+                }
+                // CNAME chain is in the answer too, we only pick the addresses
+                if(klass == k_class_in && type == k_type_a && rdlength == 4) {
+                    Address addr;
+                    memcpy(&addr.m_addr4, packet + off, 4);
+                    addr.m_address_type = AddressType::IpV4;
+                    addresses.push_back(addr);
+                    query->m_ttl = std::min(query->m_ttl, ttl);
+                } else if(klass == k_class_in && type == k_type_aaaa && rdlength == 16) {
+                    Address addr;
+                    memcpy(&addr.m_addr6, packet + off, 16);
+                    addr.m_address_type = AddressType::IpV6;
+                    addresses.push_back(addr);
+                    query->m_ttl = std::min(query->m_ttl, ttl);
+                }
+                off += rdlength;
+            }
+
+            query->m_done[idx] = true;
+            query->m_errc[idx] = errc;
+            return query->m_done[0] && query->m_done[1];
+        }
+
+        // under m_lock
+        // remove from maps, merge the results and put it into cache
+        void finish_locked(Query *query)
+        {
+            m_inflight.erase(query->m_name);
+            release_slot(query->m_slot);
+
+            auto &addresses = query->m_addresses[0];
+            addresses.insert(addresses.end(), query->m_addresses[1].begin(), query->m_addresses[1].end());
+
+            if(!addresses.empty()) {
+                query->m_errc[0] = DnsErrc::ok;
+                cache_insert(query->m_name, addresses, query->m_ttl);
+            } else if(query->m_errc[0] == DnsErrc::ok) {
+                // NODATA for A, take the error of AAAA
+                query->m_errc[0] = query->m_errc[1] == DnsErrc::ok ? DnsErrc::not_found : query->m_errc[1];
+            }
+
+            if(m_inflight.empty() && m_timer_armed) {
+                set_timer(false);
+            }
+        }
+
+        // not under m_lock
+        void complete(Query *done)
+        {
+            for(; done;) {
+                Query *next = done->m_next_done;
+                for(auto awaiter = done->m_waiters; awaiter;) {
+                    // awaiter may be destroyed after resumed
+                    auto next_awaiter = awaiter->m_next;
+                    awaiter->m_result.m_errc = done->m_errc[0];
+                    awaiter->m_result.m_addresses = done->m_addresses[0];
+                    m_ctx->post_task(&awaiter->m_local_task);
+                    awaiter = next_awaiter;
+                }
+                delete done;
+                done = next;
+            }
+        }
+
+        void on_timer()
+        {
+            uint64_t expirations;
+            ::read(m_timer_handle, &expirations, sizeof(expirations));
+
+            Query *done = nullptr;
+            std::unique_lock<DefaultSpinLock> guard(m_lock);
+            auto now = SteadyClock::now();
+            for(auto it = m_inflight.begin(); it != m_inflight.end();) {
+                Query *query = it->second;
+                ++it;
+                if(query->m_deadline > now) {
+                    continue;
+                }
+                if(query->m_attempt < m_config.m_attempts * (int)m_servers.size()) {
+                    // try next nameserver
+                    m_stats.m_retransmits += 1;
+                    query->m_server = (query->m_server + 1) % m_servers.size();
+                    send_query(query);
+                    continue;
+                }
+                for(int i = 0; i < 2; ++i) {
+                    if(!query->m_done[i]) {
+                        query->m_errc[i] = DnsErrc::timeout;
+                    }
+                }
+                finish_locked(query);
+                query->m_next_done = done;
+                done = query;
+            }
+            guard.unlock();
+
+            complete(done);
+        }
+    };
+
+    inline void DnsSocketCallback::on_callback(IoEvent &)
+    {
+        m_client->on_readable(m_slot);
+    }
+
+    inline void DnsTimerCallback::on_callback(IoEvent &)
+    {
+        m_client->on_timer();
+    }
+
+    inline bool DnsLookupAwaiter::await_ready()
+    {
+        return m_client->lookup_local(*this);
+    }
+
+    inline bool DnsLookupAwaiter::await_suspend(std::coroutine_handle<TaskPromiseBase> h)
+    {
+        m_suspend_coroutine = h;
+        return m_client->enqueue(*this);
+    }
+
+    // client must be used with the ctx it was created with
+    inline DnsLookupAwaiter async_dns_lookup(DnsClient &client, char const *name)
+    {
+        return client.lookup(name);
+    }
+
+} // namespace tinyasync
+
+#endif
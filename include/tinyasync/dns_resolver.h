@@ -1,15 +1,9 @@
 #ifndef TINYASYNC_DNS_RESOLVER_H
 #define TINYASYNC_DNS_RESOLVER_H
 
-#include <thread>
-#include <vector>
-#include <mutex>
-#include <condition_variable>
-
 namespace tinyasync
 {
     class DnsResolver;
-    class DnsResolverFactory;
 
     struct DsnResult
     {
@@ -28,102 +22,32 @@ namespace tinyasync
     };
 
 
-    struct [[nodiscard]] DnsResolverAwaiter : ListNode
+    // runs in executor thread
+    struct DnsResolveFunc
     {
-        DnsResolver *m_dns_resolver;
-        IoCtxBase *m_ctx;
-        DsnResult m_result;
-        std::coroutine_handle<TaskPromiseBase> m_suspend_coroutine;
         char const *m_name;
-        PostTask m_local_task;
-
-        DnsResolverAwaiter(DnsResolver &resolver, IoCtxBase &ctx, char const *name) {
-            m_ctx = &ctx;
-            m_dns_resolver = &resolver;
-            m_local_task.set_callback(do_local_task);         
-            m_name = name;   
-        }
-
-        // resolve done
-        // resume our coroutine
-        static void do_local_task(PostTask *posttask)
-        {
-            TINYASYNC_POINT_FROM_MEMBER(awaiter, posttask, DnsResolverAwaiter, m_local_task);
-            TINYASYNC_RESUME(awaiter->m_suspend_coroutine);            
-        }
-
-        bool await_ready()
-        {
-            return false;
-        }
-
-        template<class P>
-        void await_suspend(std::coroutine_handle<P> h) {
-            auto suspend_coroutine = h.promise().coroutine_handle_base();
-            await_suspend(suspend_coroutine);
-        }
-
-        void await_suspend(std::coroutine_handle<TaskPromiseBase> h);
-
-        DsnResult await_resume();
-
-        
 
+        DsnResult operator()() const;
     };
 
+    using DnsResolverAwaiter = ExecutorAwaiter<DnsResolveFunc>;
+
+    // getaddrinfo 是阻塞的, 交给 BlockingExecutor 去做
     class DnsResolver
     {
-
-        friend class DnsResolverAwaiter;
-
-        // public for dns thread
-        std::condition_variable m_condv;
-        std::mutex m_mutex;
-        Queue m_requests;
-
-        DefaultSpinLock m_spinlock;
-        std::vector<std::thread> m_threads;
-        bool m_abort = false;
+        BlockingExecutor m_executor;
 
     public:
         DnsResolver() = default;
         DnsResolver(DnsResolver &&) = delete;
 
         void add_workers(size_t n) {
-
-            for(size_t i = 0; i < n; ++i) {
-
-                std::unique_lock<std::mutex> guard(m_mutex);
-                m_threads.emplace_back([this] () {
-
-                    int id = this->m_threads.size();
-                    TINYASYNC_GUARD("[dns thread %d]", id);                    
-
-                    this->work(id);
-                });
-                guard.unlock();
-            }
+            m_executor.add_workers(n);
         }
 
-
-        ~DnsResolver()
+        static void gethostaddr(char const *name, DsnResult &result)
         {
-            std::unique_lock<std::mutex> guard(m_mutex);
-            m_abort = true;
-            guard.unlock();
-            
-            m_condv.notify_all();
-
-            for(auto &thread : m_threads) {
-                thread.join();
-            }
-
-
-        }
-
-        void gethostaddr(DnsResolverAwaiter &req)
-        {
-            addrinfo *result;
+            addrinfo *res0;
 
             addrinfo hints;
             memset(&hints, 0, sizeof(hints));
@@ -131,120 +55,62 @@ namespace tinyasync
             hints.ai_socktype = SOCK_STREAM;
             hints.ai_flags |= AI_CANONNAME;
 
-            int errc = getaddrinfo(req.m_name, NULL, &hints, &result);
+            int errc = getaddrinfo(name, NULL, &hints, &res0);
             if (errc)
             {
-                req.m_result.m_errc = errc;
+                result.m_errc = errc;
                 return;
             }
 
-            for (auto res = result; res;)
+            for (auto res = res0; res;)
             {
 
                 if (res->ai_family == AF_INET)
                 {
                     auto addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
-                    req.m_result.m_address.m_addr4 = addr;
+                    result.m_address.m_addr4 = addr;
                     break;
                 }
                 else if (res->ai_family == AF_INET6)
                 {
                     auto addr = ((struct sockaddr_in6 *)res->ai_addr)->sin6_addr;
-                    req.m_result.m_address.m_addr6 = addr;
+                    result.m_address.m_addr6 = addr;
                     break;
                 }
                 res = res->ai_next;
             }
 
-            freeaddrinfo(result);
-        }
-
-        void work(int id)
-        {
-            for (;!m_abort;)
-            {
-                DnsResolverAwaiter *awaiter = nullptr;   
-                std::unique_lock<std::mutex> guard(m_mutex);
-                for(;!m_abort;) {                           
-                    m_spinlock.lock();
-                    auto node = m_requests.pop();                    
-                    m_spinlock.unlock();
-                    if(node) {
-                        awaiter = static_cast<DnsResolverAwaiter *>(node);
-                        break;
-                    }
-                    m_condv.wait(guard);
-                }
-                guard.unlock();
-                if(m_abort) {
-                    break;
-                }
-                
-                gethostaddr(*awaiter);
-
-
-                TINYASYNC_ASSERT(awaiter->m_ctx);
-                TINYASYNC_LOG("post response to %p", awaiter->m_ctx);
-                // should thread safe
-                awaiter->m_ctx->post_task(&awaiter->m_local_task);
-            }
-
-            TINYASYNC_LOG("worker %d abort", id);
+            freeaddrinfo(res0);
         }
 
-
-
-
         static DnsResolver dns_resolver;
 
         static DnsResolver &instance() {
             return dns_resolver;
         }
 
-        // ctx must be thread safe for posting task
+        // the result is posted back with remote_post_task, any ctx works
         DnsResolverAwaiter resolve(IoContext &ctx, char const *name)
         {
-            return {*this, *ctx.get_io_ctx_base(), name };
+            return m_executor.run(ctx, DnsResolveFunc{ name });
         }
     };
 
     inline DnsResolver DnsResolver::dns_resolver;
 
-    DnsResolverAwaiter async_dns_resolve(IoContext &ctx, char const *name)
+    inline DsnResult DnsResolveFunc::operator()() const
     {
-        auto inst = &DnsResolver::instance();   
-        return inst->resolve(ctx, name);
-    }
-
-    inline void DnsResolverAwaiter::await_suspend(std::coroutine_handle<TaskPromiseBase> h)
-    {
-        TINYASYNC_GUARD("DnsResolverAwaiter::await_suspend(): ");
-        TINYASYNC_LOG("enqueue");
-
-        m_suspend_coroutine = h;        
-
-        auto resolver = m_dns_resolver;
-
-        resolver->m_spinlock.lock();
-        std::size_t n  = resolver->m_threads.size();
-        
-        if(n == 0) TINYASYNC_UNLIKELY {
-            resolver->m_spinlock.unlock(); 
-            resolver->add_workers(1);
-            resolver->m_spinlock.lock();
-        }
-
-        resolver->m_requests.push(this);
-        resolver->m_spinlock.unlock(); 
-
-        resolver->m_condv.notify_one();      
+        TINYASYNC_GUARD("DnsResolveFunc(): ");
+        DsnResult result;
+        DnsResolver::gethostaddr(m_name, result);
+        TINYASYNC_LOG("resolved");
+        return result;
     }
 
-    DsnResult DnsResolverAwaiter::await_resume()
+    inline DnsResolverAwaiter async_dns_resolve(IoContext &ctx, char const *name)
     {
-        TINYASYNC_GUARD("DnsResolverAwaiter::await_suspend(): ");
-        TINYASYNC_LOG("resolved");
-        return this->m_result;
+        auto inst = &DnsResolver::instance();
+        return inst->resolve(ctx, name);
     }
 
 } // namespace tinyasync
@@ -0,0 +1,484 @@
+#ifndef TINYASYNC_EXECUTOR_H
+#define TINYASYNC_EXECUTOR_H
+
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <exception>
+#include <type_traits>
+#include <stdexcept>
+
+namespace tinyasync
+{
+    class BlockingExecutor;
+
+    // 在工作线程里执行的任务
+    // 和 PostTask 一样用函数指针,不用虚函数
+    struct ExecutorTask : ListNode
+    {
+        void (*m_run)(ExecutorTask *);
+    };
+
+    template<class R>
+    struct ExecutorResult
+    {
+        std::optional<R> m_value;
+
+        template<class F>
+        void set(F &f)
+        {
+            m_value.emplace(f());
+        }
+
+        R get()
+        {
+            return std::move(*m_value);
+        }
+    };
+
+    template<>
+    struct ExecutorResult<void>
+    {
+        template<class F>
+        void set(F &f)
+        {
+            f();
+        }
+
+        void get()
+        {
+        }
+    };
+
+    // co_await executor.run(ctx, f)
+    // f() runs in a worker thread, the result (or exception) is delivered
+    // back to the awaiting coroutine in the ctx thread through remote_post_task
+    // so both single and multiple thread ctxs can be used
+    template<class F>
+    struct [[nodiscard]] ExecutorAwaiter : ExecutorTask
+    {
+        using result_type = std::remove_cvref_t<std::invoke_result_t<F &>>;
+
+        BlockingExecutor *m_executor;
+        IoCtxBase *m_ctx;
+        F m_func;
+        ExecutorResult<result_type> m_result;
+        std::exception_ptr m_exception;
+        std::coroutine_handle<TaskPromiseBase> m_suspend_coroutine;
+        PostTask m_local_task;
+
+        ExecutorAwaiter(BlockingExecutor &executor, IoCtxBase *ctx, F func)
+            : m_func(std::move(func))
+        {
+            m_executor = &executor;
+            m_ctx = ctx;
+            m_run = run_in_worker;
+            m_local_task.set_callback(do_local_task);
+        }
+
+        ExecutorAwaiter(ExecutorAwaiter &&) = delete;
+
+        // run in worker thread
+        static void run_in_worker(ExecutorTask *task)
+        {
+            auto awaiter = static_cast<ExecutorAwaiter *>(task);
+            try {
+                awaiter->m_result.set(awaiter->m_func);
+            } catch(...) {
+                awaiter->m_exception = std::current_exception();
+            }
+            TINYASYNC_ASSERT(awaiter->m_ctx);
+            // not the ctx's thread, post_task() of a single thread ctx is not locked
+            awaiter->m_ctx->remote_post_task(&awaiter->m_local_task);
+        }
+
+        // work done
+        // resume our coroutine
+        static void do_local_task(PostTask *posttask)
+        {
+            TINYASYNC_POINT_FROM_MEMBER(awaiter, posttask, ExecutorAwaiter, m_local_task);
+            TINYASYNC_RESUME(awaiter->m_suspend_coroutine);
+        }
+
+        bool await_ready()
+        {
+            return false;
+        }
+
+        template<class P>
+        void await_suspend(std::coroutine_handle<P> h) {
+            auto suspend_coroutine = h.promise().coroutine_handle_base();
+            await_suspend(suspend_coroutine);
+        }
+
+        void await_suspend(std::coroutine_handle<TaskPromiseBase> h);
+
+        result_type await_resume()
+        {
+            if(m_exception) TINYASYNC_UNLIKELY {
+                std::rethrow_exception(m_exception);
+            }
+            return m_result.get();
+        }
+    };
+
+    // Vyukov's bounded MPMC queue
+    // 每个工作线程一个,别的线程可以从这里偷任务
+    class ExecutorQueue
+    {
+        static const std::size_t k_capacity = 256;
+        static const std::size_t k_mask = k_capacity - 1;
+        static_assert((k_capacity & k_mask) == 0);
+
+        struct Cell
+        {
+            std::atomic<std::size_t> m_sequence;
+            ExecutorTask *m_task;
+        };
+
+        alignas(64) Cell m_cells[k_capacity];
+        alignas(64) std::atomic<std::size_t> m_enqueue_pos;
+        alignas(64) std::atomic<std::size_t> m_dequeue_pos;
+
+    public:
+        ExecutorQueue()
+        {
+            for(std::size_t i = 0; i < k_capacity; ++i) {
+                m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+            }
+            m_enqueue_pos.store(0, std::memory_order_relaxed);
+            m_dequeue_pos.store(0, std::memory_order_relaxed);
+        }
+
+        // false if full
+        bool push(ExecutorTask *task)
+        {
+            Cell *cell;
+            std::size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            for(;;) {
+                cell = &m_cells[pos & k_mask];
+                std::size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if(diff == 0) {
+                    if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if(diff < 0) {
+                    return false;
+                } else {
+                    pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+            cell->m_task = task;
+            cell->m_sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // nullptr if empty
+        ExecutorTask *pop()
+        {
+            Cell *cell;
+            std::size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            for(;;) {
+                cell = &m_cells[pos & k_mask];
+                std::size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+                if(diff == 0) {
+                    if(m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if(diff < 0) {
+                    return nullptr;
+                } else {
+                    pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                }
+            }
+            ExecutorTask *task = cell->m_task;
+            cell->m_sequence.store(pos + k_mask + 1, std::memory_order_release);
+            return task;
+        }
+    };
+
+    // 通用的阻塞任务线程池
+    // 提交无锁: 轮流放进各个工作线程的有界队列, 同时排队的任务最多 k_capacity * 工作线程数
+    // 队列都满了, 提交的协程排到 m_parked 上 (backpressure), 这时任务还不会被执行;
+    // 工作线程每取走一个任务, 空出的位置放进一个排队的任务
+    // 空闲的工作线程先取自己的队列, 再偷别人的
+    class BlockingExecutor
+    {
+        template<class F>
+        friend struct ExecutorAwaiter;
+
+        struct Worker
+        {
+            ExecutorQueue m_queue;
+            std::thread m_thread;
+        };
+
+        static const int k_max_workers = 64;
+
+        std::atomic<Worker *> m_workers[k_max_workers] = {};
+        std::atomic<int> m_num_workers = 0;
+        std::mutex m_add_mutex;
+
+        alignas(64) std::atomic<std::size_t> m_next_worker = 0;
+        // submitters waiting for a free slot in the queues, FIFO
+        std::mutex m_park_mutex;
+        ExecutorTask *m_park_head = nullptr;
+        ExecutorTask *m_park_tail = nullptr;
+        alignas(64) std::atomic<std::size_t> m_parked = 0;
+        // workers sleep on it with std::atomic::wait
+        alignas(64) std::atomic<uint32_t> m_signal = 0;
+        std::atomic<int> m_sleeping = 0;
+        std::atomic<bool> m_abort = false;
+
+    public:
+        BlockingExecutor() = default;
+        BlockingExecutor(BlockingExecutor &&) = delete;
+
+        ~BlockingExecutor()
+        {
+            m_abort.store(true);
+            m_signal.fetch_add(1);
+            m_signal.notify_all();
+
+            int n = m_num_workers.load();
+            for(int i = 0; i < n; ++i) {
+                Worker *worker = m_workers[i].load();
+                worker->m_thread.join();
+                delete worker;
+            }
+        }
+
+        void add_workers(size_t n)
+        {
+            std::lock_guard<std::mutex> guard(m_add_mutex);
+            for(size_t i = 0; i < n; ++i) {
+                int id = m_num_workers.load(std::memory_order_relaxed);
+                if(id == k_max_workers) {
+                    break;
+                }
+                Worker *worker = new Worker();
+                worker->m_thread = std::thread([this, worker, id] () {
+                    TINYASYNC_GUARD("[executor thread %d]", id);
+                    this->work(worker, id);
+                });
+                m_workers[id].store(worker, std::memory_order_release);
+                m_num_workers.store(id + 1, std::memory_order_release);
+            }
+        }
+
+        std::size_t num_workers() const
+        {
+            return m_num_workers.load(std::memory_order_acquire);
+        }
+
+        // submitters waiting because all queues are full
+        std::size_t parked() const
+        {
+            return m_parked.load(std::memory_order_relaxed);
+        }
+
+        // ctx must be thread safe for posting task
+        template<class F>
+        ExecutorAwaiter<std::decay_t<F> > run(IoCtxBase &ctx, F &&func)
+        {
+            return { *this, &ctx, std::forward<F>(func) };
+        }
+
+        template<class F>
+        ExecutorAwaiter<std::decay_t<F> > run(IoContext &ctx, F &&func)
+        {
+            return { *this, ctx.get_io_ctx_base(), std::forward<F>(func) };
+        }
+
+        // resume in the ctx that is running current coroutine
+        // only valid when awaited inside IoContext::run()
+        template<class F>
+        ExecutorAwaiter<std::decay_t<F> > run(F &&func)
+        {
+            return { *this, nullptr, std::forward<F>(func) };
+        }
+
+        void submit(ExecutorTask *task)
+        {
+            int n = m_num_workers.load(std::memory_order_acquire);
+            if(n == 0) TINYASYNC_UNLIKELY {
+                n = ensure_worker();
+            }
+
+            if(!try_push(task, n)) {
+                park(task);
+            }
+            wake_worker();
+        }
+
+    private:
+
+        void wake_worker()
+        {
+            m_signal.fetch_add(1);
+            if(m_sleeping.load() > 0) {
+                m_signal.notify_one();
+            }
+        }
+
+        bool try_push(ExecutorTask *task, int n)
+        {
+            std::size_t start = m_next_worker.fetch_add(1, std::memory_order_relaxed);
+            for(int i = 0; i < n; ++i) {
+                Worker *worker = m_workers[(start + i) % n].load(std::memory_order_acquire);
+                if(worker->m_queue.push(task)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void park(ExecutorTask *task)
+        {
+            {
+                std::lock_guard<std::mutex> guard(m_park_mutex);
+                task->m_next = nullptr;
+                if(m_park_tail) {
+                    m_park_tail->m_next = task;
+                } else {
+                    m_park_head = task;
+                }
+                m_park_tail = task;
+                m_parked.fetch_add(1);
+            }
+            // a worker may have freed a slot before it saw m_parked
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            admit_parked();
+        }
+
+        // move parked tasks into the queues while there is room
+        // called after a slot is freed; pairs with the fence in find_task
+        void admit_parked()
+        {
+            std::lock_guard<std::mutex> guard(m_park_mutex);
+            int n = m_num_workers.load(std::memory_order_acquire);
+            while(m_park_head) {
+                ExecutorTask *task = m_park_head;
+                // the task may run and be gone as soon as it is pushed
+                auto next = static_cast<ExecutorTask *>(task->m_next);
+                if(!try_push(task, n)) {
+                    break;
+                }
+                m_park_head = next;
+                if(!next) {
+                    m_park_tail = nullptr;
+                }
+                m_parked.fetch_sub(1);
+            }
+        }
+
+        int ensure_worker()
+        {
+            std::lock_guard<std::mutex> guard(m_add_mutex);
+            int n = m_num_workers.load(std::memory_order_relaxed);
+            if(n == 0) {
+                Worker *worker = new Worker();
+                worker->m_thread = std::thread([this, worker] () {
+                    TINYASYNC_GUARD("[executor thread %d]", 0);
+                    this->work(worker, 0);
+                });
+                m_workers[0].store(worker, std::memory_order_release);
+                m_num_workers.store(1, std::memory_order_release);
+                n = 1;
+            }
+            return n;
+        }
+
+        ExecutorTask *pop_task(Worker *self, int id)
+        {
+            ExecutorTask *task = self->m_queue.pop();
+            if(task) {
+                return task;
+            }
+
+            // steal
+            int n = m_num_workers.load(std::memory_order_acquire);
+            for(int i = 1; i < n; ++i) {
+                Worker *other = m_workers[(id + i) % n].load(std::memory_order_acquire);
+                task = other->m_queue.pop();
+                if(task) {
+                    return task;
+                }
+            }
+            return nullptr;
+        }
+
+        ExecutorTask *find_task(Worker *self, int id)
+        {
+            ExecutorTask *task = pop_task(self, id);
+            // either we see the parked task, or park() sees our free slot
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(m_parked.load(std::memory_order_relaxed) > 0) {
+                admit_parked();
+                wake_worker();
+                if(!task) {
+                    task = pop_task(self, id);
+                }
+            }
+            return task;
+        }
+
+        void work(Worker *self, int id)
+        {
+            for(;!m_abort.load(std::memory_order_relaxed);) {
+                ExecutorTask *task = find_task(self, id);
+                if(task) {
+                    task->m_run(task);
+                    continue;
+                }
+
+                uint32_t signal = m_signal.load();
+                // recheck, a task may be submitted before we load the signal
+                task = find_task(self, id);
+                if(task) {
+                    task->m_run(task);
+                    continue;
+                }
+                if(m_abort.load()) {
+                    break;
+                }
+                m_sleeping.fetch_add(1);
+                m_signal.wait(signal);
+                m_sleeping.fetch_sub(1);
+            }
+            TINYASYNC_LOG("worker %d abort", id);
+        }
+
+    public:
+
+        static BlockingExecutor &instance()
+        {
+            static BlockingExecutor executor;
+            return executor;
+        }
+    };
+
+    template<class F>
+    inline void ExecutorAwaiter<F>::await_suspend(std::coroutine_handle<TaskPromiseBase> h)
+    {
+        TINYASYNC_GUARD("ExecutorAwaiter::await_suspend(): ");
+        TINYASYNC_LOG("submit");
+
+        m_suspend_coroutine = h;
+        if(!m_ctx) {
+            m_ctx = t_run_loop.m_ctx;
+            if(!m_ctx) {
+                // e.g. co_spawn() runs the coroutine before IoContext::run()
+                throw std::logic_error("BlockingExecutor::run(f): no IoContext is running on this thread, use run(ctx, f)");
+            }
+        }
+        m_executor->submit(this);
+    }
+
+} // namespace tinyasync
+
+#endif
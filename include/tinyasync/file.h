@@ -0,0 +1,180 @@
+#ifndef TINYASYNC_FILE_H
+#define TINYASYNC_FILE_H
+
+#include <fcntl.h>
+
+namespace tinyasync
+{
+    class FileWorkers;
+    class AsyncFile;
+
+    // 普通文件对epoll总是"就绪"的,读写会阻塞IoCtx线程
+    // 所以把 pread/pwrite/fsync 交给工作线程去做,做完以后 remote_post_task 回来
+    // 单线程和多线程的 ctx 都可以用
+    enum class FileOp
+    {
+        Read,
+        Write,
+        Fsync,
+    };
+
+    // runs in executor thread
+    // bytes transfered, 0 for fsync
+    struct FileIoFunc
+    {
+        NativeHandle m_file_handle;
+        FileOp m_op;
+        void *m_buffer_addr;
+        std::size_t m_buffer_size;
+        off_t m_offset;
+
+        std::size_t operator()() const
+        {
+            ssize_t nbytes = 0;
+            switch (m_op)
+            {
+            case FileOp::Read:
+                do {
+                    nbytes = ::pread(m_file_handle, m_buffer_addr, m_buffer_size, m_offset);
+                } while (nbytes < 0 && errno == EINTR);
+                if (nbytes < 0) {
+                    throw_errno("AsyncFile: pread error");
+                }
+                break;
+            case FileOp::Write:
+                do {
+                    nbytes = ::pwrite(m_file_handle, m_buffer_addr, m_buffer_size, m_offset);
+                } while (nbytes < 0 && errno == EINTR);
+                if (nbytes < 0) {
+                    throw_errno("AsyncFile: pwrite error");
+                }
+                break;
+            case FileOp::Fsync:
+                if (::fsync(m_file_handle) < 0) {
+                    throw_errno("AsyncFile: fsync error");
+                }
+                break;
+            }
+            return nbytes;
+        }
+    };
+
+    using AsyncFileAwaiter = ExecutorAwaiter<FileIoFunc>;
+
+    // 文件io用自己的线程池, 不和dns等抢线程
+    class FileWorkers
+    {
+        BlockingExecutor m_executor;
+
+    public:
+        FileWorkers() = default;
+        FileWorkers(FileWorkers &&) = delete;
+
+        void add_workers(size_t n) {
+            m_executor.add_workers(n);
+        }
+
+        AsyncFileAwaiter submit(IoCtxBase &ctx, FileIoFunc func)
+        {
+            return m_executor.run(ctx, func);
+        }
+
+        static FileWorkers file_workers;
+
+        static FileWorkers &instance() {
+            return file_workers;
+        }
+    };
+
+    inline FileWorkers FileWorkers::file_workers;
+
+    // completions come back with remote_post_task, the ctx may be single thread
+    class AsyncFile
+    {
+        IoCtxBase *m_ctx = nullptr;
+        FileWorkers *m_workers = nullptr;
+        NativeHandle m_file_handle = NULL_HANDLE;
+
+    public:
+        AsyncFile() = default;
+
+        // open 本身也可能阻塞, 但一般很快, 就在当前线程做了
+        AsyncFile(IoContext &ctx, char const *path, int flags, mode_t mode = 0644)
+        {
+            m_ctx = ctx.get_io_ctx_base();
+            m_workers = &FileWorkers::instance();
+            m_file_handle = ::open(path, flags | O_CLOEXEC, mode);
+            if (m_file_handle < 0) {
+                m_file_handle = NULL_HANDLE;
+                throw_errno(format("AsyncFile: can't open %s", path));
+            }
+        }
+
+        AsyncFile(AsyncFile &&r)
+        {
+            m_ctx = r.m_ctx;
+            m_workers = r.m_workers;
+            m_file_handle = r.m_file_handle;
+            r.m_file_handle = NULL_HANDLE;
+        }
+
+        AsyncFile &operator=(AsyncFile &&r)
+        {
+            if(this != &r) {
+                close();
+                m_ctx = r.m_ctx;
+                m_workers = r.m_workers;
+                m_file_handle = r.m_file_handle;
+                r.m_file_handle = NULL_HANDLE;
+            }
+            return *this;
+        }
+
+        ~AsyncFile()
+        {
+            close();
+        }
+
+        NativeHandle native_handle() const
+        {
+            return m_file_handle;
+        }
+
+        // don't close while any operation is pending
+        void close()
+        {
+            if(m_file_handle != NULL_HANDLE) {
+                ::close(m_file_handle);
+                m_file_handle = NULL_HANDLE;
+            }
+        }
+
+        AsyncFileAwaiter async_read_at(Buffer buffer, off_t offset)
+        {
+            return m_workers->submit(*m_ctx, { m_file_handle, FileOp::Read, buffer.data(), buffer.size(), offset });
+        }
+
+        AsyncFileAwaiter async_read_at(void *buffer, std::size_t bytes, off_t offset)
+        {
+            return m_workers->submit(*m_ctx, { m_file_handle, FileOp::Read, buffer, bytes, offset });
+        }
+
+        AsyncFileAwaiter async_write_at(ConstBuffer buffer, off_t offset)
+        {
+            return m_workers->submit(*m_ctx, { m_file_handle, FileOp::Write, (void *)buffer.data(), buffer.size(), offset });
+        }
+
+        AsyncFileAwaiter async_write_at(void const *buffer, std::size_t bytes, off_t offset)
+        {
+            return m_workers->submit(*m_ctx, { m_file_handle, FileOp::Write, (void *)buffer, bytes, offset });
+        }
+
+        AsyncFileAwaiter async_fsync()
+        {
+            return m_workers->submit(*m_ctx, { m_file_handle, FileOp::Fsync, nullptr, 0, 0 });
+        }
+    };
+
+} // namespace tinyasync
+
+#endif
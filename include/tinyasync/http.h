@@ -0,0 +1,602 @@
+#ifndef TINYASYNC_HTTP_H
+#define TINYASYNC_HTTP_H
+
+// HTTP/1.1 服务端
+// HttpRequestParser: 增量解析, 请求里的字符串都是指向接收缓冲的 string_view, 不拷贝
+//                    找行尾用 SSE2 一次比较 16 字节
+// http_serve_connection: keep-alive, pipelining
+//                    一次读到的多个请求依次处理, 所有响应用一次 sendmsg 发出去
+// 不支持 chunked 请求体 (回 501)
+
+#include <string_view>
+#include <limits.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace tinyasync
+{
+    // first c in [p, end), or nullptr
+    inline char const *http_find_char(char const *p, char const *end, char c)
+    {
+#ifdef __SSE2__
+        __m128i const pattern = _mm_set1_epi8(c);
+        for(; end - p >= 16; p += 16) {
+            __m128i v = _mm_loadu_si128((__m128i const *)p);
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, pattern));
+            if(mask) {
+                return p + __builtin_ctz(mask);
+            }
+        }
+#endif
+        for(; p < end; ++p) {
+            if(*p == c) {
+                return p;
+            }
+        }
+        return nullptr;
+    }
+
+    // the end of the empty line ("\r\n\r\n" or "\n\n") in [p, end)
+    // the request begins at begin, p may be in the middle to skip scanned bytes
+    inline char const *http_find_header_end(char const *begin, char const *p, char const *end)
+    {
+        auto is_end = [begin](char const *lf) {
+            return (lf - begin >= 1 && lf[-1] == '\n') ||
+                (lf - begin >= 2 && lf[-1] == '\r' && lf[-2] == '\n');
+        };
+#ifdef __SSE2__
+        __m128i const lf = _mm_set1_epi8('\n');
+        for(; end - p >= 16; p += 16) {
+            __m128i v = _mm_loadu_si128((__m128i const *)p);
+            unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+            // usually one '\n' per header line, walk all of them
+            for(; mask; mask &= mask - 1) {
+                char const *q = p + __builtin_ctz(mask);
+                if(is_end(q)) {
+                    return q + 1;
+                }
+            }
+        }
+#endif
+        for(; p < end; ++p) {
+            if(*p == '\n' && is_end(p)) {
+                return p + 1;
+            }
+        }
+        return nullptr;
+    }
+
+    inline bool http_iequals(std::string_view a, std::string_view b)
+    {
+        if(a.size() != b.size()) {
+            return false;
+        }
+        for(std::size_t i = 0; i < a.size(); ++i) {
+            char x = a[i], y = b[i];
+            if(x >= 'A' && x <= 'Z') x += 'a' - 'A';
+            if(y >= 'A' && y <= 'Z') y += 'a' - 'A';
+            if(x != y) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    inline std::string_view http_trim(std::string_view s)
+    {
+        while(!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+            s.remove_prefix(1);
+        }
+        while(!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+            s.remove_suffix(1);
+        }
+        return s;
+    }
+
+    // true if the comma separated list has token
+    inline bool http_has_token(std::string_view list, std::string_view token)
+    {
+        for(;;) {
+            auto comma = list.find(',');
+            if(http_iequals(http_trim(list.substr(0, comma)), token)) {
+                return true;
+            }
+            if(comma == std::string_view::npos) {
+                return false;
+            }
+            list.remove_prefix(comma + 1);
+        }
+    }
+
+    inline char const *http_status_reason(int status)
+    {
+        switch (status)
+        {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        case 505: return "HTTP Version Not Supported";
+        }
+        return "Unknown";
+    }
+
+    struct HttpHeader
+    {
+        std::string_view m_name;
+        std::string_view m_value;
+    };
+
+    // all views point into the receive buffer
+    // valid until the response of this request is sent
+    struct HttpRequest
+    {
+        static const int k_max_headers = 64;
+
+        std::string_view m_method;
+        std::string_view m_target;
+        std::string_view m_body;
+        int m_version_minor = 1;
+        bool m_keep_alive = true;
+        std::size_t m_content_length = 0;
+        int m_num_headers = 0;
+        HttpHeader m_headers[k_max_headers];
+
+        // empty if not found
+        std::string_view header(std::string_view name) const
+        {
+            for(int i = 0; i < m_num_headers; ++i) {
+                if(http_iequals(m_headers[i].m_name, name)) {
+                    return m_headers[i].m_value;
+                }
+            }
+            return {};
+        }
+
+        // target without query
+        std::string_view path() const
+        {
+            return m_target.substr(0, m_target.find('?'));
+        }
+    };
+
+    enum class HttpParseStatus
+    {
+        Complete,
+        Incomplete,
+        Error,
+    };
+
+    class HttpRequestParser
+    {
+        // bytes scanned for the end of header
+        std::size_t m_scanned = 0;
+        // header + body, known after the header is parsed
+        std::size_t m_request_size = 0;
+
+    public:
+        std::size_t m_max_header_size = 8 * 1024;
+        std::size_t m_max_body_size = 1024 * 1024;
+        // status for the error response
+        int m_error_status = 0;
+
+        void reset()
+        {
+            m_scanned = 0;
+            m_request_size = 0;
+        }
+
+        // data begins at the first byte of the request
+        // call again with the same data and more bytes appended after Incomplete
+        // the data may be moved between calls
+        HttpParseStatus parse(char const *data, std::size_t size, HttpRequest &req, std::size_t &consumed)
+        {
+            if(m_request_size && size < m_request_size) {
+                return HttpParseStatus::Incomplete;
+            }
+
+            // empty lines before request line are ignored
+            std::size_t start = 0;
+            while(start < size && (data[start] == '\r' || data[start] == '\n')) {
+                ++start;
+            }
+            char const *begin = data + start;
+            char const *end = data + size;
+            // the end "\r\n\r\n" may cross the last scan
+            std::size_t from = std::max(start, m_scanned > 3 ? m_scanned - 3 : 0);
+            char const *head_end = http_find_header_end(begin, data + from, end);
+            if(!head_end) {
+                m_scanned = size;
+                if(size - start > m_max_header_size) {
+                    return error(431);
+                }
+                return HttpParseStatus::Incomplete;
+            }
+            if((std::size_t)(head_end - begin) > m_max_header_size) {
+                return error(431);
+            }
+
+            int status = parse_head(begin, head_end, req);
+            if(status) {
+                return error(status);
+            }
+            if(req.m_content_length > m_max_body_size) {
+                return error(413);
+            }
+
+            std::size_t total = (head_end - data) + req.m_content_length;
+            if(size < total) {
+                m_request_size = total;
+                return HttpParseStatus::Incomplete;
+            }
+            req.m_body = std::string_view(head_end, req.m_content_length);
+            consumed = total;
+            reset();
+            return HttpParseStatus::Complete;
+        }
+
+        HttpParseStatus parse(ConstBuffer buffer, HttpRequest &req, std::size_t &consumed)
+        {
+            return parse((char const *)buffer.data(), buffer.size(), req, consumed);
+        }
+
+    private:
+        HttpParseStatus error(int status)
+        {
+            reset();
+            m_error_status = status;
+            return HttpParseStatus::Error;
+        }
+
+        static std::string_view line(char const *p, char const *lf)
+        {
+            if(lf > p && lf[-1] == '\r') {
+                --lf;
+            }
+            return std::string_view(p, lf - p);
+        }
+
+        // 0 if ok, otherwise http status of the error
+        static int parse_head(char const *begin, char const *end, HttpRequest &req)
+        {
+            // request line
+            char const *lf = http_find_char(begin, end, '\n');
+            std::string_view request_line = line(begin, lf);
+
+            auto sp1 = request_line.find(' ');
+            if(sp1 == 0 || sp1 == std::string_view::npos) {
+                return 400;
+            }
+            auto sp2 = request_line.find(' ', sp1 + 1);
+            if(sp2 == std::string_view::npos || sp2 == sp1 + 1) {
+                return 400;
+            }
+            req.m_method = request_line.substr(0, sp1);
+            req.m_target = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+            std::string_view version = request_line.substr(sp2 + 1);
+            if(version == "HTTP/1.1") {
+                req.m_version_minor = 1;
+            } else if(version == "HTTP/1.0") {
+                req.m_version_minor = 0;
+            } else if(version.starts_with("HTTP/")) {
+                return 505;
+            } else {
+                return 400;
+            }
+
+            req.m_num_headers = 0;
+            req.m_content_length = 0;
+            bool has_content_length = false;
+            bool close = false;
+            bool keep_alive = false;
+
+            for(char const *p = lf + 1; p < end; ) {
+                lf = http_find_char(p, end, '\n');
+                std::string_view header_line = line(p, lf);
+                p = lf + 1;
+                if(header_line.empty()) {
+                    break;
+                }
+
+                auto colon = header_line.find(':');
+                if(colon == 0 || colon == std::string_view::npos) {
+                    return 400;
+                }
+                std::string_view name = header_line.substr(0, colon);
+                // no whitespace between name and colon
+                if(name.back() == ' ' || name.back() == '\t') {
+                    return 400;
+                }
+                std::string_view value = http_trim(header_line.substr(colon + 1));
+
+                if(req.m_num_headers == HttpRequest::k_max_headers) {
+                    return 431;
+                }
+                req.m_headers[req.m_num_headers++] = { name, value };
+
+                if(http_iequals(name, "content-length")) {
+                    std::size_t n = 0;
+                    if(value.empty() || value.size() > 18) {
+                        return 400;
+                    }
+                    for(char c : value) {
+                        if(c < '0' || c > '9') {
+                            return 400;
+                        }
+                        n = n * 10 + (c - '0');
+                    }
+                    if(has_content_length && n != req.m_content_length) {
+                        return 400;
+                    }
+                    has_content_length = true;
+                    req.m_content_length = n;
+                } else if(http_iequals(name, "transfer-encoding")) {
+                    return 501;
+                } else if(http_iequals(name, "connection")) {
+                    close = close || http_has_token(value, "close");
+                    keep_alive = keep_alive || http_has_token(value, "keep-alive");
+                }
+            }
+
+            if(req.m_version_minor == 1) {
+                req.m_keep_alive = !close;
+            } else {
+                req.m_keep_alive = keep_alive && !close;
+            }
+            return 0;
+        }
+    };
+
+    struct HttpResponse
+    {
+        int m_status = 200;
+        // extra header lines, "Name: value\r\n"
+        std::string m_headers;
+        std::string m_body;
+        // used if m_body is empty
+        // must be alive until the response is sent, e.g. static data or a view of the request
+        std::string_view m_body_view;
+        // set to false to close the connection after this response
+        bool m_keep_alive = true;
+        // version of the request, set by the server
+        // HTTP/1.0 keeps the connection only with "Connection: keep-alive"
+        int m_version_minor = 1;
+        // status line and headers, filled by the server
+        std::string m_head;
+
+        void add_header(std::string_view name, std::string_view value)
+        {
+            m_headers.append(name);
+            m_headers.append(": ");
+            m_headers.append(value);
+            m_headers.append("\r\n");
+        }
+
+        void set_body(std::string body)
+        {
+            m_body = std::move(body);
+            m_body_view = {};
+        }
+
+        void set_body_view(std::string_view body)
+        {
+            m_body.clear();
+            m_body_view = body;
+        }
+
+        std::string_view body() const
+        {
+            return m_body.empty() ? m_body_view : std::string_view(m_body);
+        }
+
+        // keep the capacity
+        void clear()
+        {
+            m_status = 200;
+            m_headers.clear();
+            m_body.clear();
+            m_body_view = {};
+            m_keep_alive = true;
+            m_version_minor = 1;
+            m_head.clear();
+        }
+
+        void build_head()
+        {
+            char line[64];
+            int n = snprintf(line, sizeof(line), "HTTP/1.1 %d ", m_status);
+            m_head.assign(line, n);
+            m_head.append(http_status_reason(m_status));
+            n = snprintf(line, sizeof(line), "\r\nContent-Length: %zu\r\n", body().size());
+            m_head.append(line, n);
+            if(!m_keep_alive) {
+                m_head.append("Connection: close\r\n");
+            } else if(m_version_minor == 0) {
+                m_head.append("Connection: keep-alive\r\n");
+            }
+            m_head.append(m_headers);
+            m_head.append("\r\n");
+        }
+    };
+
+    struct HttpServerConfig
+    {
+        // initial receive buffer, grows for large requests
+        std::size_t m_buffer_size = 16 * 1024;
+        std::size_t m_max_header_size = 8 * 1024;
+        std::size_t m_max_body_size = 1024 * 1024;
+        // pipelined requests answered by one sendmsg
+        int m_max_pipeline = 64;
+    };
+
+    // send all the buffers, iov is modified
+    inline Task<bool> http_send_all(Connection &conn, iovec *iov, std::size_t iovcnt)
+    {
+        std::size_t idx = 0;
+        while(idx < iovcnt) {
+            int cnt = (int)std::min<std::size_t>(iovcnt - idx, IOV_MAX);
+            std::size_t nsent = co_await conn.async_sendv(iov + idx, cnt);
+            if(nsent == 0) {
+                co_return false;
+            }
+            for(; idx < iovcnt && nsent >= iov[idx].iov_len; ++idx) {
+                nsent -= iov[idx].iov_len;
+            }
+            if(nsent) {
+                iov[idx].iov_base = (char *)iov[idx].iov_base + nsent;
+                iov[idx].iov_len -= nsent;
+            }
+        }
+        co_return true;
+    }
+
+    // serve requests until the connection is closed
+    // handler: void (HttpRequest const &, HttpResponse &) or Task<> (HttpRequest const &, HttpResponse &)
+    // socket errors are thrown, handler exceptions are answered by 500
+    template<class Handler>
+    Task<> http_serve_connection(Connection conn, Handler handler, HttpServerConfig config = {})
+    {
+        constexpr bool k_async_handler = std::is_same_v<
+            std::invoke_result_t<Handler &, HttpRequest const &, HttpResponse &>, Task<> >;
+
+        HttpRequestParser parser;
+        parser.m_max_header_size = config.m_max_header_size;
+        parser.m_max_body_size = config.m_max_body_size;
+
+        std::vector<char> buffer(config.m_buffer_size);
+        // unparsed bytes are in [begin, end)
+        std::size_t begin = 0;
+        std::size_t end = 0;
+
+        HttpRequest req;
+        std::vector<HttpResponse> responses(config.m_max_pipeline);
+        std::vector<iovec> iov;
+        iov.reserve(2 * config.m_max_pipeline);
+        bool keep_alive = true;
+
+        while(keep_alive) {
+            // answer all complete requests in the buffer
+            int n = 0;
+            while(n < config.m_max_pipeline && keep_alive) {
+                std::size_t consumed;
+                auto status = parser.parse(buffer.data() + begin, end - begin, req, consumed);
+                if(status == HttpParseStatus::Incomplete) {
+                    break;
+                }
+
+                auto &resp = responses[n++];
+                resp.clear();
+                if(status == HttpParseStatus::Error) {
+                    resp.m_status = parser.m_error_status;
+                    resp.m_keep_alive = false;
+                    keep_alive = false;
+                    break;
+                }
+                begin += consumed;
+                resp.m_keep_alive = req.m_keep_alive;
+                resp.m_version_minor = req.m_version_minor;
+                try {
+                    if constexpr (k_async_handler) {
+                        co_await handler(req, resp);
+                    } else {
+                        handler(req, resp);
+                    }
+                } catch(...) {
+                    TINYASYNC_LOG("http handler: %s", to_string(std::current_exception()).c_str());
+                    resp.clear();
+                    resp.m_status = 500;
+                    resp.m_keep_alive = false;
+                    resp.m_version_minor = req.m_version_minor;
+                }
+                keep_alive = resp.m_keep_alive;
+                if(req.m_method == "HEAD") {
+                    // Content-Length of the body, but no body
+                    resp.build_head();
+                    resp.m_body.clear();
+                    resp.m_body_view = {};
+                }
+            }
+
+            if(n) {
+                iov.clear();
+                for(int i = 0; i < n; ++i) {
+                    auto &resp = responses[i];
+                    if(resp.m_head.empty()) {
+                        resp.build_head();
+                    }
+                    iov.push_back({ resp.m_head.data(), resp.m_head.size() });
+                    auto body = resp.body();
+                    if(body.size()) {
+                        iov.push_back({ (void *)body.data(), body.size() });
+                    }
+                }
+                if(!co_await http_send_all(conn, iov.data(), iov.size())) {
+                    break;
+                }
+                if(!keep_alive) {
+                    break;
+                }
+                if(n == config.m_max_pipeline) {
+                    // there may be more requests in buffer
+                    continue;
+                }
+            }
+
+            // read more
+            if(begin == end) {
+                begin = end = 0;
+            } else if(end == buffer.size()) {
+                if(begin > 0) {
+                    memmove(buffer.data(), buffer.data() + begin, end - begin);
+                    end -= begin;
+                    begin = 0;
+                } else {
+                    // a large request, the parser limits the size
+                    buffer.resize(buffer.size() * 2);
+                }
+            }
+            std::size_t nread = co_await conn.async_read(buffer.data() + end, buffer.size() - end);
+            if(nread == 0) {
+                break;
+            }
+            end += nread;
+        }
+    }
+
+    template<class Handler>
+    Task<> http_serve_connection_noexcept(Connection conn, Handler handler, HttpServerConfig config)
+    {
+        try {
+            co_await http_serve_connection(std::move(conn), std::move(handler), config);
+        } catch(...) {
+            TINYASYNC_LOG("http connection: %s", to_string(std::current_exception()).c_str());
+        }
+    }
+
+    // accept and serve connections forever
+    template<class Handler>
+    Task<> http_listen(Acceptor &acceptor, Handler handler, HttpServerConfig config = {})
+    {
+        for(;;) {
+            Connection conn = co_await acceptor.async_accept();
+            co_spawn(http_serve_connection_noexcept(std::move(conn), handler, config));
+        }
+    }
+
+} // namespace tinyasync
+
+#endif
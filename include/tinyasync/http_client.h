@@ -0,0 +1,761 @@
+#ifndef TINYASYNC_HTTP_CLIENT_H
+#define TINYASYNC_HTTP_CLIENT_H
+
+// HTTP/1.1 客户端
+// HttpResponseParser: 增量解析, 支持 Content-Length, chunked, 读到连接关闭
+// HttpClient: 每个 host:port 一个空闲连接池, keep-alive 的连接用完放回去复用
+//             限制每个 host 的连接数, 超过了就排队等别人用完
+//             复用的连接可能已经被服务端关掉, 没收到任何响应时重试一次 (只对幂等请求)
+// HttpClient 不是线程安全的, 只在 ctx 的线程里用
+
+#include "http.h"
+
+namespace tinyasync
+{
+    struct HttpClientHeader
+    {
+        std::string m_name;
+        std::string m_value;
+    };
+
+    struct HttpClientResponse
+    {
+        int m_status = 0;
+        int m_version_minor = 1;
+        std::string m_reason;
+        std::vector<HttpClientHeader> m_headers;
+        // chunked body is decoded
+        std::string m_body;
+        bool m_keep_alive = true;
+
+        // empty if not found
+        std::string_view header(std::string_view name) const
+        {
+            for(auto &h : m_headers) {
+                if(http_iequals(h.m_name, name)) {
+                    return h.m_value;
+                }
+            }
+            return {};
+        }
+
+        // keep the capacity
+        void clear()
+        {
+            m_status = 0;
+            m_version_minor = 1;
+            m_reason.clear();
+            m_headers.clear();
+            m_body.clear();
+            m_keep_alive = true;
+        }
+    };
+
+    class HttpResponseParser
+    {
+        enum class State
+        {
+            Head,
+            Body,
+            ChunkSize,
+            ChunkData,
+            ChunkDataEnd,
+            Trailer,
+            UntilClose,
+            Done,
+        };
+
+        State m_state = State::Head;
+        // bytes scanned for the end of header
+        std::size_t m_scanned = 0;
+        // body or chunk bytes to read
+        std::size_t m_remain = 0;
+
+        static const std::size_t k_max_line = 4 * 1024;
+
+    public:
+        std::size_t m_max_header_size = 64 * 1024;
+        std::size_t m_max_body_size = 64 * 1024 * 1024;
+        // response of HEAD has no body
+        bool m_head_request = false;
+        // what's wrong after Error
+        char const *m_error = nullptr;
+
+        void reset()
+        {
+            m_state = State::Head;
+            m_scanned = 0;
+            m_remain = 0;
+            m_error = nullptr;
+        }
+
+        // consumed bytes are done with, the body is copied to resp.m_body
+        // call again with the unconsumed bytes and more bytes appended after Incomplete
+        HttpParseStatus parse(char const *data, std::size_t size, HttpClientResponse &resp, std::size_t &consumed)
+        {
+            consumed = 0;
+            for(;;) {
+                char const *p = data + consumed;
+                char const *end = data + size;
+                std::size_t n = size - consumed;
+
+                switch (m_state)
+                {
+                case State::Head: {
+                    // the end "\r\n\r\n" may cross the last scan
+                    std::size_t from = m_scanned > 3 ? m_scanned - 3 : 0;
+                    char const *head_end = http_find_header_end(p, p + std::min(from, n), end);
+                    if(!head_end) {
+                        m_scanned = n;
+                        if(n > m_max_header_size) {
+                            return error("header too large");
+                        }
+                        return HttpParseStatus::Incomplete;
+                    }
+                    if((std::size_t)(head_end - p) > m_max_header_size) {
+                        return error("header too large");
+                    }
+                    m_scanned = 0;
+                    resp.clear();
+                    if(!parse_head(p, head_end, resp)) {
+                        return error("bad header");
+                    }
+                    consumed += head_end - p;
+                    if(resp.m_status / 100 == 1 && resp.m_status != 101) {
+                        // 100 Continue etc., the final response follows
+                        continue;
+                    }
+                    if(!body_state(resp)) {
+                        return HttpParseStatus::Error;
+                    }
+                    break;
+                }
+                case State::Body:
+                case State::ChunkData: {
+                    if(n == 0) {
+                        return HttpParseStatus::Incomplete;
+                    }
+                    std::size_t take = std::min(n, m_remain);
+                    resp.m_body.append(p, take);
+                    consumed += take;
+                    m_remain -= take;
+                    if(m_remain) {
+                        return HttpParseStatus::Incomplete;
+                    }
+                    m_state = m_state == State::Body ? State::Done : State::ChunkDataEnd;
+                    break;
+                }
+                case State::ChunkSize: {
+                    // hex[;ext]\r\n
+                    char const *lf = http_find_char(p, end, '\n');
+                    if(!lf) {
+                        if(n > k_max_line) {
+                            return error("chunk size line too long");
+                        }
+                        return HttpParseStatus::Incomplete;
+                    }
+                    std::size_t chunk = 0;
+                    int digits = 0;
+                    for(char const *q = p; q < lf; ++q, ++digits) {
+                        char c = *q;
+                        int d;
+                        if(c >= '0' && c <= '9') d = c - '0';
+                        else if(c >= 'a' && c <= 'f') d = c - 'a' + 10;
+                        else if(c >= 'A' && c <= 'F') d = c - 'A' + 10;
+                        else break;
+                        if(digits == 15) {
+                            return error("bad chunk size");
+                        }
+                        chunk = chunk * 16 + d;
+                    }
+                    if(digits == 0) {
+                        return error("bad chunk size");
+                    }
+                    consumed += lf + 1 - p;
+                    if(chunk == 0) {
+                        m_state = State::Trailer;
+                    } else {
+                        if(resp.m_body.size() + chunk > m_max_body_size) {
+                            return error("body too large");
+                        }
+                        m_remain = chunk;
+                        m_state = State::ChunkData;
+                    }
+                    break;
+                }
+                case State::ChunkDataEnd: {
+                    if(n == 0) {
+                        return HttpParseStatus::Incomplete;
+                    }
+                    if(p[0] == '\n') {
+                        consumed += 1;
+                    } else if(p[0] == '\r') {
+                        if(n == 1) {
+                            return HttpParseStatus::Incomplete;
+                        }
+                        if(p[1] != '\n') {
+                            return error("bad chunk");
+                        }
+                        consumed += 2;
+                    } else {
+                        return error("bad chunk");
+                    }
+                    m_state = State::ChunkSize;
+                    break;
+                }
+                case State::Trailer: {
+                    // trailer fields are ignored
+                    char const *lf = http_find_char(p, end, '\n');
+                    if(!lf) {
+                        if(n > k_max_line) {
+                            return error("trailer line too long");
+                        }
+                        return HttpParseStatus::Incomplete;
+                    }
+                    consumed += lf + 1 - p;
+                    if(lf == p || (lf == p + 1 && p[0] == '\r')) {
+                        m_state = State::Done;
+                    }
+                    break;
+                }
+                case State::UntilClose: {
+                    if(resp.m_body.size() + n > m_max_body_size) {
+                        return error("body too large");
+                    }
+                    resp.m_body.append(p, n);
+                    consumed += n;
+                    return HttpParseStatus::Incomplete;
+                }
+                case State::Done:
+                    m_state = State::Head;
+                    return HttpParseStatus::Complete;
+                }
+            }
+        }
+
+        HttpParseStatus parse(ConstBuffer buffer, HttpClientResponse &resp, std::size_t &consumed)
+        {
+            return parse((char const *)buffer.data(), buffer.size(), resp, consumed);
+        }
+
+        // the peer closed the connection
+        // Complete only if the body is delimited by the close
+        HttpParseStatus parse_eof()
+        {
+            if(m_state == State::UntilClose) {
+                m_state = State::Head;
+                return HttpParseStatus::Complete;
+            }
+            return error("connection closed before the response is complete");
+        }
+
+    private:
+        HttpParseStatus error(char const *what)
+        {
+            reset();
+            m_error = what;
+            return HttpParseStatus::Error;
+        }
+
+        static std::string_view line(char const *p, char const *lf)
+        {
+            if(lf > p && lf[-1] == '\r') {
+                --lf;
+            }
+            return std::string_view(p, lf - p);
+        }
+
+        // after the head is parsed
+        bool body_state(HttpClientResponse &resp)
+        {
+            if(m_head_request || resp.m_status == 204 || resp.m_status == 304 || resp.m_status == 101) {
+                m_state = State::Done;
+                if(resp.m_status == 101) {
+                    // the connection is not http any more
+                    resp.m_keep_alive = false;
+                }
+                return true;
+            }
+
+            auto te = resp.header("transfer-encoding");
+            if(!te.empty()) {
+                if(!http_has_token(te, "chunked")) {
+                    // delimited by close
+                    resp.m_keep_alive = false;
+                    m_state = State::UntilClose;
+                    return true;
+                }
+                m_state = State::ChunkSize;
+                return true;
+            }
+
+            auto cl = resp.header("content-length");
+            if(!cl.empty()) {
+                std::size_t n = 0;
+                if(cl.size() > 18) {
+                    error("bad content-length");
+                    return false;
+                }
+                for(char c : cl) {
+                    if(c < '0' || c > '9') {
+                        error("bad content-length");
+                        return false;
+                    }
+                    n = n * 10 + (c - '0');
+                }
+                if(n > m_max_body_size) {
+                    error("body too large");
+                    return false;
+                }
+                resp.m_body.reserve(n);
+                m_remain = n;
+                m_state = n ? State::Body : State::Done;
+                return true;
+            }
+
+            resp.m_keep_alive = false;
+            m_state = State::UntilClose;
+            return true;
+        }
+
+        static bool parse_head(char const *begin, char const *end, HttpClientResponse &resp)
+        {
+            // status line: HTTP/1.1 200 OK
+            char const *lf = http_find_char(begin, end, '\n');
+            std::string_view status_line = line(begin, lf);
+            if(status_line.size() < 12 || !status_line.starts_with("HTTP/1.") || status_line[8] != ' ') {
+                return false;
+            }
+            char minor = status_line[7];
+            if(minor != '0' && minor != '1') {
+                return false;
+            }
+            resp.m_version_minor = minor - '0';
+            int status = 0;
+            for(int i = 9; i < 12; ++i) {
+                char c = status_line[i];
+                if(c < '0' || c > '9') {
+                    return false;
+                }
+                status = status * 10 + (c - '0');
+            }
+            if(status_line.size() > 12 && status_line[12] != ' ') {
+                return false;
+            }
+            resp.m_status = status;
+            resp.m_reason = status_line.size() > 13 ? status_line.substr(13) : std::string_view();
+
+            bool close = false;
+            bool keep_alive = false;
+            for(char const *p = lf + 1; p < end; ) {
+                lf = http_find_char(p, end, '\n');
+                std::string_view header_line = line(p, lf);
+                p = lf + 1;
+                if(header_line.empty()) {
+                    break;
+                }
+                auto colon = header_line.find(':');
+                if(colon == 0 || colon == std::string_view::npos) {
+                    return false;
+                }
+                std::string_view name = header_line.substr(0, colon);
+                std::string_view value = http_trim(header_line.substr(colon + 1));
+                resp.m_headers.push_back({ std::string(name), std::string(value) });
+                if(http_iequals(name, "connection")) {
+                    close = close || http_has_token(value, "close");
+                    keep_alive = keep_alive || http_has_token(value, "keep-alive");
+                }
+            }
+
+            if(resp.m_version_minor == 1) {
+                resp.m_keep_alive = !close;
+            } else {
+                resp.m_keep_alive = keep_alive && !close;
+            }
+            return true;
+        }
+    };
+
+    struct HttpClientRequest
+    {
+        std::string m_method = "GET";
+        std::string m_host;
+        uint16_t m_port = 80;
+        std::string m_target = "/";
+        // extra header lines, "Name: value\r\n"
+        std::string m_headers;
+        std::string m_body;
+
+        void add_header(std::string_view name, std::string_view value)
+        {
+            m_headers.append(name);
+            m_headers.append(": ");
+            m_headers.append(value);
+            m_headers.append("\r\n");
+        }
+
+        // a request sent on a reused connection may be lost if the server closes the connection at the same time
+        // only idempotent requests are sent again
+        bool idempotent() const
+        {
+            return m_method == "GET" || m_method == "HEAD" || m_method == "PUT" ||
+                m_method == "DELETE" || m_method == "OPTIONS";
+        }
+
+        std::string build_head() const
+        {
+            std::string head;
+            head.reserve(64 + m_target.size() + m_host.size() + m_headers.size());
+            head.append(m_method);
+            head.append(" ");
+            head.append(m_target);
+            head.append(" HTTP/1.1\r\nHost: ");
+            head.append(m_host);
+            if(m_port != 80) {
+                head.append(":");
+                head.append(std::to_string(m_port));
+            }
+            head.append("\r\n");
+            if(m_body.size() || m_method == "POST" || m_method == "PUT") {
+                head.append("Content-Length: ");
+                head.append(std::to_string(m_body.size()));
+                head.append("\r\n");
+            }
+            head.append(m_headers);
+            head.append("\r\n");
+            return head;
+        }
+    };
+
+    // http://host[:port][/target]
+    inline bool http_parse_url(std::string_view url, HttpClientRequest &req)
+    {
+        if(!url.starts_with("http://")) {
+            return false;
+        }
+        url.remove_prefix(7);
+        auto slash = url.find('/');
+        std::string_view authority = url.substr(0, slash);
+        req.m_target = slash == std::string_view::npos ? "/" : std::string(url.substr(slash));
+        auto colon = authority.find(':');
+        req.m_port = 80;
+        if(colon != std::string_view::npos) {
+            std::string_view port = authority.substr(colon + 1);
+            unsigned n = 0;
+            if(port.empty() || port.size() > 5) {
+                return false;
+            }
+            for(char c : port) {
+                if(c < '0' || c > '9') {
+                    return false;
+                }
+                n = n * 10 + (c - '0');
+            }
+            if(n == 0 || n > 65535) {
+                return false;
+            }
+            req.m_port = (uint16_t)n;
+            authority = authority.substr(0, colon);
+        }
+        if(authority.empty()) {
+            return false;
+        }
+        req.m_host = authority;
+        return true;
+    }
+
+    struct HttpClientConfig
+    {
+        // idle + in use, for each host:port
+        int m_max_connections_per_host = 8;
+        int m_max_idle_per_host = 8;
+        // initial receive buffer of a connection, grows for large headers
+        std::size_t m_buffer_size = 16 * 1024;
+        std::size_t m_max_header_size = 64 * 1024;
+        std::size_t m_max_body_size = 64 * 1024 * 1024;
+        bool m_tcp_nodelay = true;
+        // resolve by the async DnsClient if set, otherwise by DnsResolver (getaddrinfo in a thread)
+        DnsClient *m_dns_client = nullptr;
+    };
+
+    struct HttpClientStats
+    {
+        uint64_t m_requests = 0;
+        // new connections
+        uint64_t m_connects = 0;
+        // requests sent on a pooled connection
+        uint64_t m_reuses = 0;
+        // requests sent again after a pooled connection is found closed
+        uint64_t m_retries = 0;
+        // requests waited for the per host limit
+        uint64_t m_waits = 0;
+    };
+
+    class HttpClient
+    {
+        // connection with its receive buffer
+        struct PooledConn
+        {
+            Connection m_conn;
+            std::vector<char> m_buffer;
+        };
+
+        struct Host
+        {
+            std::string m_name;
+            uint16_t m_port;
+            bool m_resolved = false;
+            Endpoint m_endpoint;
+            // most recently used at back
+            std::vector<PooledConn> m_idle;
+            // idle + in use + connecting
+            int m_open = 0;
+            // requests waiting for a connection
+            Event m_event;
+
+            Host(IoContext &ctx) : m_event(ctx)
+            {
+            }
+        };
+
+        IoContext *m_ctx;
+        HttpClientConfig m_config;
+        // Host is not movable, waiters point to its Event
+        std::unordered_map<std::string, std::unique_ptr<Host> > m_hosts;
+        HttpClientStats m_stats;
+
+    public:
+
+        HttpClient(IoContext &ctx, HttpClientConfig config = {})
+            : m_ctx(&ctx), m_config(config)
+        {
+        }
+
+        HttpClient(HttpClient &&) = delete;
+
+        // all requests should have been done
+        ~HttpClient() = default;
+
+        HttpClientStats stats() const
+        {
+            return m_stats;
+        }
+
+        // close all idle connections, e.g. after the servers are changed
+        void close_idle()
+        {
+            for(auto &kv : m_hosts) {
+                auto &host = *kv.second;
+                int freed = (int)host.m_idle.size();
+                host.m_open -= freed;
+                host.m_idle.clear();
+                // each closed connection makes room for one waiter
+                for(int i = 0; i < freed; ++i) {
+                    host.m_event.notify_one();
+                }
+            }
+        }
+
+        // socket errors and bad responses are thrown
+        Task<HttpClientResponse> request(HttpClientRequest req)
+        {
+            Host &host = this->host(req.m_host, req.m_port);
+            co_await resolve(host);
+
+            std::string head = req.build_head();
+            m_stats.m_requests += 1;
+
+            for(int attempt = 0; ; ++attempt) {
+                PooledConn conn;
+                // the other idle connections may be closed too, retry on a new one
+                bool reused = co_await acquire(host, conn, attempt == 0);
+
+                HttpClientResponse resp;
+                bool received = false;
+                bool reusable = false;
+                std::exception_ptr error;
+                try {
+                    reusable = co_await exchange(conn, req, head, resp, received);
+                } catch(...) {
+                    error = std::current_exception();
+                }
+                release(host, std::move(conn), reusable);
+
+                if(error) {
+                    if(reused && !received && attempt == 0 && req.idempotent()) {
+                        m_stats.m_retries += 1;
+                        continue;
+                    }
+                    std::rethrow_exception(error);
+                }
+                co_return resp;
+            }
+        }
+
+        Task<HttpClientResponse> get(std::string_view url)
+        {
+            HttpClientRequest req;
+            if(!http_parse_url(url, req)) {
+                throw_error(format("HttpClient: bad url %s", std::string(url).c_str()), EINVAL);
+            }
+            return request(std::move(req));
+        }
+
+    private:
+
+        Host &host(std::string const &name, uint16_t port)
+        {
+            auto &host = m_hosts[name + ":" + std::to_string(port)];
+            if(!host) {
+                host.reset(new Host(*m_ctx));
+                host->m_name = name;
+                host->m_port = port;
+            }
+            return *host;
+        }
+
+        Task<> resolve(Host &host)
+        {
+            if(host.m_resolved) {
+                co_return;
+            }
+
+            Address addr;
+            if(!parse_address(host.m_name.c_str(), addr)) {
+                if(m_config.m_dns_client) {
+                    auto result = co_await async_dns_lookup(*m_config.m_dns_client, host.m_name.c_str());
+                    if(!result.ok()) {
+                        throw_error(format("HttpClient: can't resolve %s, %s", host.m_name.c_str(),
+                            dns_errc_string(result.errc())), EHOSTUNREACH);
+                    }
+                    // A records first
+                    addr = result.address();
+                } else {
+                    auto result = co_await async_dns_resolve(*m_ctx, host.m_name.c_str());
+                    if(result.native_errc()) {
+                        throw_error(format("HttpClient: can't resolve %s", host.m_name.c_str()), EHOSTUNREACH);
+                    }
+                    addr = result.address();
+                }
+            }
+            host.m_endpoint = Endpoint(addr, host.m_port);
+            host.m_resolved = true;
+        }
+
+        // @return true if conn is from the pool
+        Task<bool> acquire(Host &host, PooledConn &conn, bool use_idle)
+        {
+            for(;;) {
+                if(!host.m_idle.empty()) {
+                    if(use_idle) {
+                        conn = std::move(host.m_idle.back());
+                        host.m_idle.pop_back();
+                        m_stats.m_reuses += 1;
+                        co_return true;
+                    }
+                    if(host.m_open == m_config.m_max_connections_per_host) {
+                        // close the least recently used one to make room
+                        host.m_idle.erase(host.m_idle.begin());
+                        host.m_open -= 1;
+                    }
+                }
+                if(host.m_open < m_config.m_max_connections_per_host) {
+                    break;
+                }
+                m_stats.m_waits += 1;
+                co_await host.m_event;
+            }
+
+            host.m_open += 1;
+            try {
+                conn.m_conn = co_await async_connect(*m_ctx,
+                    host.m_endpoint.address().m_address_type == AddressType::IpV6 ? Protocol::ip_v6() : Protocol::ip_v4(),
+                    host.m_endpoint);
+            } catch(...) {
+                host.m_open -= 1;
+                host.m_event.notify_one();
+                throw;
+            }
+            if(m_config.m_tcp_nodelay) {
+                conn.m_conn.set_tcp_no_delay();
+            }
+            conn.m_buffer.resize(m_config.m_buffer_size);
+            m_stats.m_connects += 1;
+            co_return false;
+        }
+
+        void release(Host &host, PooledConn conn, bool reusable)
+        {
+            if(reusable && (int)host.m_idle.size() < m_config.m_max_idle_per_host) {
+                host.m_idle.push_back(std::move(conn));
+            } else {
+                // closed when conn goes out of scope
+                host.m_open -= 1;
+            }
+            host.m_event.notify_one();
+        }
+
+        // send the request and read the response
+        // @return true if the connection can be used for the next request
+        Task<bool> exchange(PooledConn &conn, HttpClientRequest const &req, std::string const &head,
+            HttpClientResponse &resp, bool &received)
+        {
+            iovec iov[2] = {
+                { (void *)head.data(), head.size() },
+                { (void *)req.m_body.data(), req.m_body.size() },
+            };
+            if(!co_await http_send_all(conn.m_conn, iov, req.m_body.empty() ? 1 : 2)) {
+                throw_error("HttpClient: connection closed while sending", ECONNRESET);
+            }
+
+            HttpResponseParser parser;
+            parser.m_max_header_size = m_config.m_max_header_size;
+            parser.m_max_body_size = m_config.m_max_body_size;
+            parser.m_head_request = req.m_method == "HEAD";
+
+            auto &buffer = conn.m_buffer;
+            // unparsed bytes are in [begin, end)
+            std::size_t begin = 0;
+            std::size_t end = 0;
+            for(;;) {
+                if(begin == end) {
+                    begin = end = 0;
+                } else if(end == buffer.size()) {
+                    if(begin > 0) {
+                        memmove(buffer.data(), buffer.data() + begin, end - begin);
+                        end -= begin;
+                        begin = 0;
+                    } else {
+                        // a large header, the parser limits the size
+                        buffer.resize(buffer.size() * 2);
+                    }
+                }
+
+                std::size_t nread = co_await conn.m_conn.async_read(buffer.data() + end, buffer.size() - end);
+                HttpParseStatus status;
+                if(nread == 0) {
+                    status = parser.parse_eof();
+                    if(status == HttpParseStatus::Complete) {
+                        co_return false;
+                    }
+                } else {
+                    received = true;
+                    end += nread;
+                    std::size_t consumed;
+                    status = parser.parse(buffer.data() + begin, end - begin, resp, consumed);
+                    begin += consumed;
+                    if(status == HttpParseStatus::Complete) {
+                        // bytes after the response are unexpected, don't reuse the connection
+                        co_return resp.m_keep_alive && begin == end;
+                    }
+                }
+                if(status == HttpParseStatus::Error) {
+                    throw_error(format("HttpClient: bad response, %s", parser.m_error), EPROTO);
+                }
+            }
+        }
+    };
+
+} // namespace tinyasync
+
+#endif
@@ -210,6 +210,379 @@ namespace tinyasync
 
      // end __time_queue
 
+    // snapshot of the counters of IoCtx, see IoContext::stats()
+    struct IoCtxStats
+    {
+        // events returned by one epoll_wait: 0, 1, ..., the last bucket for more
+        static const int k_events_buckets = 8;
+        // duration of a loop turn (one task, or the callbacks of one epoll_wait)
+        // bucket i: [2^(i-1), 2^i) us, bucket 0: < 1us, the last bucket for more
+        static const int k_turn_buckets = 20;
+        // the run loop puts a probe into the run queue every this often
+        static constexpr std::chrono::milliseconds k_lag_probe_interval { 1 };
+
+        uint64_t m_tasks_executed = 0;
+        // part of m_tasks_executed, run from the LIFO slot
+        uint64_t m_lifo_tasks = 0;
+        uint64_t m_epoll_waits = 0;
+        // epoll_wait returned with any event
+        uint64_t m_epoll_wakeups = 0;
+        // woken by the wakeup eventfd only, no io event to handle
+        uint64_t m_spurious_wakeups = 0;
+        // io events (not counting the wakeup eventfd)
+        uint64_t m_io_events = 0;
+        uint64_t m_wakeup_a_thread = 0;
+        std::size_t m_task_queue_size = 0;
+        std::size_t m_thread_waiting = 0;
+        uint64_t m_events_per_wait[k_events_buckets] = {};
+        // m_turn_us, m_lag_us stay zero unless set_stats_enabled(true)
+        uint64_t m_turn_us[k_turn_buckets] = {};
+        // run loop lag: how long the probe waited in the run queue before it was run
+        // same buckets as m_turn_us
+        uint64_t m_lag_us[k_turn_buckets] = {};
+
+        double events_per_wait() const
+        {
+            return m_epoll_waits ? double(m_io_events) / m_epoll_waits : 0;
+        }
+
+        // upper bound of the bucket holding the p-th (0~1) loop turn, in us
+        uint64_t turn_percentile_us(double p) const
+        {
+            return percentile_us(m_turn_us, p);
+        }
+
+        // upper bound of the bucket holding the p-th (0~1) lag sample, in us
+        uint64_t lag_percentile_us(double p) const
+        {
+            return percentile_us(m_lag_us, p);
+        }
+
+        static uint64_t percentile_us(uint64_t const (&buckets)[k_turn_buckets], double p)
+        {
+            uint64_t total = 0;
+            for(auto n : buckets) {
+                total += n;
+            }
+            uint64_t target = (uint64_t)(p * total);
+            uint64_t acc = 0;
+            for(int i = 0; i < k_turn_buckets; ++i) {
+                acc += buckets[i];
+                if(acc > target) {
+                    return uint64_t(1) << i;
+                }
+            }
+            return uint64_t(1) << (k_turn_buckets - 1);
+        }
+    };
+
+    // 固定大小的接收 buffer, 每个 IoCtx 一个
+    // async_read_pooled 等数据到了才从这里拿 buffer, 空闲的连接不占 buffer
+    class BufferPool
+    {
+        struct FreeBuffer
+        {
+            FreeBuffer *m_next;
+        };
+
+        std::size_t m_buffer_size = 16 * 1024;
+        // 超过这么多的空闲 buffer 还给系统
+        std::size_t m_max_cached = 256;
+        FreeBuffer *m_free = nullptr;
+        std::size_t m_cached = 0;
+        std::size_t m_in_use = 0;
+        std::size_t m_peak_in_use = 0;
+        bool m_multiple_thread = false;
+        SysSpinLock m_lock;
+#ifndef TINYASYNC_NDEBUG
+        // 单线程的 pool 不加锁, 只能在一个线程里 alloc/free (IoBuf 不能跨线程释放)
+        std::atomic<std::thread::id> m_owner_thread {};
+#endif
+
+        void lock()
+        {
+            if(m_multiple_thread) {
+                m_lock.lock();
+            } else {
+                check_owner_thread();
+            }
+        }
+
+        void check_owner_thread()
+        {
+#ifndef TINYASYNC_NDEBUG
+            // the first thread that uses the pool owns it
+            std::thread::id owner {};
+            auto self = std::this_thread::get_id();
+            if(!m_owner_thread.compare_exchange_strong(owner, self, std::memory_order_relaxed)) {
+                TINYASYNC_ASSERT(owner == self && "buffer of a single thread IoContext used in another thread");
+            }
+#endif
+        }
+
+        void unlock()
+        {
+            if(m_multiple_thread) {
+                m_lock.unlock();
+            }
+        }
+
+        void release_cached()
+        {
+            while(m_free) {
+                auto next = m_free->m_next;
+                ::free(m_free);
+                m_free = next;
+            }
+            m_cached = 0;
+        }
+
+    public:
+        BufferPool() = default;
+        BufferPool(BufferPool const &) = delete;
+        BufferPool &operator=(BufferPool const &) = delete;
+
+        // buffers still in use (held by suspended coroutines) are leaked
+        // PooledBuffer must not outlive the IoContext
+        ~BufferPool()
+        {
+            release_cached();
+        }
+
+        // set by the IoCtx
+        void set_multiple_thread(bool multiple_thread)
+        {
+            m_multiple_thread = multiple_thread;
+        }
+
+        // call before any buffer is in use
+        // configuration, e.g. in the main thread before Runtime starts, not checked by the owner thread
+        void set_buffer_size(std::size_t size)
+        {
+            if(m_multiple_thread) {
+                m_lock.lock();
+            }
+            TINYASYNC_ASSERT(m_in_use == 0);
+            release_cached();
+            m_buffer_size = std::max(size, sizeof(FreeBuffer));
+            unlock();
+        }
+
+        void set_max_cached(std::size_t n)
+        {
+            m_max_cached = n;
+        }
+
+        std::size_t buffer_size() const
+        {
+            return m_buffer_size;
+        }
+
+        std::size_t in_use() const
+        {
+            return m_in_use;
+        }
+
+        std::size_t peak_in_use() const
+        {
+            return m_peak_in_use;
+        }
+
+        std::byte *alloc()
+        {
+            lock();
+            void *p = m_free;
+            if(p) {
+                m_free = m_free->m_next;
+                --m_cached;
+            } else {
+                p = ::malloc(m_buffer_size);
+                if(!p) {
+                    unlock();
+                    throw std::bad_alloc();
+                }
+            }
+            ++m_in_use;
+            m_peak_in_use = std::max(m_peak_in_use, m_in_use);
+            unlock();
+            return (std::byte *)p;
+        }
+
+        void free(std::byte *p)
+        {
+            lock();
+            --m_in_use;
+            if(m_cached < m_max_cached) {
+                auto node = (FreeBuffer *)p;
+                node->m_next = m_free;
+                m_free = node;
+                ++m_cached;
+                p = nullptr;
+            }
+            unlock();
+            if(p) {
+                ::free(p);
+            }
+        }
+    };
+
+    // 每个 IoCtx 一个, 给 ConnImpl 这种随连接创建销毁的小对象用
+    // 底下是 SlabPool, 多线程的 ctx 加锁
+    class ObjectSlab
+    {
+        SlabPool m_slab;
+        std::size_t m_in_use = 0;
+        bool m_multiple_thread = false;
+        SysSpinLock m_lock;
+
+        void lock()
+        {
+            if(m_multiple_thread) {
+                m_lock.lock();
+            }
+        }
+
+        void unlock()
+        {
+            if(m_multiple_thread) {
+                m_lock.unlock();
+            }
+        }
+
+    public:
+        ObjectSlab() = default;
+        ObjectSlab(ObjectSlab const &) = delete;
+        ObjectSlab &operator=(ObjectSlab const &) = delete;
+
+        // set by the IoCtx
+        void set_multiple_thread(bool multiple_thread)
+        {
+            m_multiple_thread = multiple_thread;
+        }
+
+        // slots of a size that is a multiple of 64 are cache line aligned
+        void *alloc(std::size_t size)
+        {
+            TINYASYNC_ASSERT(size <= SlabPool::k_max_size);
+            lock();
+            void *p;
+            try {
+                p = m_slab.alloc(size);
+            } catch(...) {
+                unlock();
+                throw;
+            }
+            ++m_in_use;
+            unlock();
+            return p;
+        }
+
+        void free(void *p, std::size_t size)
+        {
+            lock();
+            m_slab.free(p, size);
+            --m_in_use;
+            unlock();
+        }
+
+        std::size_t in_use() const
+        {
+            return m_in_use;
+        }
+    };
+
+    // ctx 自己的协程帧 resource
+    // 帧可能比 ctx 活得长 (例如 Task 对象在 ctx 析构之后才销毁), 所以 ctx 和每块没归还的内存各持有一个引用
+    // 最后一个引用释放时才删除 upstream
+    // 一直不销毁的帧 (例如 abort 时还挂起的协程) 让它一直留着, 和 new/delete 时一样是泄漏
+    class CtxMemoryResource : public std::pmr::memory_resource
+    {
+        std::unique_ptr<std::pmr::memory_resource> m_upstream;
+        std::atomic<std::size_t> m_ref_cnt { 1 };
+        bool m_multiple_thread;
+
+        ~CtxMemoryResource() = default;
+
+        void add_ref()
+        {
+            if(m_multiple_thread) {
+                m_ref_cnt.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                m_ref_cnt.store(m_ref_cnt.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+
+    public:
+        CtxMemoryResource(std::unique_ptr<std::pmr::memory_resource> upstream, bool multiple_thread)
+            : m_upstream(std::move(upstream)), m_multiple_thread(multiple_thread)
+        {
+        }
+
+        CtxMemoryResource(CtxMemoryResource const &) = delete;
+        CtxMemoryResource &operator=(CtxMemoryResource const &) = delete;
+
+        // allocations not returned yet
+        std::size_t live() const
+        {
+            return m_ref_cnt.load(std::memory_order_relaxed) - 1;
+        }
+
+        void release()
+        {
+            std::size_t n;
+            if(m_multiple_thread) {
+                n = m_ref_cnt.fetch_sub(1, std::memory_order_acq_rel);
+            } else {
+                n = m_ref_cnt.load(std::memory_order_relaxed);
+                m_ref_cnt.store(n - 1, std::memory_order_relaxed);
+            }
+            if(n == 1) {
+                delete this;
+            }
+        }
+
+        struct Releaser
+        {
+            void operator()(CtxMemoryResource *resource) const
+            {
+                resource->release();
+            }
+        };
+
+    protected:
+        void *do_allocate(size_t bytes, size_t alignment) override
+        {
+            void *p = m_upstream->allocate(bytes, alignment);
+            add_ref();
+            return p;
+        }
+
+        void do_deallocate(void *p, size_t bytes, size_t alignment) override
+        {
+            m_upstream->deallocate(p, bytes, alignment);
+            release();
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+
+    class IoCtxBase;
+
+    // state of the run loop on current thread
+    struct RunLoopLocal
+    {
+        // the ctx whose run() is executing on this thread
+        IoCtxBase *m_ctx = nullptr;
+        // LIFO slot: the most recently posted task runs next on this thread
+        // good for cache locality of request/response ping-pong
+        PostTask *m_lifo_slot = nullptr;
+    };
+
+    inline thread_local RunLoopLocal t_run_loop;
+
     class IoCtxBase
     {
     protected:
@@ -226,14 +599,34 @@ namespace tinyasync
         
     public:
         virtual void run() = 0;
+        // if called from the thread running this ctx, the task is put into LIFO slot
+        // and it will run right after current task (resume inline)
+        // otherwise (or LIFO slot disabled), same as defer_task
         virtual void post_task(PostTask *) = 0;
+        // always append the task to the end of the run queue
+        // post_task/defer_task of a single thread ctx are not locked, only call them in its own thread
+        virtual void defer_task(PostTask *) = 0;
+        // any thread, e.g. a worker of BlockingExecutor
+        // locked, and wakes up the ctx if it is waiting in epoll_wait
+        virtual void remote_post_task(PostTask *) = 0;
         virtual void request_abort() = 0;
         virtual void post_time_out(timeNode * ) = 0; // 加入时间检查点
+        virtual IoCtxStats stats() = 0;
         virtual ~IoCtxBase() {}
 
         // avoid using virtual functions ...
         NativeHandle m_epoll_handle = NULL_HANDLE;
+        bool m_multiple_thread = false;
         std::pmr::memory_resource *m_memory_resource;
+        // ctx 自己的 resource, 最后一个帧释放后才析构
+        std::unique_ptr<CtxMemoryResource, CtxMemoryResource::Releaser> m_owned_memory_resource;
+        // async_read_pooled 用的接收 buffer
+        BufferPool m_buffer_pool;
+        // ConnImpl 从这里申请, 连接不能比 ctx 活得长
+        ObjectSlab m_conn_slab;
+        bool m_lifo_slot_enabled = true;
+        // 计时统计 (m_turn_us, m_lag_us), 每个 task 多两次 steady_clock::now(), 默认关
+        bool m_stats_enabled = false;
 
         NativeHandle event_poll_handle()
         {
@@ -265,6 +658,33 @@ namespace tinyasync
             auto *ctx = m_ctx.get();
             ctx->post_task(task);
         }
+
+        void defer_task(PostTask *task)
+        {
+            auto *ctx = m_ctx.get();
+            ctx->defer_task(task);
+        }
+
+        void remote_post_task(PostTask *task)
+        {
+            auto *ctx = m_ctx.get();
+            ctx->remote_post_task(task);
+        }
+
+        // call before run()
+        void set_lifo_slot_enabled(bool enabled)
+        {
+            auto *ctx = m_ctx.get();
+            ctx->m_lifo_slot_enabled = enabled;
+        }
+
+        // call before run()
+        // turn/lag histograms in stats(), the plain counters are always on
+        void set_stats_enabled(bool enabled)
+        {
+            auto *ctx = m_ctx.get();
+            ctx->m_stats_enabled = enabled;
+        }
         
         void request_abort()
         {
@@ -272,17 +692,59 @@ namespace tinyasync
             ctx->request_abort();
         }
 
+        // can be called from any thread
+        IoCtxStats stats()
+        {
+            auto *ctx = m_ctx.get();
+            return ctx->stats();
+        }
+
         std::pmr::memory_resource *get_memory_resource_for_task()
         {
             auto *ctx = m_ctx.get();
             return ctx->m_memory_resource;
         }
 
+        // 第一个参数是 IoContext & 的协程, 协程帧从这个 ctx 的 resource 申请
+        // 帧可以比 ctx 活得长: ctx 自己的 resource 等最后一个帧释放后才析构
+        // set_memory_resource(memory_resource *) 的 resource 则要比所有的帧活得长
+        std::pmr::polymorphic_allocator<std::byte> get_allocator_for_task()
+        {
+            auto *ctx = m_ctx.get();
+            return std::pmr::polymorphic_allocator<std::byte>(ctx->m_memory_resource);
+        }
+
+        // replace the resource of the ctx, e.g. an arena (monotonic_buffer_resource)
+        // or FixPoolResource when all frames have the same size
+        // call before any coroutine is created with this ctx
+        // a multiple thread ctx frees frames in any of its threads, the resource must be thread safe
+        void set_memory_resource(std::unique_ptr<std::pmr::memory_resource> resource)
+        {
+            auto *ctx = m_ctx.get();
+            ctx->m_owned_memory_resource.reset(new CtxMemoryResource(std::move(resource), ctx->m_multiple_thread));
+            ctx->m_memory_resource = ctx->m_owned_memory_resource.get();
+        }
+
+        // not owned, must outlive the ctx and all the frames from it
+        void set_memory_resource(std::pmr::memory_resource *resource)
+        {
+            auto *ctx = m_ctx.get();
+            ctx->m_memory_resource = resource;
+            ctx->m_owned_memory_resource.reset();
+        }
+
         NativeHandle event_poll_handle()
         {
             auto *ctx = m_ctx.get();
             return ctx->m_epoll_handle;
         }
+
+        // receive buffers of async_read_pooled, set_buffer_size() before use
+        BufferPool &buffer_pool()
+        {
+            auto *ctx = m_ctx.get();
+            return ctx->m_buffer_pool;
+        }
     };
 
 
@@ -291,8 +753,9 @@ namespace tinyasync
     {
         using spinlock_type = NaitveLock;
         static constexpr bool multiple_thread = false;
-        static std::pmr::memory_resource *get_memory_resource() {
-            return std::pmr::get_default_resource();
+        // 只有一个线程, 每个 ctx 一个不加锁的内存池
+        static std::unique_ptr<std::pmr::memory_resource> make_memory_resource() {
+            return std::make_unique<PoolResource>();
         }
     };
 
@@ -300,8 +763,9 @@ namespace tinyasync
     {
         using spinlock_type = DefaultSpinLock;
         static constexpr bool multiple_thread = true;
-        static std::pmr::memory_resource *get_memory_resource() {
-            return get_default_resource();
+        // 协程帧可能在 ctx 的任何一个线程释放, 用全局的 resource
+        static std::unique_ptr<std::pmr::memory_resource> make_memory_resource() {
+            return nullptr;
         }
     };
 
@@ -315,21 +779,93 @@ namespace tinyasync
 
         typename CtxTrait::spinlock_type m_que_lock;
 
+        // 单线程 ctx 的 m_task_queue 不加锁, 别的线程 post 的任务先放在这里, 再用 eventfd 叫醒
+        // run loop 看到 m_remote_pending 就整个搬到 m_task_queue
+        SysSpinLock m_remote_lock;
+        Queue m_remote_queue;
+        std::atomic<bool> m_remote_pending = false;
+        NativeHandle m_remote_handle = NULL_HANDLE;
+        // epoll data of m_remote_handle, below CallbackGuard like the wakeup handle
+        static constexpr std::uintptr_t k_remote_event = 2;
+
         std::size_t m_thread_waiting = 0;
-        std::size_t m_task_queue_size = 0;
+        // changed by the run loop (under m_que_lock if multiple thread), stats() reads it from any thread
+        std::atomic<std::size_t> m_task_queue_size = 0;
         Queue m_task_queue;
+        // not a real task, only measures how long a task waits in m_task_queue
+        PostTask m_lag_probe;
+        bool m_lag_probe_queued = false;
+        std::chrono::steady_clock::time_point m_lag_probe_time;
 
         //最多30秒的等待,超时
         timeQueue<10 * 1000> m_time_queue;
         bool m_abort_requested = false;
         static const bool k_multiple_thread = CtxTrait::multiple_thread;
+        // max number of tasks run from LIFO slot in a row
+        // then the LIFO task goes to the end of queue, so that the queue is not starved
+        static const int k_lifo_budget = 16;
+
+        // lock free, relaxed
+        // all threads of the ctx write them, stats() reads them
+        struct Counters
+        {
+            std::atomic<uint64_t> m_tasks_executed = 0;
+            std::atomic<uint64_t> m_lifo_tasks = 0;
+            std::atomic<uint64_t> m_epoll_waits = 0;
+            std::atomic<uint64_t> m_epoll_wakeups = 0;
+            std::atomic<uint64_t> m_spurious_wakeups = 0;
+            std::atomic<uint64_t> m_io_events = 0;
+            std::atomic<uint64_t> m_wakeup_a_thread = 0;
+            std::atomic<uint64_t> m_events_per_wait[IoCtxStats::k_events_buckets] = {};
+            std::atomic<uint64_t> m_turn_us[IoCtxStats::k_turn_buckets] = {};
+            std::atomic<uint64_t> m_lag_us[IoCtxStats::k_turn_buckets] = {};
+        };
+        alignas(64) Counters m_counters;
+
+        static void count(std::atomic<uint64_t> &counter, uint64_t n = 1)
+        {
+            if constexpr (k_multiple_thread) {
+                counter.fetch_add(n, std::memory_order_relaxed);
+            } else {
+                // only one thread, no need for a locked instruction
+                counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+            }
+        }
+
+        // the queue size is only changed by one thread at a time
+        void add_task_queue_size(std::size_t n)
+        {
+            m_task_queue_size.store(m_task_queue_size.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        void sub_task_queue_size(std::size_t n)
+        {
+            m_task_queue_size.store(m_task_queue_size.load(std::memory_order_relaxed) - n, std::memory_order_relaxed);
+        }
+
+        void count_us(std::atomic<uint64_t> (&buckets)[IoCtxStats::k_turn_buckets], std::chrono::steady_clock::time_point begin)
+        {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+            int bucket = us <= 0 ? 0 : std::min<int>(std::bit_width((uint64_t)us), IoCtxStats::k_turn_buckets - 1);
+            count(buckets[bucket]);
+        }
+
+        void count_turn(std::chrono::steady_clock::time_point begin)
+        {
+            count_us(m_counters.m_turn_us, begin);
+        }
 
         void wakeup_a_thread();
+        void invoke_task(PostTask *task);
+        void drain_remote_tasks();
     public:
         IoCtx();
         void post_task(PostTask *callback) override;
+        void defer_task(PostTask *callback) override;
+        void remote_post_task(PostTask *callback) override;
         void post_time_out(timeNode *) override;
         void request_abort() override;
+        IoCtxStats stats() override;
         void run() override;
         ~IoCtx() override;
     };
@@ -357,7 +893,13 @@ namespace tinyasync
         TINYASYNC_GUARD("IoContext.IoContext(): ");
         TINYASYNC_LOG("Ctx at %p", this);
 
-        m_memory_resource = T::get_memory_resource();
+        m_multiple_thread = k_multiple_thread;
+        if(auto resource = T::make_memory_resource()) {
+            m_owned_memory_resource.reset(new CtxMemoryResource(std::move(resource), k_multiple_thread));
+        }
+        m_buffer_pool.set_multiple_thread(k_multiple_thread);
+        m_conn_slab.set_multiple_thread(k_multiple_thread);
+        m_memory_resource = m_owned_memory_resource ? m_owned_memory_resource.get() : get_default_resource();
 #ifdef _WIN32
 
         WSADATA wsaData;
@@ -401,6 +943,20 @@ namespace tinyasync
             throw_errno(err);
         }
 
+        if constexpr (!k_multiple_thread)
+        {
+            fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (fd == -1)
+            {
+                throw_errno("IoContext().IoContext(): can't create eventfd");
+            }
+            m_remote_handle = fd;
+            evt.data.ptr = (void *)k_remote_event;
+            evt.events = EPOLLIN;
+            if(epoll_ctl(m_epoll_handle, EPOLL_CTL_ADD, m_remote_handle, &evt) < 0) {
+                throw_errno(format("can't set remote event %s (epoll %s)", handle_c_str(m_remote_handle), handle_c_str(m_epoll_handle)));
+            }
+        }
 
 #endif
     }
@@ -418,6 +974,12 @@ namespace tinyasync
             ::epoll_ctl(m_epoll_handle, EPOLL_CTL_DEL, m_wakeup_handle, NULL);
             close_handle(m_wakeup_handle);
         }
+        // tasks still in m_remote_queue are dropped, like the ones in m_task_queue
+        if (m_remote_handle)
+        {
+            ::epoll_ctl(m_epoll_handle, EPOLL_CTL_DEL, m_remote_handle, NULL);
+            close_handle(m_remote_handle);
+        }
         close_handle(m_epoll_handle);
 #endif
     }
@@ -425,6 +987,8 @@ namespace tinyasync
     template <class T>
     void IoCtx<T>::wakeup_a_thread()
     {
+        TINYASYNC_TRACE_EVENT(WakeupThread, m_wakeup_handle, this);
+        count(m_counters.m_wakeup_a_thread);
         epoll_event evt;
         evt.data.ptr = (void *)1;
         evt.events = EPOLLIN | EPOLLONESHOT;
@@ -440,14 +1004,32 @@ namespace tinyasync
 
     template <class T>
     void IoCtx<T>::post_task(PostTask *task)
+    {
+        TINYASYNC_TRACE_EVENT(PostTask, -1, task);
+        auto &local = t_run_loop;
+        if(local.m_ctx == this && m_lifo_slot_enabled) {
+            // the displaced task (if any) goes to run queue
+            auto prev = local.m_lifo_slot;
+            local.m_lifo_slot = task;
+            if(!prev) {
+                return;
+            }
+            task = prev;
+        }
+        defer_task(task);
+    }
+
+    template <class T>
+    void IoCtx<T>::defer_task(PostTask *task)
     {
 
         TINYASYNC_GUARD("post_task(): ");
+        TINYASYNC_TRACE_EVENT(DeferTask, -1, task);
         if constexpr (k_multiple_thread)
         {
             m_que_lock.lock();
             m_task_queue.push(get_node(task));
-            m_task_queue_size += 1;
+            add_task_queue_size(1);
             auto thread_wating = m_thread_waiting;
             m_que_lock.unlock();
 
@@ -462,9 +1044,84 @@ namespace tinyasync
         else
         {
             m_task_queue.push(get_node(task));
+            add_task_queue_size(1);
         }
     }
 
+    template <class T>
+    void IoCtx<T>::remote_post_task(PostTask *task)
+    {
+        TINYASYNC_TRACE_EVENT(DeferTask, -1, task);
+        if constexpr (k_multiple_thread)
+        {
+            // locked, and a waiting thread is woken up
+            defer_task(task);
+        }
+        else
+        {
+            m_remote_lock.lock();
+            m_remote_queue.push(get_node(task));
+            bool signal = !m_remote_pending.load(std::memory_order_relaxed);
+            m_remote_pending.store(true, std::memory_order_relaxed);
+            m_remote_lock.unlock();
+            if (signal)
+            {
+                uint64_t one = 1;
+                if (::write(m_remote_handle, &one, sizeof(one)) < 0 && errno != EAGAIN)
+                {
+                    throw_errno("IoContext: can't write remote eventfd");
+                }
+            }
+        }
+    }
+
+    // the ctx's thread
+    template <class T>
+    void IoCtx<T>::drain_remote_tasks()
+    {
+        std::size_t n = 0;
+        m_remote_lock.lock();
+        m_remote_pending.store(false, std::memory_order_relaxed);
+        while (auto node = m_remote_queue.pop())
+        {
+            m_task_queue.push(node);
+            ++n;
+        }
+        m_remote_lock.unlock();
+        add_task_queue_size(n);
+    }
+
+    template <class T>
+    IoCtxStats IoCtx<T>::stats()
+    {
+        IoCtxStats stats;
+        auto &c = m_counters;
+        auto relaxed = std::memory_order_relaxed;
+        stats.m_tasks_executed = c.m_tasks_executed.load(relaxed);
+        stats.m_lifo_tasks = c.m_lifo_tasks.load(relaxed);
+        stats.m_epoll_waits = c.m_epoll_waits.load(relaxed);
+        stats.m_epoll_wakeups = c.m_epoll_wakeups.load(relaxed);
+        stats.m_spurious_wakeups = c.m_spurious_wakeups.load(relaxed);
+        stats.m_io_events = c.m_io_events.load(relaxed);
+        stats.m_wakeup_a_thread = c.m_wakeup_a_thread.load(relaxed);
+        for(int i = 0; i < IoCtxStats::k_events_buckets; ++i) {
+            stats.m_events_per_wait[i] = c.m_events_per_wait[i].load(relaxed);
+        }
+        for(int i = 0; i < IoCtxStats::k_turn_buckets; ++i) {
+            stats.m_turn_us[i] = c.m_turn_us[i].load(relaxed);
+            stats.m_lag_us[i] = c.m_lag_us[i].load(relaxed);
+        }
+
+        stats.m_task_queue_size = m_task_queue_size.load(relaxed);
+        if constexpr (k_multiple_thread) {
+            // a single thread ctx has no waiting thread to count
+            m_que_lock.lock();
+            stats.m_thread_waiting = m_thread_waiting;
+            m_que_lock.unlock();
+        }
+        return stats;
+    }
+
     template <class T>
     void IoCtx<T>::post_time_out(timeNode * tnode)
     {
@@ -487,6 +1144,32 @@ namespace tinyasync
         }
     }
 
+    template <class T>
+    void IoCtx<T>::invoke_task(PostTask *task)
+    {
+        TINYASYNC_TRACE_EVENT(TaskBegin, -1, task);
+        std::chrono::steady_clock::time_point begin;
+        if (m_stats_enabled)
+        {
+            begin = std::chrono::steady_clock::now();
+        }
+        count(m_counters.m_tasks_executed);
+        try
+        {
+            auto callback = task->get_callback();
+            callback(task);
+        }
+        catch (...)
+        {
+            terminate_with_unhandled_exception();
+        }
+        if (m_stats_enabled)
+        {
+            count_turn(begin);
+        }
+        TINYASYNC_TRACE_EVENT(TaskEnd, -1, task);
+    }
+
     template <class T>
     void IoCtx<T>::run()
     {
@@ -496,15 +1179,81 @@ namespace tinyasync
         TINYASYNC_GUARD("IoContex::run(): ");
         int const maxevents = 5;
 
+        // bind this thread to the ctx, so that post_task can use the LIFO slot
+        struct RunLoopGuard
+        {
+            RunLoopLocal m_saved;
+            IoCtxBase *m_ctx;
+            RunLoopGuard(IoCtxBase *ctx) : m_saved(t_run_loop), m_ctx(ctx)
+            {
+                t_run_loop.m_ctx = ctx;
+                t_run_loop.m_lifo_slot = nullptr;
+            }
+            ~RunLoopGuard()
+            {
+                // abort: the task in LIFO slot goes back to run queue, not lost
+                if(auto task = t_run_loop.m_lifo_slot) {
+                    t_run_loop.m_lifo_slot = nullptr;
+                    m_ctx->defer_task(task);
+                }
+                t_run_loop = m_saved;
+            }
+        } run_loop_guard(this);
+
+        auto &local = t_run_loop;
+        int lifo_budget = k_lifo_budget;
+
         for (;;)
         {
-            printf("running... \n");
+            // fast path: resume the most recently readied task
+            // no lock, no queue
+            PostTask *lifo_task = local.m_lifo_slot;
+            if (lifo_task)
+            {
+                local.m_lifo_slot = nullptr;
+                if (lifo_budget > 0)
+                {
+                    --lifo_budget;
+                    count(m_counters.m_lifo_tasks);
+                    invoke_task(lifo_task);
+                    continue;
+                }
+            }
+            lifo_budget = k_lifo_budget;
+
+            if constexpr (!k_multiple_thread)
+            {
+                // relaxed: a missed flag is seen next turn, or the eventfd wakes up epoll_wait
+                if (m_remote_pending.load(std::memory_order_relaxed))
+                {
+                    drain_remote_tasks();
+                }
+            }
 
             if constexpr (k_multiple_thread)
             {
                 m_que_lock.lock();
             }
 
+            if (lifo_task)
+            {
+                // out of budget, give the tasks in queue a chance
+                m_task_queue.push(get_node(lifo_task));
+                add_task_queue_size(1);
+            }
+
+            if (m_stats_enabled && !m_lag_probe_queued)
+            {
+                auto steady_now = std::chrono::steady_clock::now();
+                if (steady_now - m_lag_probe_time >= IoCtxStats::k_lag_probe_interval)
+                {
+                    // not counted in m_task_queue_size
+                    m_task_queue.push(get_node(&m_lag_probe));
+                    m_lag_probe_queued = true;
+                    m_lag_probe_time = steady_now;
+                }
+            }
+
             // 检查时间队列
             auto time_node = m_time_queue.front();
             auto now_time = Clock::now();
@@ -526,7 +1275,9 @@ std::chrono::duration_cast<std::chrono::seconds>( (now_time - time_node->get_exp
                 m_time_queue.pop();
 
                 //创建Task
-                post_task(time_node->m_post_task);
+                // we are holding the queue lock, push directly
+                m_task_queue.push(get_node(time_node->m_post_task));
+                add_task_queue_size(1);
                 time_node->remove_self();
             }
 
@@ -548,21 +1299,28 @@ std::chrono::duration_cast<std::chrono::seconds>( (now_time - time_node->get_exp
             if (node)
             {
                 // we have task to do
+                PostTask *task = from_node_to_post_task(node);
+                auto probe_time = m_lag_probe_time;
+                if (task == &m_lag_probe)
+                {
+                    m_lag_probe_queued = false;
+                }
+                else
+                {
+                    sub_task_queue_size(1);
+                }
                 if constexpr (k_multiple_thread)
                 {
-                    m_task_queue_size -= 1;
                     m_que_lock.unlock();
                 }
 
-                PostTask *task = from_node_to_post_task(node);
-                try
+                if (task == &m_lag_probe)
                 {
-                    auto callback = task->get_callback();
-                    callback(task);
+                    count_us(m_counters.m_lag_us, probe_time);
                 }
-                catch (...)
+                else
                 {
-                    terminate_with_unhandled_exception();
+                    invoke_task(task);
                 }
             }
             else
@@ -600,14 +1358,17 @@ std::chrono::duration_cast<std::chrono::seconds>( (now_time - time_node->get_exp
                 int const timeout = 1000; // 1000ms
 
                 TINYASYNC_LOG("waiting event ... handle = %s", handle_c_str(epfd));
+                TINYASYNC_TRACE_EVENT(EpollWaitBegin, epfd, this);
                 int nfds = epoll_wait(epfd, (epoll_event *)events, maxevents, timeout);
+                TINYASYNC_TRACE_EVENT(EpollWaitEnd, nfds, this);
+                count(m_counters.m_epoll_waits);
                 TINYASYNC_LOG("epoll wakeup handle = %s", handle_c_str(epfd));
 
                 if constexpr (k_multiple_thread)
                 {
                     m_que_lock.lock();
                     m_thread_waiting -= 1;
-                    const auto task_queue_size = m_task_queue_size;
+                    const std::size_t task_queue_size = m_task_queue_size.load(std::memory_order_relaxed);
                     m_que_lock.unlock();
                     TINYASYNC_LOG("task_queue_size %d\n", task_queue_size);
 
@@ -675,6 +1436,12 @@ std::chrono::duration_cast<std::chrono::seconds>( (now_time - time_node->get_exp
                     }
                 }
 
+                std::chrono::steady_clock::time_point turn_begin;
+                if (m_stats_enabled)
+                {
+                    turn_begin = std::chrono::steady_clock::now();
+                }
+                int io_events = 0;
                 for (auto i = 0; i < nfds; ++i)
                 {
                     auto &evt = events[i];
@@ -684,6 +1451,8 @@ std::chrono::duration_cast<std::chrono::seconds>( (now_time - time_node->get_exp
                     if (callback >= CallbackGuard)
                     {
                         TINYASYNC_LOG("invoke callback");
+                        TINYASYNC_TRACE_EVENT(IoEvent, -1, callback);
+                        ++io_events;
                         try
                         {
                             callback->callback(evt);
@@ -693,7 +1462,36 @@ std::chrono::duration_cast<std::chrono::seconds>( (now_time - time_node->get_exp
                             terminate_with_unhandled_exception();
                         }
                     }
+                    else if constexpr (!k_multiple_thread)
+                    {
+                        if (callback == (Callback *)k_remote_event)
+                        {
+                            uint64_t n;
+                            while (::read(m_remote_handle, &n, sizeof(n)) > 0)
+                            {
+                            }
+                            drain_remote_tasks();
+                        }
+                    }
+                }
+
+                if (nfds > 0)
+                {
+                    count(m_counters.m_epoll_wakeups);
+                    if (io_events == 0)
+                    {
+                        count(m_counters.m_spurious_wakeups);
+                    }
+                    else
+                    {
+                        count(m_counters.m_io_events, io_events);
+                        if (m_stats_enabled)
+                        {
+                            count_turn(turn_begin);
+                        }
+                    }
                 }
+                count(m_counters.m_events_per_wait[std::min(io_events, IoCtxStats::k_events_buckets - 1)]);
 #endif
 
             } // if(node) ... else
@@ -4,9 +4,14 @@
 #include <cstddef>   // std::size_t, std::byte
 #include <bit>       // std::countx_zeros
 #include <vector>
+#include <array>
 #include <stdlib.h>
 #include <memory>
+#include <stdexcept>
 #include <assert.h>
+#ifdef __unix__
+#include <sys/mman.h>
+#endif
 
 #if defined(__clang__)
 
@@ -223,17 +228,143 @@ namespace tinyasync
 
     // inline std::map<void *, bool> m_allocated;
 
+    struct PoolConfig
+    {
+        // PoolImpl 每次向系统申请的大小, 32KB - 256KB
+        std::size_t m_chunk_size = 32 * 1024;
+        // size + align 不小于这个的是大对象, 16KB - m_chunk_size/2
+        // LargeObjectCache 最小的一级是 16KB, 更小的大对象也要占 16KB
+        std::size_t m_large_threshold = 16 * 1024;
+        // 大对象释放后缓存起来的总字节数上限, 超过就还给系统
+        std::size_t m_large_cache_bytes = 64 * 1024 * 1024;
+    };
+
+    // 大对象: 按尺寸分级, 每级一个空闲链表, 释放的先缓存起来给同一级的下一次申请用
+    // unix 上用 mmap, 还给系统时整块 munmap, 不会在堆里留下碎片
+    struct LargeObjectCache
+    {
+        static constexpr std::size_t k_page_size = 4096;
+        // 更大的直接 mmap/munmap, 不缓存
+        static constexpr std::size_t k_max_cached_size = 32 * 1024 * 1024;
+        // 16KB .. 32MB
+        static constexpr std::size_t k_num_classes = 45;
+
+        PoolNode *m_free[k_num_classes] = {};
+        std::size_t m_cached_bytes = 0;
+        std::size_t m_max_cached_bytes;
+
+        explicit LargeObjectCache(std::size_t max_cached_bytes) : m_max_cached_bytes(max_cached_bytes)
+        {
+        }
+
+        LargeObjectCache(LargeObjectCache const &) = delete;
+        LargeObjectCache &operator=(LargeObjectCache const &) = delete;
+
+        ~LargeObjectCache()
+        {
+            for(std::size_t cls = 0; cls < k_num_classes; ++cls) {
+                for(auto node = m_free[cls]; node;) {
+                    auto next = node->m_next;
+                    unmap(node, class_size(cls));
+                    node = next;
+                }
+            }
+        }
+
+        // 16KB 起, 每个 2 的幂分 4 级, 都是页的整数倍
+        static std::size_t size_class(std::size_t size);
+        static std::size_t class_size(std::size_t cls);
+
+        static std::size_t round_to_page(std::size_t size)
+        {
+            return (size + k_page_size - 1) & ~(k_page_size - 1);
+        }
+
+        static void *map(std::size_t size)
+        {
+#ifdef __unix__
+            void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(p == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            return p;
+#else
+            void *p = ::malloc(size);
+            if(!p) {
+                throw std::bad_alloc();
+            }
+            return p;
+#endif
+        }
+
+        static void unmap(void *p, std::size_t size)
+        {
+#ifdef __unix__
+            ::munmap(p, size);
+#else
+            ::free(p);
+#endif
+        }
+
+        void *alloc(std::size_t size, std::size_t align)
+        {
+            if(align > k_page_size) {
+                return ::aligned_alloc(align, (size + align - 1) & ~(align - 1));
+            }
+            if(size > k_max_cached_size) {
+                return map(round_to_page(size));
+            }
+            auto cls = size_class(size);
+            if(auto node = m_free[cls]) {
+                m_free[cls] = node->m_next;
+                m_cached_bytes -= class_size(cls);
+                return node;
+            }
+            return map(class_size(cls));
+        }
+
+        void free(void *p, std::size_t size, std::size_t align)
+        {
+            if(align > k_page_size) {
+                ::free(p);
+                return;
+            }
+            if(size > k_max_cached_size) {
+                unmap(p, round_to_page(size));
+                return;
+            }
+            auto cls = size_class(size);
+            auto csize = class_size(cls);
+            if(m_cached_bytes + csize > m_max_cached_bytes) {
+                unmap(p, csize);
+                return;
+            }
+            auto node = (PoolNode *)p;
+            node->m_next = m_free[cls];
+            m_free[cls] = node;
+            m_cached_bytes += csize;
+        }
+    };
+
     struct PoolImpl
     {
+        // 默认 chunk 的 order, 32KB
         static const int k_max_order = 48;
+        // 默认大对象的 order, 16KB
         static const int k_malloc_order = 44;
+        // chunk 最大 256KB, 受 64 位的 m_free_flags 限制
+        static const int k_max_chunk_order = 60;
 
         uint64_t m_free_flags; // m_free对应位置是否有free的Node
-        FreeNode m_free[k_max_order + 1];
+        FreeNode m_free[64];
 
         FreeNode m_chuncks;
 
-        PoolImpl()
+        int m_chunk_order;
+        std::size_t m_large_threshold;
+        LargeObjectCache m_large;
+
+        PoolImpl(PoolConfig const &config = {}) : m_large(config.m_large_cache_bytes)
         {
             for (auto &m : m_free) //初始化每个FreeNode
             {
@@ -242,14 +373,29 @@ namespace tinyasync
             }
             m_free_flags = 0;
             m_chuncks.init(); // 指向自己的freeNode
-        }
 
-        ~PoolImpl() //析构
-        {            
-            for(auto i = 0; i < k_max_order; ++i) {
-                assert(m_free[i].m_next == &m_free[i]);
+            if(config.m_chunk_size < block_size(k_max_order) || config.m_chunk_size > block_size(k_max_chunk_order)) {
+                throw std::invalid_argument("PoolConfig: chunk size must be in [32KB, 256KB]");
             }
+            if(config.m_large_threshold < LargeObjectCache::class_size(0)) {
+                throw std::invalid_argument("PoolConfig: large threshold must be at least 16KB");
+            }
+            if(config.m_large_threshold > config.m_chunk_size / 2) {
+                throw std::invalid_argument("PoolConfig: large threshold must not exceed chunk size / 2");
+            }
+            // 向下取整, 保证 chunk 不超过 config 的大小
+            m_chunk_order = (int)block_order(config.m_chunk_size);
+            if(block_size(m_chunk_order) > config.m_chunk_size) {
+                --m_chunk_order;
+            }
+            m_large_threshold = config.m_large_threshold;
+        }
 
+        ~PoolImpl() //析构
+        {
+            // 没有归还的 chunk 也一起释放
+            // 大对象是单独 mmap 的, 只有 LargeObjectCache 里缓存着的会 unmap, 还在用的不会
+            // IoContext 的 resource 等所有的帧都归还了才析构 (见 CtxMemoryResource)
             auto c = m_chuncks.m_next;
             for(;c != &m_chuncks;) {
                 auto next = c->m_next;
@@ -259,13 +405,13 @@ namespace tinyasync
             }
         }
 
-        static constexpr uint16_t s1(std::size_t s) {
+        static constexpr uint32_t s1(std::size_t s) {
             return s + s/4;
         }
-        static constexpr uint16_t s2(std::size_t s) {
+        static constexpr uint32_t s2(std::size_t s) {
             return s + s/2;
         }
-        static constexpr uint16_t s3(std::size_t s) {
+        static constexpr uint32_t s3(std::size_t s) {
             return s + 3*s/4;
         }
 
@@ -309,7 +455,7 @@ namespace tinyasync
 
         static std::size_t block_size(std::size_t block_order)
         {
-            static constexpr uint16_t table[] = {
+            static constexpr uint32_t table[] = {
                                     8, s1(8), s2(8), s3(8),
                                     16, s1(16), s2(16), s3(16),
                                     32, s1(32), s2(32), s3(32),
@@ -322,7 +468,10 @@ namespace tinyasync
                                     1<<12, s1(1<<12), s2(1<<12), s3(1<<12),
                                     1<<13, s1(1<<13), s2(1<<13), s3(1<<13),
                                     1<<14, s1(1<<14), s2(1<<14), s3(1<<14),
-                                    1<<15, 
+                                    1<<15, s1(1<<15), s2(1<<15), s3(1<<15),
+                                    1<<16, s1(1<<16), s2(1<<16), s3(1<<16),
+                                    1<<17, s1(1<<17), s2(1<<17), s3(1<<17),
+                                    1<<18, s1(1<<18), s2(1<<18), s3(1<<18),
                                     };
             return table[block_order];
         }
@@ -420,9 +569,9 @@ namespace tinyasync
             const std::size_t block_size_ = size_ + align; 
             //要申请的大小2,考虑到最大的align的可能
             
-            if (block_size_ >= PoolImpl::block_size(k_malloc_order)) //大于最大的尺寸16384byte
+            if (block_size_ >= pool->m_large_threshold) //大对象, 默认 16384byte
             {
-                return ::aligned_alloc(align, size); // 由系统申请
+                return pool->m_large.alloc(size, align);
             }
 
 
@@ -445,6 +594,13 @@ namespace tinyasync
             //  把m_free_flags idx位置右边的都清空
             idx = ffs64(pool->m_free_flags & ~((uint64_t(1) << idx_) - 1)); 
 
+            // block_order 是向上取整的, m_free[idx_] 里的 block 可能比 block_size_ 小
+            // 这时候去更大的 order 里找
+            if (idx == idx_ && PoolBlock::from_free_node(pool->m_free[idx].m_next)->size() < block_size_)
+            {
+                idx = ffs64(pool->m_free_flags & ~((uint64_t(2) << idx_) - 1));
+            }
+
             if (idx != 64) // 找能用的最小的地方
             {
                 FreeNode &node = pool->m_free[idx];
@@ -458,7 +614,7 @@ namespace tinyasync
             }
             else // idx右边有64个0,m_free全部为空,申请新的内存
             {
-                auto size = PoolImpl::block_size(k_max_order); // 直接申请最大的内存块,32kb
+                auto size = PoolImpl::block_size(pool->m_chunk_order); // 直接申请最大的内存块,默认32kb
                 auto head = (PoolBlock *)::malloc(size + 2*sizeof(PoolBlock));// 系统申请内存,sizeof(PoolBlock)=24
                 // auto tail = (PoolBlock *)((char*)head + size); // ?? 为什么是+size
                 auto tail = (PoolBlock *)((char*)head + size + sizeof(PoolBlock) ); // 改成末尾,by rainboy
@@ -466,12 +622,12 @@ namespace tinyasync
                 // auto tail = block + size;
 
                 block->m_prev_size = PoolBlock::encode_size(0, 0, false); // 前一个 : 大小0, order,0,free=false
-                block->m_size = PoolBlock::encode_size(size, k_max_order, true); //当前,大小,size,order,free=true
+                block->m_size = PoolBlock::encode_size(size, pool->m_chunk_order, true); //当前,大小,size,order,free=true
 
                 tail->m_size = PoolBlock::encode_size(0, 0, false);
 
                 pool->m_chuncks.push(&head->m_free_node); //记录申请的内存,free的时候用
-                pool->add_free_block(block, k_max_order);
+                pool->add_free_block(block, pool->m_chunk_order);
             }
 
             //break_: 将一个大块的内存,拆成小块
@@ -528,9 +684,9 @@ namespace tinyasync
             std::size_t size_ = std::max(size, 2*sizeof(void*)); // 内存至少16tybe
             align = std::max(2*sizeof(uint32_t), align); // 对齐至少是8
             const std::size_t block_size_ = size_ + align;// 推算出块的大小 size_ + align
-            if (block_size_ >= block_size(k_malloc_order)) // 大于指定的最大内存
+            if (block_size_ >= pool->m_large_threshold) // 大对象
             {
-                ::free(p); // 由系统释放
+                pool->m_large.free(p, size, align);
                 return;
             }
             
@@ -588,6 +744,207 @@ namespace tinyasync
         }
     };
 
+    // slab 的一个页面, 页头在页面开始的地方, 页面按 k_page_size 对齐
+    // 槽位是否空闲记在页头的位图里, 申请时不用碰槽位本身的内存, 并且总是用地址最低的空闲槽位
+    struct SlabPage
+    {
+        static constexpr std::size_t k_page_size = 64 * 1024;
+        // 最小的槽位是 32 字节
+        static constexpr std::size_t k_max_words = k_page_size / 32 / 64;
+
+        FreeNode m_avail_node; // 在 SlabPool::m_avail[class] 里, 页面满了就摘掉
+        FreeNode m_page_node;  // 在 SlabPool::m_pages 里, 析构时释放
+        uint32_t m_used;
+        uint32_t m_capacity;
+        uint32_t m_slot_size;
+        // m_bits[0, m_hint) 都是 0
+        uint32_t m_hint;
+        // 1 表示空闲
+        uint64_t m_bits[k_max_words];
+
+        static constexpr std::size_t k_header_size = (sizeof(FreeNode) * 2 + sizeof(uint32_t) * 4 + sizeof(uint64_t) * k_max_words + 63) & ~std::size_t(63);
+
+        char *slots()
+        {
+            return (char *)this + k_header_size;
+        }
+
+        void init(uint32_t slot_size)
+        {
+            m_used = 0;
+            m_slot_size = slot_size;
+            m_capacity = (uint32_t)((k_page_size - k_header_size) / slot_size);
+            m_hint = 0;
+            std::size_t words = (m_capacity + 63) / 64;
+            for(std::size_t i = 0; i < k_max_words; ++i) {
+                m_bits[i] = i < words ? ~uint64_t(0) : 0;
+            }
+            if(m_capacity % 64) {
+                m_bits[words - 1] = (uint64_t(1) << (m_capacity % 64)) - 1;
+            }
+        }
+
+        // the page must have a free slot
+        void *alloc()
+        {
+            auto w = m_hint;
+            while(!m_bits[w]) {
+                ++w;
+            }
+            m_hint = w;
+            auto bit = std::countr_zero(m_bits[w]);
+            m_bits[w] &= m_bits[w] - 1;
+            ++m_used;
+            return slots() + (w * 64 + bit) * m_slot_size;
+        }
+
+        void free(void *p)
+        {
+            auto idx = (uint32_t)(((char *)p - slots()) / m_slot_size);
+            auto w = idx / 64;
+            assert(!(m_bits[w] & (uint64_t(1) << (idx % 64))));
+            m_bits[w] |= uint64_t(1) << (idx % 64);
+            if(w < m_hint) {
+                m_hint = w;
+            }
+            --m_used;
+        }
+
+        static SlabPage *from_avail_node(FreeNode *node)
+        {
+            return (SlabPage *)((char *)node - offsetof(SlabPage, m_avail_node));
+        }
+
+        static SlabPage *from_page_node(FreeNode *node)
+        {
+            return (SlabPage *)((char *)node - offsetof(SlabPage, m_page_node));
+        }
+    };
+    static_assert(sizeof(SlabPage) <= SlabPage::k_header_size);
+
+    // 小对象的 slab, 放在 PoolImpl 前面
+    // 64-512 字节的协程帧和 awaiter 最多, 走这里不用查 m_free_flags, 不用拆分 block, 释放时也不用合并
+    // 每个尺寸一个页面链表, 只处理对齐不超过 max_align_t 的请求
+    struct SlabPool
+    {
+        static constexpr std::size_t k_page_size = SlabPage::k_page_size;
+        static constexpr std::size_t k_max_size = 512;
+        static constexpr std::size_t k_num_classes = 9;
+        // 都是 16 的倍数, 槽位自然按 max_align_t 对齐
+        static constexpr uint16_t k_class_size[k_num_classes] = { 32, 48, 64, 96, 128, 192, 256, 384, 512 };
+
+        // (size + 15) / 16 -> class
+        static constexpr auto k_class_table = []() {
+            std::array<uint8_t, k_max_size / 16 + 1> table = {};
+            std::size_t cls = 0;
+            for(std::size_t i = 0; i < table.size(); ++i) {
+                while(k_class_size[cls] < i * 16) {
+                    ++cls;
+                }
+                table[i] = (uint8_t)cls;
+            }
+            return table;
+        }();
+
+        FreeNode m_avail[k_num_classes];
+        FreeNode m_pages;
+
+        SlabPool()
+        {
+            for(auto &avail : m_avail) {
+                avail.init();
+            }
+            m_pages.init();
+        }
+
+        SlabPool(SlabPool const &) = delete;
+        SlabPool &operator=(SlabPool const &) = delete;
+
+        ~SlabPool()
+        {
+            for(auto node = m_pages.m_next; node != &m_pages;) {
+                auto next = node->m_next;
+                ::free(SlabPage::from_page_node(node));
+                node = next;
+            }
+        }
+
+        static bool fits(std::size_t size, std::size_t align)
+        {
+            return size <= k_max_size && align <= alignof(std::max_align_t);
+        }
+
+        static std::size_t size_class(std::size_t size)
+        {
+            return k_class_table[(size + 15) / 16];
+        }
+
+        static SlabPage *page_of(void *p)
+        {
+            return (SlabPage *)((std::uintptr_t)p & ~(k_page_size - 1));
+        }
+
+        SlabPage *new_page(std::size_t cls)
+        {
+            auto page = (SlabPage *)::aligned_alloc(k_page_size, k_page_size);
+            if(!page) {
+                throw std::bad_alloc();
+            }
+            page->init(k_class_size[cls]);
+            m_pages.push(&page->m_page_node);
+            m_avail[cls].push(&page->m_avail_node);
+            return page;
+        }
+
+        void *alloc(std::size_t size)
+        {
+            auto cls = size_class(size);
+            FreeNode &avail = m_avail[cls];
+            SlabPage *page;
+            if(avail.m_next != &avail) {
+                page = SlabPage::from_avail_node(avail.m_next);
+            } else {
+                page = new_page(cls);
+            }
+
+            void *p = page->alloc();
+            if(page->m_used == page->m_capacity) {
+                page->m_avail_node.remove_self();
+            }
+            return p;
+        }
+
+        void free(void *p, std::size_t size)
+        {
+            auto page = page_of(p);
+            bool full = page->m_used == page->m_capacity;
+            page->free(p);
+
+            FreeNode &avail = m_avail[size_class(size)];
+            if(full) {
+                // 重新可用的页面放在最前面, 先用它
+                avail.push(&page->m_avail_node);
+            } else if(page->m_used == 0 && avail.m_next != avail.m_prev) {
+                // 空页面, 同尺寸还有别的可用页面时还给系统, 否则留着避免反复申请释放
+                page->m_avail_node.remove_self();
+                page->m_page_node.remove_self();
+                ::free(page);
+            }
+        }
+    };
+
+    inline std::size_t LargeObjectCache::size_class(std::size_t size)
+    {
+        // 以 2KB 为单位就是 PoolImpl 的 order, 16KB 是第 0 级
+        std::size_t units = std::max<std::size_t>((size + 2047) / 2048, 8);
+        return PoolImpl::block_order(units);
+    }
+
+    inline std::size_t LargeObjectCache::class_size(std::size_t cls)
+    {
+        return PoolImpl::block_size(cls) * 2048;
+    }
+
     // 给StackfulPool构造用
     struct StackfulPoolArg {
         char *m_base;
@@ -750,24 +1107,36 @@ namespace tinyasync
     };
 
     // 基于表的内存池
+    // 不超过 512 字节的走 SlabPool, 其它的走 PoolImpl
     class PoolResource : public std::pmr::memory_resource
     {
+        SlabPool m_slab;
         PoolImpl m_impl;
     public:
 
         PoolResource() = default;
+        PoolResource(PoolConfig const &config) : m_impl(config)
+        {
+        }
         PoolResource(PoolResource&&) = delete;
         PoolResource &operator=(PoolResource&&) = delete;
 
         virtual void *
         do_allocate(size_t __bytes, size_t __alignment) override
         {
+            if(SlabPool::fits(__bytes, __alignment)) {
+                return m_slab.alloc(__bytes);
+            }
             return PoolImpl::alloc(&m_impl, __bytes, __alignment);
         }
 
         virtual void
         do_deallocate(void *__p, size_t __bytes, size_t __alignment) override
         {
+            if(SlabPool::fits(__bytes, __alignment)) {
+                m_slab.free(__p, __bytes);
+                return;
+            }
             PoolImpl::free(&m_impl, __p, __bytes, __alignment);
         }
 
@@ -277,17 +277,26 @@ namespace tinyasync
 
         static void on_callback(PostTask *);
 
+        // symmetric transfer
+        // mutex acquired: transfer back to the suspended coroutine
+        // enqueued: return to resumer
         template<class Promise>
-        auto await_suspend(std::coroutine_handle<Promise> suspended_coroutine)
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> suspended_coroutine)
         {
             auto suspended_coroutine_base = suspended_coroutine.promise().coroutine_handle_base();
-            return await_suspend(suspended_coroutine_base);
+            if(lock_or_enqueue(suspended_coroutine_base)) {
+                return std::noop_coroutine();
+            }
+            return suspended_coroutine;
         }
 
         MutexLockAwaiter(Mutex &mutex, IoCtxBase &ctx);
         // 返回 false 直接挂起协程
         bool await_ready() noexcept;
-        bool await_suspend(std::coroutine_handle<TaskPromiseBase> suspend_coroutine);
+        // return true if enqueued (coroutine should keep suspended)
+        // return false if mutex acquired
+        // used by callbacks which hold a suspended coroutine
+        bool lock_or_enqueue(std::coroutine_handle<TaskPromiseBase> suspend_coroutine);
         void await_resume();
     };
 
@@ -318,7 +327,7 @@ namespace tinyasync
     }
 
     //返回值
-    inline bool MutexLockAwaiter::await_suspend(std::coroutine_handle<TaskPromiseBase> suspend_coroutine)
+    inline bool MutexLockAwaiter::lock_or_enqueue(std::coroutine_handle<TaskPromiseBase> suspend_coroutine)
     {
         m_suspended_coroutine = suspend_coroutine;
         auto mutex = m_mutex;
@@ -458,7 +467,7 @@ namespace tinyasync
         void on_callback(IoEvent &evt)
         {
             TINYASYNC_GUARD("WaitCallback:on_callback(): ");
-            auto suspend = m_mutex_lock_awaiter.await_suspend(m_suspended_coroutine);
+            auto suspend = m_mutex_lock_awaiter.lock_or_enqueue(m_suspended_coroutine);
             if (!suspend)
             {
                 TINYASYNC_LOG("locked");                
@@ -630,6 +639,7 @@ namespace tinyasync
             return false;
         }
 
+        // always suspend, Event::on_notify resumes us from the run loop
         template <class Promise>
         void await_suspend(std::coroutine_handle<Promise> h)
         {
@@ -797,7 +807,7 @@ namespace tinyasync
 
         for(;node; node = node->m_next) {
             CondvAwaiter<Condv> *awaiter = CondvAwaiter<Condv>::from_node(node);
-            if(!awaiter->m_mutex_lock_awaiter.await_suspend(awaiter->m_resume_coroutine)) {
+            if(!awaiter->m_mutex_lock_awaiter.lock_or_enqueue(awaiter->m_resume_coroutine)) {
                 TINYASYNC_RESUME(awaiter->m_resume_coroutine);
             }
         }
@@ -0,0 +1,350 @@
+#ifndef TINYASYNC_RUNTIME_H
+#define TINYASYNC_RUNTIME_H
+
+#include <thread>
+#include <vector>
+#include <string>
+#include <exception>
+#include <sched.h>
+
+namespace tinyasync
+{
+
+    struct RuntimeConfig
+    {
+        // 0: 每个可用的 cpu (或物理核) 一个
+        int m_threads = 0;
+        // 线程绑定到自己的 cpu 上
+        bool m_pin_threads = true;
+        // 每个物理核只用一个超线程
+        bool m_skip_hyperthreads = false;
+    };
+
+    // cpus this process may run on, in order
+    inline std::vector<int> available_cpus(bool skip_hyperthreads = false)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(::sched_getaffinity(0, sizeof(set), &set) < 0) {
+            throw_errno("can't get cpu affinity");
+        }
+        std::vector<int> cpus;
+        for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if(!CPU_ISSET(cpu, &set)) {
+                continue;
+            }
+            if(skip_hyperthreads) {
+                // "0,4" or "0-1", the first one is the representative of the core
+                auto path = format("/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+                if(FILE *f = fopen(path.c_str(), "r")) {
+                    int first = cpu;
+                    int n = fscanf(f, "%d", &first);
+                    fclose(f);
+                    if(n == 1 && first != cpu) {
+                        continue;
+                    }
+                }
+            }
+            cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    class Runtime;
+
+    // Runtime::post() 的任务, 跑完删除自己
+    // 登记在核的 RuntimeTaskList 上, 没跑的 (例如 abort 时还在队列里) 由 Runtime 删除
+    struct RuntimeFuncTaskBase : PostTask
+    {
+        RuntimeFuncTaskBase *m_prev = nullptr;
+        RuntimeFuncTaskBase *m_next = nullptr;
+        void (*m_drop)(RuntimeFuncTaskBase *);
+    };
+
+    // any thread
+    class RuntimeTaskList
+    {
+        SysSpinLock m_lock;
+        RuntimeFuncTaskBase m_head;
+
+    public:
+        RuntimeTaskList()
+        {
+            m_head.m_prev = &m_head;
+            m_head.m_next = &m_head;
+        }
+
+        RuntimeTaskList(RuntimeTaskList &&) = delete;
+
+        // the tasks not run yet
+        ~RuntimeTaskList()
+        {
+            for(auto task = m_head.m_next; task != &m_head;) {
+                auto next = task->m_next;
+                task->m_drop(task);
+                task = next;
+            }
+        }
+
+        void link(RuntimeFuncTaskBase *task)
+        {
+            m_lock.lock();
+            task->m_prev = m_head.m_prev;
+            task->m_next = &m_head;
+            m_head.m_prev->m_next = task;
+            m_head.m_prev = task;
+            m_lock.unlock();
+        }
+
+        void unlink(RuntimeFuncTaskBase *task)
+        {
+            m_lock.lock();
+            task->m_prev->m_next = task->m_next;
+            task->m_next->m_prev = task->m_prev;
+            m_lock.unlock();
+        }
+    };
+
+    template<class F>
+    struct RuntimeFuncTask : RuntimeFuncTaskBase
+    {
+        RuntimeTaskList *m_list;
+        F m_func;
+
+        RuntimeFuncTask(RuntimeTaskList *list, F func) : m_list(list), m_func(std::move(func))
+        {
+            set_callback(invoke);
+            m_drop = drop;
+        }
+
+        static void invoke(PostTask *task)
+        {
+            auto self = static_cast<RuntimeFuncTask *>(task);
+            self->m_list->unlink(self);
+            std::unique_ptr<RuntimeFuncTask> guard(self);
+            self->m_func();
+        }
+
+        // never run
+        static void drop(RuntimeFuncTaskBase *task)
+        {
+            delete static_cast<RuntimeFuncTask *>(task);
+        }
+    };
+
+    // thread-per-core: 每个核一个单线程 IoContext 和一个线程, 核之间不共享状态
+    // 连接用 acceptor() 在每个核上各监听一次同一个端口 (SO_REUSEPORT), 由内核分给各个核
+    // 核之间通信用 post()/spawn_on(), 不要直接碰别的核的 IoContext 和它上面的对象
+    // 别的线程来的任务走 IoContext::remote_post_task (加锁, eventfd 叫醒那个核)
+    //
+    //     Runtime rt;
+    //     for(int core = 0; core < rt.size(); ++core)
+    //         rt.spawn_on(core, [&rt, core](IoContext &ctx) { return listen(ctx, rt.acceptor(core, protocol, endpoint)); });
+    //     rt.run();
+    class Runtime
+    {
+        struct Core
+        {
+            IoContext m_ctx { std::false_type{} };
+            // destroyed before m_ctx
+            RuntimeTaskList m_func_tasks;
+            int m_cpu = -1;
+            std::thread m_thread;
+            std::exception_ptr m_exception;
+        };
+
+        std::vector<std::unique_ptr<Core>> m_cores;
+        RuntimeConfig m_config;
+        bool m_started = false;
+
+        // the core's thread
+        void run_core(Core &core)
+        {
+            try {
+                // before run(), so that memory touched by the ctx is allocated on its own cpu
+                if(m_config.m_pin_threads) {
+                    pin(core);
+                }
+                core.m_ctx.run();
+            } catch(...) {
+                core.m_exception = std::current_exception();
+                // otherwise the other cores keep running and join() never returns
+                for(auto &other : m_cores) {
+                    if(other.get() != &core) {
+                        auto ctx = &other->m_ctx;
+                        post_func(*other, [ctx]() { ctx->request_abort(); });
+                    }
+                }
+            }
+        }
+
+        // the core deletes the task if it never runs
+        template<class F>
+        void post_func(Core &c, F f)
+        {
+            auto task = new RuntimeFuncTask<F>(&c.m_func_tasks, std::move(f));
+            c.m_func_tasks.link(task);
+            post_task(c, task);
+        }
+
+        void post_task(Core &c, PostTask *task)
+        {
+            if(t_run_loop.m_ctx == c.m_ctx.get_io_ctx_base()) {
+                c.m_ctx.post_task(task);
+            } else {
+                c.m_ctx.remote_post_task(task);
+            }
+        }
+
+        // pin the calling thread
+        void pin(Core &core)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(core.m_cpu, &set);
+            int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if(err) {
+                throw_error(format("can't pin thread to cpu %d", core.m_cpu), err);
+            }
+        }
+
+    public:
+        Runtime(RuntimeConfig const &config = {}) : m_config(config)
+        {
+            auto cpus = available_cpus(config.m_skip_hyperthreads);
+            if(cpus.empty()) {
+                throw_error("Runtime: no cpu available", 0);
+            }
+            int n = config.m_threads > 0 ? config.m_threads : (int)cpus.size();
+            for(int i = 0; i < n; ++i) {
+                auto core = std::make_unique<Core>();
+                // more threads than cpus: wrap around
+                core->m_cpu = cpus[i % cpus.size()];
+                m_cores.push_back(std::move(core));
+            }
+        }
+
+        Runtime(Runtime &&) = delete;
+
+        // still running (e.g. start() without join()): abort and wait
+        ~Runtime()
+        {
+            bool running = false;
+            for(auto &core : m_cores) {
+                running = running || core->m_thread.joinable();
+            }
+            if(running) {
+                request_abort();
+                for(auto &core : m_cores) {
+                    if(core->m_thread.joinable()) {
+                        core->m_thread.join();
+                    }
+                }
+            }
+        }
+
+        int size() const
+        {
+            return (int)m_cores.size();
+        }
+
+        IoContext &context(int core)
+        {
+            return m_cores[core]->m_ctx;
+        }
+
+        int cpu(int core) const
+        {
+            return m_cores[core]->m_cpu;
+        }
+
+        // index of the core running on this thread, -1 if none
+        int current_core() const
+        {
+            auto ctx = t_run_loop.m_ctx;
+            for(int i = 0; i < size(); ++i) {
+                if(m_cores[i]->m_ctx.get_io_ctx_base() == ctx) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        // SO_REUSEPORT 的 Acceptor, 每个核调用一次
+        Acceptor acceptor(int core, Protocol protocol, Endpoint endpoint)
+        {
+            return Acceptor(context(core), protocol, endpoint, true);
+        }
+
+        // any thread, before or after start()
+        // on the core's own thread it is the same as ctx.post_task()
+        void post_task(int core, PostTask *task)
+        {
+            post_task(*m_cores[core], task);
+        }
+
+        // f() runs on the core's thread
+        template<class F>
+        void post(int core, F f)
+        {
+            post_func(*m_cores[core], std::move(f));
+        }
+
+        // co_spawn(f(ctx)) on the core's thread
+        // the coroutine is created there, so that its frame comes from that ctx's pool
+        template<class F>
+        void spawn_on(int core, F f)
+        {
+            auto &ctx = context(core);
+            post(core, [&ctx, f = std::move(f)]() mutable {
+                co_spawn(f(ctx));
+            });
+        }
+
+        // start one thread per core
+        void start()
+        {
+            TINYASYNC_ASSERT(!m_started);
+            m_started = true;
+            for(auto &core : m_cores) {
+                auto c = core.get();
+                c->m_thread = std::thread([this, c]() { run_core(*c); });
+            }
+        }
+
+        // wait for all cores to finish, rethrows the first exception of them
+        void join()
+        {
+            std::exception_ptr exception;
+            for(auto &core : m_cores) {
+                if(core->m_thread.joinable()) {
+                    core->m_thread.join();
+                }
+                if(core->m_exception && !exception) {
+                    exception = core->m_exception;
+                }
+            }
+            if(exception) {
+                std::rethrow_exception(exception);
+            }
+        }
+
+        void run()
+        {
+            start();
+            join();
+        }
+
+        // any thread
+        void request_abort()
+        {
+            for(int i = 0; i < size(); ++i) {
+                auto ctx = &context(i);
+                post(i, [ctx]() { ctx->request_abort(); });
+            }
+        }
+    };
+
+} // namespace tinyasync
+
+#endif
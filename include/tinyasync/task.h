@@ -38,6 +38,15 @@ namespace tinyasync {
         using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<std::max_align_t>;
         using allocator_traits = typename std::allocator_traits<Alloc>::template rebind_traits<std::max_align_t>;
 
+#ifdef TINYASYNC_CORO_PROFILE
+        // the profile entry is put after the allocator
+        inline static std::size_t profile_offset(std::size_t allocator_end)
+        {
+            auto constexpr align = alignof(CoroProfileEntry*);
+            return (allocator_end + align - 1u) & ~(align - 1u);
+        }
+#endif
+
         inline static void * do_alloc(std::size_t size, allocator_type &alloc)
         {
             // put allocator at the end of the frame       
@@ -46,6 +55,9 @@ namespace tinyasync {
             auto allocator_offset = (size  + allocator_align - 1u) & ~(allocator_align - 1u);
 
             auto allocate_size = allocator_offset + allocator_size;
+#ifdef TINYASYNC_CORO_PROFILE
+            allocate_size = profile_offset(allocate_size) + sizeof(CoroProfileEntry*);
+#endif
             auto num = (allocate_size + sizeof(std::max_align_t) - 1)/sizeof(std::max_align_t);
 
             auto ptr = alloc.allocate(num);
@@ -78,6 +90,12 @@ namespace tinyasync {
         {
             //auto ptr = alloc_0(size, std::forward<Args>(args)...);
             auto ptr = alloc_0(size, args...);
+#ifdef TINYASYNC_CORO_PROFILE
+            auto constexpr source = std::is_same_v<Alloc, std::allocator<std::byte> > ?
+                CoroAllocSource::GlobalNew : CoroAllocSource::TaskAllocator;
+            auto allocator_end = ((size + alignof(allocator_type) - 1u) & ~(alignof(allocator_type) - 1u)) + sizeof(allocator_type);
+            *(CoroProfileEntry**)((char*)ptr + profile_offset(allocator_end)) = coro_profile_on_alloc(size, source, args...);
+#endif
             return ptr;
         }
 
@@ -88,6 +106,10 @@ namespace tinyasync {
             auto allocator_offset = (size  + allocator_align - 1u) & ~(allocator_align - 1u);
 
             auto allocate_size = allocator_offset + allocator_size;
+#ifdef TINYASYNC_CORO_PROFILE
+            coro_profile_on_free(*(CoroProfileEntry**)((char*)ptr + profile_offset(allocate_size)), size);
+            allocate_size = profile_offset(allocate_size) + sizeof(CoroProfileEntry*);
+#endif
             auto num = (allocate_size + sizeof(std::max_align_t) - 1)/sizeof(std::max_align_t);
 
             using value_type = typename allocator_traits::value_type;
@@ -227,6 +249,9 @@ namespace tinyasync {
         // resumer to destruct exception
         ExceptionPtrWrapper m_unhandled_exception;
         std::coroutine_handle<void> m_continuation;
+#ifdef TINYASYNC_CORO_PROFILE
+        CoroProfileFrame m_profile;
+#endif
 
         std::coroutine_handle<TaskPromiseBase> coroutine_handle_base() noexcept
         {
@@ -237,10 +262,33 @@ namespace tinyasync {
         TaskPromiseBase(TaskPromiseBase&& r) = delete;
         TaskPromiseBase(TaskPromiseBase const& r) = delete;
 
+#ifdef TINYASYNC_CORO_PROFILE
+        struct InitialAwaiter : std::suspend_always
+        {
+            CoroProfileFrame *m_profile;
+            void await_resume() const noexcept
+            {
+                m_profile->on_run();
+            }
+        };
+
+        InitialAwaiter initial_suspend()
+        {
+            return { {}, &m_profile };
+        }
+
+        // every co_await in Task is timed
+        template<class Awaitable>
+        CoroProfileAwaiter<Awaitable> await_transform(Awaitable &&awaitable)
+        {
+            return { &m_profile, std::forward<Awaitable>(awaitable) };
+        }
+#else
         std::suspend_always initial_suspend()
         {
             return { };
         }
+#endif
 
         struct FinalAwaiter : std::suspend_always
         {
@@ -248,6 +296,9 @@ namespace tinyasync {
             std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) const noexcept
             {
                 auto &promise = h.promise();
+#ifdef TINYASYNC_CORO_PROFILE
+                promise.m_profile.on_suspend(true);
+#endif
                 auto continuum = promise.m_continuation;
                 return continuum;
             }
@@ -388,8 +439,12 @@ namespace tinyasync {
                 return false;
             }
 
+            // symmetric transfer: the sub coroutine runs on our stack frame
+            // and transfers back by FinalAwaiter, stack depth doesn't grow with co_await depth
+            // g++ 只有开了 -foptimize-sibling-calls (-O2 默认开) 才把它编成尾调用
+            // -O0/-O1 要自己加这个选项, 否则很深的 co_await 链会爆栈
             template<class Promise>
-            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> awaiting_coro)
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> awaiting_coro) noexcept
             {
                 auto sub_coroutine = m_h;
                 sub_coroutine.promise().m_continuation = awaiting_coro;
@@ -437,8 +492,10 @@ namespace tinyasync {
                 return m_sub_coroutine.done();
             }
 
+            // the sub coroutine is running somewhere else
+            // its FinalAwaiter will transfer to us
             template<class Promise>
-            void await_suspend(std::coroutine_handle<Promise> awaiting_coro)
+            void await_suspend(std::coroutine_handle<Promise> awaiting_coro) noexcept
             {
                 auto sub_coroutine = m_sub_coroutine;
                 sub_coroutine.promise().m_continuation = awaiting_coro;
@@ -536,9 +593,13 @@ namespace tinyasync {
         }
     }
 
+    // called from callbacks (epoll events, post tasks) only
+    // the native stack is flat here, awaiters inside coroutines use symmetric transfer instead
     inline void resume_coroutine_callback(std::coroutine_handle<TaskPromiseBase> coroutine)
     {
+        TINYASYNC_TRACE_EVENT(ResumeBegin, -1, coroutine.address());
         coroutine.resume();
+        TINYASYNC_TRACE_EVENT(ResumeEnd, -1, coroutine.address());
         // the last coroutine is not always the same as the resume coroutine
     }
 
@@ -9,11 +9,19 @@
 #endif
 
 #include "task.h"
+#include "memory_pool.h"
 #include "io_context.h"
 #include "buffer.h"
 #include "awaiters.h"
 #include "mutex.h"
-#include "dns_resolver.h"
-#include "memory_pool.h"
+#include "buffered_connection.h"
+#include "executor.h"
+#include "dns_resolver.h"
+#include "file.h"
+#include "dns_client.h"
+#include "http.h"
+#include "http_client.h"
+#include "udp.h"
+#include "runtime.h"
 
 #endif // TINYASYNC_H
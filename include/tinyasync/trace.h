@@ -0,0 +1,243 @@
+#ifndef TINYASYNC_TRACE_H
+#define TINYASYNC_TRACE_H
+
+// 二进制事件追踪
+// 定义 TINYASYNC_EVENT_TRACE 后打开, 否则 TINYASYNC_TRACE_EVENT 什么也不做
+// 每个线程一个环形缓冲, 只有本线程写, 不加锁, 不格式化字符串
+// 记录: 时间戳, 事件, fd, 协程/任务地址
+// trace_export_chrome_json() 导出 chrome://tracing 或 Perfetto 能打开的 json
+//
+// TINYASYNC_TRACE 是另一回事, 那是打印字符串的调试日志
+
+#ifdef TINYASYNC_EVENT_TRACE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace tinyasync
+{
+    enum class TraceEvent : uint16_t
+    {
+        // a task from the run queue, B/E pair
+        TaskBegin,
+        TaskEnd,
+        // epoll_wait, fd = number of events at end, B/E pair
+        EpollWaitBegin,
+        EpollWaitEnd,
+        // a coroutine is resumed until it suspends or finishes, B/E pair
+        ResumeBegin,
+        ResumeEnd,
+        // instant events
+        IoEvent,
+        PostTask,
+        DeferTask,
+        WakeupThread,
+        Recv,
+        Send,
+        Accept,
+        Connect,
+        Close,
+        Count,
+    };
+
+    inline char const *trace_event_name(TraceEvent event)
+    {
+        switch (event)
+        {
+        case TraceEvent::TaskBegin:
+        case TraceEvent::TaskEnd: return "task";
+        case TraceEvent::EpollWaitBegin:
+        case TraceEvent::EpollWaitEnd: return "epoll_wait";
+        case TraceEvent::ResumeBegin:
+        case TraceEvent::ResumeEnd: return "resume";
+        case TraceEvent::IoEvent: return "io_event";
+        case TraceEvent::PostTask: return "post_task";
+        case TraceEvent::DeferTask: return "defer_task";
+        case TraceEvent::WakeupThread: return "wakeup_thread";
+        case TraceEvent::Recv: return "recv";
+        case TraceEvent::Send: return "send";
+        case TraceEvent::Accept: return "accept";
+        case TraceEvent::Connect: return "connect";
+        case TraceEvent::Close: return "close";
+        case TraceEvent::Count: break;
+        }
+        return "unknown";
+    }
+
+    // 'B', 'E' or 'i' for chrome trace
+    inline char trace_event_phase(TraceEvent event)
+    {
+        switch (event)
+        {
+        case TraceEvent::TaskBegin:
+        case TraceEvent::EpollWaitBegin:
+        case TraceEvent::ResumeBegin: return 'B';
+        case TraceEvent::TaskEnd:
+        case TraceEvent::EpollWaitEnd:
+        case TraceEvent::ResumeEnd: return 'E';
+        default: return 'i';
+        }
+    }
+
+    // raw ticks, converted to time on export
+    inline uint64_t trace_ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    struct TraceRecord
+    {
+        uint64_t m_ticks;
+        void const *m_ptr;
+        int32_t m_fd;
+        TraceEvent m_event;
+    };
+    static_assert(sizeof(TraceRecord) == 24);
+
+    struct TraceRing
+    {
+        static const std::size_t k_capacity = 1 << 16;
+        static const std::size_t k_mask = k_capacity - 1;
+
+        // only the owner thread writes
+        std::atomic<uint64_t> m_head = 0;
+        uint32_t m_tid;
+        TraceRing *m_next = nullptr;
+        TraceRecord m_records[k_capacity];
+
+        void record(TraceEvent event, int fd, void const *ptr)
+        {
+            uint64_t head = m_head.load(std::memory_order_relaxed);
+            TraceRecord &r = m_records[head & k_mask];
+            r.m_ticks = trace_ticks();
+            r.m_ptr = ptr;
+            r.m_fd = fd;
+            r.m_event = event;
+            m_head.store(head + 1, std::memory_order_release);
+        }
+    };
+
+    struct TraceRegistry
+    {
+        // rings are never freed, so we can export after the threads exit
+        std::atomic<TraceRing *> m_rings = nullptr;
+        std::atomic<uint32_t> m_next_tid = 1;
+        uint64_t m_start_ticks;
+        std::chrono::steady_clock::time_point m_start_time;
+
+        TraceRegistry()
+        {
+            m_start_ticks = trace_ticks();
+            m_start_time = std::chrono::steady_clock::now();
+        }
+
+        TraceRing *new_ring()
+        {
+            TraceRing *ring = new TraceRing();
+            ring->m_tid = m_next_tid.fetch_add(1, std::memory_order_relaxed);
+            TraceRing *head = m_rings.load(std::memory_order_relaxed);
+            do {
+                ring->m_next = head;
+            } while(!m_rings.compare_exchange_weak(head, ring,
+                std::memory_order_release, std::memory_order_relaxed));
+            return ring;
+        }
+
+        static TraceRegistry &instance()
+        {
+            static TraceRegistry registry;
+            return registry;
+        }
+    };
+
+    inline thread_local TraceRing *t_trace_ring = nullptr;
+
+    inline TraceRing *trace_ring_slow()
+    {
+        t_trace_ring = TraceRegistry::instance().new_ring();
+        return t_trace_ring;
+    }
+
+    inline void trace_event(TraceEvent event, int fd, void const *ptr)
+    {
+        TraceRing *ring = t_trace_ring;
+        if(!ring) TINYASYNC_UNLIKELY {
+            ring = trace_ring_slow();
+        }
+        ring->record(event, fd, ptr);
+    }
+
+    // write all rings as chrome trace json
+    // safe to call while other threads are tracing, records overwritten during export are dropped
+    // @return false if the file can't be opened
+    inline bool trace_export_chrome_json(char const *path)
+    {
+        FILE *file = fopen(path, "w");
+        if(!file) {
+            return false;
+        }
+
+        auto &registry = TraceRegistry::instance();
+        // ticks -> microseconds
+        uint64_t now_ticks = trace_ticks();
+        auto now_time = std::chrono::steady_clock::now();
+        double elapsed_us = std::chrono::duration<double, std::micro>(now_time - registry.m_start_time).count();
+        double us_per_tick = now_ticks > registry.m_start_ticks ? elapsed_us / double(now_ticks - registry.m_start_ticks) : 0;
+
+        fprintf(file, "{\"traceEvents\":[\n");
+        bool first = true;
+        std::vector<TraceRecord> records;
+        for(TraceRing *ring = registry.m_rings.load(std::memory_order_acquire); ring; ring = ring->m_next) {
+            uint64_t head = ring->m_head.load(std::memory_order_acquire);
+            uint64_t begin = head > TraceRing::k_capacity ? head - TraceRing::k_capacity : 0;
+            records.clear();
+            for(uint64_t i = begin; i < head; ++i) {
+                records.push_back(ring->m_records[i & TraceRing::k_mask]);
+            }
+            // the writer may have overwritten the oldest records while we copy
+            uint64_t head2 = ring->m_head.load(std::memory_order_acquire);
+            uint64_t valid = head2 > TraceRing::k_capacity ? head2 - TraceRing::k_capacity : 0;
+            std::size_t skip = valid > begin ? std::min<std::size_t>(valid - begin, records.size()) : 0;
+
+            // unmatched 'E' at the beginning makes chrome unhappy
+            int depth[3] = { 0, 0, 0 };
+            for(std::size_t i = skip; i < records.size(); ++i) {
+                auto &r = records[i];
+                char phase = trace_event_phase(r.m_event);
+                int pair = ((int)r.m_event) / 2;
+                if(phase == 'B') {
+                    depth[pair] += 1;
+                } else if(phase == 'E') {
+                    if(depth[pair] == 0) {
+                        continue;
+                    }
+                    depth[pair] -= 1;
+                }
+                double ts = double(r.m_ticks - registry.m_start_ticks) * us_per_tick;
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u%s,\"args\":{\"fd\":%d,\"ptr\":\"%p\"}}",
+                    first ? "" : ",\n", trace_event_name(r.m_event), phase, ts, ring->m_tid,
+                    phase == 'i' ? ",\"s\":\"t\"" : "", (int)r.m_fd, r.m_ptr);
+                first = false;
+            }
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        return true;
+    }
+
+} // namespace tinyasync
+
+#define TINYASYNC_TRACE_EVENT(event, fd, ptr) ::tinyasync::trace_event(::tinyasync::TraceEvent::event, (int)(fd), (void const *)(ptr))
+
+#else
+
+#define TINYASYNC_TRACE_EVENT(event, fd, ptr) ((void)0)
+
+#endif // TINYASYNC_EVENT_TRACE
+
+#endif
@@ -0,0 +1,600 @@
+#ifndef TINYASYNC_UDP_H
+#define TINYASYNC_UDP_H
+
+// UDP socket
+// async_recv_from/async_send_to: 一次一个包 (recvmsg/sendmsg)
+// async_recv_batch/async_send_batch: 一次多个包 (recvmmsg/sendmmsg), 一次系统调用收发一批
+// 和 Connection 一样: 边沿触发, 就绪时在 await_suspend 里直接收发, 不挂起
+// GSO: Datagram::m_segment_size 不为 0 时, 一个大 buffer 由内核切成多个包发出去 (UDP_SEGMENT)
+// GRO: enable_gro() 之后, 内核把同一个流的多个包合并成一个大 buffer 交上来, m_segment_size 是每个包的大小
+// 不是线程安全的, 一个 socket 只在一个线程里用
+
+#include <span>
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace tinyasync
+{
+    struct Datagram
+    {
+        // receive: the buffer to fill, m_size is its capacity
+        // send: the payload
+        void *m_data = nullptr;
+        std::size_t m_size = 0;
+        // receive: bytes received
+        std::size_t m_bytes = 0;
+        // receive: the sender, send: the destination
+        Endpoint m_endpoint;
+        // receive: the datagram was larger than the buffer, the rest is dropped
+        bool m_truncated = false;
+        // send: split the payload into datagrams of this size by the kernel (GSO)
+        // receive: the size of the coalesced datagrams (GRO), the last one may be shorter
+        // 0: one datagram
+        std::size_t m_segment_size = 0;
+
+        // received datagrams in the buffer
+        std::size_t segment_count() const
+        {
+            if(!m_segment_size || m_bytes == 0) {
+                return 1;
+            }
+            return (m_bytes + m_segment_size - 1) / m_segment_size;
+        }
+
+        // the i-th received datagram
+        ConstBuffer segment(std::size_t i) const
+        {
+            if(!m_segment_size) {
+                return ConstBuffer((std::byte const *)m_data, m_bytes);
+            }
+            std::size_t offset = i * m_segment_size;
+            return ConstBuffer((std::byte const *)m_data + offset, std::min(m_segment_size, m_bytes - offset));
+        }
+    };
+
+    // ipv4 max payload
+    static const std::size_t k_udp_max_payload = 65507;
+    // the kernel refuses more segments in one send
+    static const std::size_t k_udp_max_gso_segments = 64;
+    static const std::size_t k_udp_control_size = 64;
+
+    // segments of size segment_size can be sent by one GSO datagram
+    inline std::size_t udp_max_gso_segments(std::size_t segment_size)
+    {
+        return std::max<std::size_t>(1, std::min(k_udp_max_gso_segments, k_udp_max_payload / segment_size));
+    }
+
+    class UdpSocketImpl;
+
+    class TINYASYNC_NODISCARD UdpAwaiter
+    {
+        friend class UdpSocketImpl;
+        friend class UdpSocket;
+
+        ListNode m_node;
+        UdpSocketImpl *m_socket;
+        bool m_send;
+        // batch, or &m_single if nullptr
+        Datagram *m_datagrams;
+        std::size_t m_count;
+        Datagram m_single;
+        // the sender of single receive
+        Endpoint *m_from = nullptr;
+        std::size_t m_result = 0;
+        int m_errno = 0;
+        std::coroutine_handle<TaskPromiseBase> m_suspend_coroutine;
+
+        static UdpAwaiter *from_node(ListNode *node)
+        {
+            return (UdpAwaiter *)((char *)node - offsetof(UdpAwaiter, m_node));
+        }
+
+        // @return false if it would block
+        bool do_io();
+
+    public:
+        UdpAwaiter(UdpSocketImpl &socket, bool send, Datagram *datagrams, std::size_t count)
+            : m_socket(&socket), m_send(send), m_datagrams(datagrams), m_count(count)
+        {
+        }
+
+        bool await_ready();
+
+        template<class Promise>
+        bool await_suspend(std::coroutine_handle<Promise> suspend_coroutine)
+        {
+            return await_suspend(suspend_coroutine.promise().coroutine_handle_base());
+        }
+
+        bool await_suspend(std::coroutine_handle<TaskPromiseBase> h);
+
+        // single: bytes received/sent
+        // batch: datagrams received/sent, at least 1
+        std::size_t await_resume();
+    };
+
+    class UdpSocketImpl
+    {
+        friend class UdpSocket;
+        friend class UdpAwaiter;
+
+        IoCtxBase *m_ctx;
+        NativeSocket m_socket = NULL_SOCKET;
+        Callback m_callback;
+        Queue m_recv_que;
+        Queue m_send_que;
+        bool m_ready_to_recv = true;
+        bool m_ready_to_send = true;
+        // close task is pending
+        bool m_closing = false;
+        // UdpSocket is gone, the close task deletes this
+        bool m_released = false;
+        PostTask m_post_task;
+
+        bool m_gro = false;
+
+        struct alignas(cmsghdr) Control
+        {
+            char m_data[k_udp_control_size];
+        };
+
+        // for recvmmsg/sendmmsg, only used inside one syscall
+        std::vector<mmsghdr> m_msgs;
+        std::vector<iovec> m_iovs;
+        std::vector<sockaddr_storage> m_addrs;
+        std::vector<Control> m_controls;
+
+    public:
+        UdpSocketImpl(IoCtxBase &ctx, Protocol const &protocol) : m_ctx(&ctx)
+        {
+            TINYASYNC_ASSERT(protocol.m_type == SOCK_DGRAM);
+            m_callback.m_callback = on_callback;
+            m_socket = open_socket(protocol);
+
+            epoll_event evt;
+            evt.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            evt.data.ptr = &m_callback;
+            if(epoll_ctl(m_ctx->event_poll_handle(), EPOLL_CTL_ADD, m_socket, &evt) == -1) {
+                auto err = errno;
+                close_socket(m_socket);
+                errno = err;
+                throw_errno("UdpSocket: can't bind socket with epoll");
+            }
+        }
+
+        UdpSocketImpl(UdpSocketImpl const &) = delete;
+        UdpSocketImpl &operator=(UdpSocketImpl const &) = delete;
+
+        ~UdpSocketImpl()
+        {
+            TINYASYNC_ASSERT(!m_recv_que.m_before_head.m_next && !m_send_que.m_before_head.m_next);
+        }
+
+        // close now, pending awaiters are resumed with ENOTSOCK from the run loop
+        void close()
+        {
+            TINYASYNC_ASSERT(m_socket != NULL_SOCKET);
+            epoll_ctl(m_ctx->event_poll_handle(), EPOLL_CTL_DEL, m_socket, NULL);
+            if(close_socket(m_socket) < 0) {
+                throw_errno("UdpSocket: close error");
+            }
+            m_socket = NULL_SOCKET;
+            // epoll events of this socket may be in the current batch
+            // they are handled before the task, so we can't delete this now
+            m_closing = true;
+            m_post_task.set_callback(on_close);
+            m_ctx->defer_task(&m_post_task);
+        }
+
+        void release()
+        {
+            if(m_socket != NULL_SOCKET) {
+                close();
+            }
+            if(m_closing) {
+                m_released = true;
+            } else {
+                delete this;
+            }
+        }
+
+        void prepare_batch(std::size_t count)
+        {
+            if(m_msgs.size() < count) {
+                m_msgs.resize(count);
+                m_iovs.resize(count);
+                m_addrs.resize(count);
+                m_controls.resize(count);
+            }
+        }
+
+        static void on_close(PostTask *posttask)
+        {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+            auto *socket = (UdpSocketImpl *)((char *)posttask - offsetof(UdpSocketImpl, m_post_task));
+#pragma GCC diagnostic pop
+
+            socket->m_closing = false;
+            ListNode *nodes[2] = { socket->m_recv_que.m_before_head.m_next, socket->m_send_que.m_before_head.m_next };
+            socket->m_recv_que.clear();
+            socket->m_send_que.clear();
+            if(socket->m_released) {
+                delete socket;
+            }
+
+            for(auto node : nodes) {
+                while(node) {
+                    auto next = node->m_next;
+                    auto awaiter = UdpAwaiter::from_node(node);
+                    awaiter->m_errno = ENOTSOCK;
+                    TINYASYNC_RESUME(awaiter->m_suspend_coroutine);
+                    node = next;
+                }
+            }
+        }
+
+        // do io for awaiters in order until it would block
+        // the awaiters are resumed at last, they may close the socket
+        void process(Queue &que, bool &ready)
+        {
+            ready = true;
+            ListNode *done = nullptr;
+            ListNode **done_tail = &done;
+            while(ListNode *node = que.m_before_head.m_next) {
+                if(!UdpAwaiter::from_node(node)->do_io()) {
+                    ready = false;
+                    break;
+                }
+                bool empty;
+                que.pop(empty);
+                node->m_next = nullptr;
+                *done_tail = node;
+                done_tail = &node->m_next;
+            }
+
+            while(done) {
+                auto next = done->m_next;
+                TINYASYNC_RESUME(UdpAwaiter::from_node(done)->m_suspend_coroutine);
+                done = next;
+            }
+        }
+
+        static void on_callback(Callback *callback, IoEvent &evt)
+        {
+            TINYASYNC_GUARD("UdpSocket::on_callback(): ");
+            auto *socket = (UdpSocketImpl *)((char *)callback - offsetof(UdpSocketImpl, m_callback));
+            if(socket->m_socket == NULL_SOCKET) {
+                // closed, awaiters are resumed by the close task
+                return;
+            }
+
+            // errors (e.g. ICMP port unreachable) are reported by the syscall of the awaiter
+            int events = evt.events;
+            if(events & (EPOLLIN | EPOLLERR)) {
+                socket->process(socket->m_recv_que, socket->m_ready_to_recv);
+            }
+            // the resumed receivers may close it, but the deletion is deferred
+            if((events & (EPOLLOUT | EPOLLERR)) && socket->m_socket != NULL_SOCKET) {
+                socket->process(socket->m_send_que, socket->m_ready_to_send);
+            }
+        }
+    };
+
+    // UDP_SEGMENT on send, UDP_GRO on receive
+    inline void udp_set_control(msghdr &msg, char *control, bool send, Datagram const &dg, bool gro)
+    {
+        if(send) {
+            if(!dg.m_segment_size) {
+                return;
+            }
+            msg.msg_control = control;
+            msg.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment_size = dg.m_segment_size;
+            memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+        } else if(gro) {
+            msg.msg_control = control;
+            msg.msg_controllen = k_udp_control_size;
+        }
+    }
+
+    // segment size of coalesced datagrams, 0 if not coalesced
+    inline std::size_t udp_gro_segment_size(msghdr &msg)
+    {
+        for(cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                int segment_size;
+                memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+                return (std::size_t)segment_size;
+            }
+        }
+        return 0;
+    }
+
+    inline bool UdpAwaiter::do_io()
+    {
+        auto socket = m_socket;
+        NativeSocket fd = socket->m_socket;
+        Datagram *dgs = m_datagrams ? m_datagrams : &m_single;
+        bool gro = socket->m_gro;
+
+        for(;;) {
+            ssize_t ret;
+            if(m_count == 1) {
+                sockaddr_storage addr;
+                alignas(cmsghdr) char control[k_udp_control_size];
+                iovec iov = { dgs->m_data, dgs->m_size };
+                msghdr msg = {};
+                msg.msg_name = &addr;
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                udp_set_control(msg, control, m_send, *dgs, gro);
+                if(m_send) {
+                    msg.msg_namelen = endpoint_to_sockaddr(dgs->m_endpoint, addr);
+                    ret = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+                    TINYASYNC_TRACE_EVENT(Send, fd, this);
+                    if(ret >= 0) {
+                        m_result = m_datagrams ? 1 : (std::size_t)ret;
+                    }
+                } else {
+                    msg.msg_namelen = sizeof(addr);
+                    ret = ::recvmsg(fd, &msg, 0);
+                    TINYASYNC_TRACE_EVENT(Recv, fd, this);
+                    if(ret >= 0) {
+                        dgs->m_bytes = (std::size_t)ret;
+                        dgs->m_endpoint = endpoint_from_sockaddr(addr);
+                        dgs->m_truncated = msg.msg_flags & MSG_TRUNC;
+                        dgs->m_segment_size = gro ? udp_gro_segment_size(msg) : 0;
+                        m_result = m_datagrams ? 1 : (std::size_t)ret;
+                    }
+                }
+            } else {
+                socket->prepare_batch(m_count);
+                auto msgs = socket->m_msgs.data();
+                auto iovs = socket->m_iovs.data();
+                auto addrs = socket->m_addrs.data();
+                auto controls = socket->m_controls.data();
+                for(std::size_t i = 0; i < m_count; ++i) {
+                    iovs[i] = { dgs[i].m_data, dgs[i].m_size };
+                    auto &msg = msgs[i].msg_hdr;
+                    msg = {};
+                    msg.msg_name = &addrs[i];
+                    msg.msg_namelen = m_send ? endpoint_to_sockaddr(dgs[i].m_endpoint, addrs[i]) : sizeof(sockaddr_storage);
+                    msg.msg_iov = &iovs[i];
+                    msg.msg_iovlen = 1;
+                    udp_set_control(msg, controls[i].m_data, m_send, dgs[i], gro);
+                }
+                if(m_send) {
+                    ret = ::sendmmsg(fd, msgs, (unsigned)m_count, MSG_NOSIGNAL);
+                    TINYASYNC_TRACE_EVENT(Send, fd, this);
+                } else {
+                    // the socket is nonblocking, returns what are queued
+                    ret = ::recvmmsg(fd, msgs, (unsigned)m_count, 0, nullptr);
+                    TINYASYNC_TRACE_EVENT(Recv, fd, this);
+                    for(ssize_t i = 0; i < ret; ++i) {
+                        dgs[i].m_bytes = msgs[i].msg_len;
+                        dgs[i].m_endpoint = endpoint_from_sockaddr(addrs[i]);
+                        dgs[i].m_truncated = msgs[i].msg_hdr.msg_flags & MSG_TRUNC;
+                        dgs[i].m_segment_size = gro ? udp_gro_segment_size(msgs[i].msg_hdr) : 0;
+                    }
+                }
+                if(ret >= 0) {
+                    m_result = (std::size_t)ret;
+                }
+            }
+
+            if(ret >= 0) {
+                return true;
+            }
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            }
+            m_errno = errno;
+            return true;
+        }
+    }
+
+    inline bool UdpAwaiter::await_ready()
+    {
+        if(m_socket->m_socket == NULL_SOCKET) {
+            m_errno = ENOTSOCK;
+            return true;
+        }
+        return m_count == 0;
+    }
+
+    inline bool UdpAwaiter::await_suspend(std::coroutine_handle<TaskPromiseBase> h)
+    {
+        auto socket = m_socket;
+        auto &que = m_send ? socket->m_send_que : socket->m_recv_que;
+        bool &ready = m_send ? socket->m_ready_to_send : socket->m_ready_to_recv;
+        // keep the order of awaiters
+        if(ready && !que.m_before_head.m_next) {
+            if(do_io()) {
+                return false;
+            }
+            ready = false;
+        }
+        m_suspend_coroutine = h;
+        que.push(&m_node);
+        return true;
+    }
+
+    inline std::size_t UdpAwaiter::await_resume()
+    {
+        if(m_errno) {
+            errno = m_errno;
+            throw_errno(m_send ? "UdpSocket: send error" : "UdpSocket: recv error");
+        }
+        if(m_from) {
+            *m_from = m_single.m_endpoint;
+        }
+        return m_result;
+    }
+
+    class UdpSocket
+    {
+        UdpSocketImpl *m_impl = nullptr;
+
+    public:
+        UdpSocket() = default;
+
+        // not bound, the first send binds it to an ephemeral port
+        UdpSocket(IoContext &ctx, Protocol const &protocol)
+        {
+            m_impl = new UdpSocketImpl(*ctx.get_io_ctx_base(), protocol);
+        }
+
+        UdpSocket(IoContext &ctx, Protocol const &protocol, Endpoint const &endpoint) : UdpSocket(ctx, protocol)
+        {
+            try {
+                bind(endpoint);
+            } catch(...) {
+                m_impl->release();
+                throw;
+            }
+        }
+
+        UdpSocket(UdpSocket &&r) : m_impl(std::exchange(r.m_impl, nullptr))
+        {
+        }
+
+        UdpSocket &operator=(UdpSocket &&r)
+        {
+            UdpSocket tmp(std::move(r));
+            std::swap(m_impl, tmp.m_impl);
+            return *this;
+        }
+
+        ~UdpSocket()
+        {
+            if(m_impl) {
+                m_impl->release();
+            }
+        }
+
+        NativeSocket native_handle() const
+        {
+            return m_impl->m_socket;
+        }
+
+        void bind(Endpoint const &endpoint)
+        {
+            int on = 1;
+            ::setsockopt(m_impl->m_socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            bind_socket(m_impl->m_socket, endpoint);
+        }
+
+        // the bound address, e.g. the port after binding port 0
+        Endpoint local_endpoint() const
+        {
+            sockaddr_storage addr;
+            socklen_t len = sizeof(addr);
+            if(::getsockname(m_impl->m_socket, (sockaddr *)&addr, &len) == -1) {
+                throw_errno("UdpSocket: getsockname failed");
+            }
+            return endpoint_from_sockaddr(addr, len);
+        }
+
+        // the kernel drops datagrams when the receive buffer is full
+        void set_recv_buffer_size(int bytes)
+        {
+            if(::setsockopt(m_impl->m_socket, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) == -1) {
+                throw_errno("UdpSocket: can't set SO_RCVBUF");
+            }
+        }
+
+        void set_send_buffer_size(int bytes)
+        {
+            if(::setsockopt(m_impl->m_socket, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes)) == -1) {
+                throw_errno("UdpSocket: can't set SO_SNDBUF");
+            }
+        }
+
+        // coalesce received datagrams of a flow into one buffer, see Datagram::m_segment_size
+        // the receive buffers should be k_udp_max_payload bytes, or datagrams are truncated
+        // @return false if the kernel doesn't support it
+        bool enable_gro(bool on = true)
+        {
+            int value = on;
+            if(::setsockopt(m_impl->m_socket, SOL_UDP, UDP_GRO, &value, sizeof(value)) == -1) {
+                return false;
+            }
+            m_impl->m_gro = on;
+            return true;
+        }
+
+        bool is_closed() const
+        {
+            return !m_impl || m_impl->m_socket == NULL_SOCKET;
+        }
+
+        void close()
+        {
+            m_impl->close();
+        }
+
+        // @return bytes received, from is set to the sender
+        UdpAwaiter async_recv_from(void *buffer, std::size_t bytes, Endpoint &from)
+        {
+            UdpAwaiter awaiter(*m_impl, false, nullptr, 1);
+            awaiter.m_single.m_data = buffer;
+            awaiter.m_single.m_size = bytes;
+            awaiter.m_from = &from;
+            return awaiter;
+        }
+
+        // @return bytes sent
+        UdpAwaiter async_send_to(void const *buffer, std::size_t bytes, Endpoint const &to)
+        {
+            UdpAwaiter awaiter(*m_impl, true, nullptr, 1);
+            awaiter.m_single.m_data = (void *)buffer;
+            awaiter.m_single.m_size = bytes;
+            awaiter.m_single.m_endpoint = to;
+            return awaiter;
+        }
+
+        // send bytes as datagrams of segment_size by one syscall (GSO)
+        // at most udp_max_gso_segments(segment_size) segments
+        // @return bytes sent
+        UdpAwaiter async_send_segments(void const *buffer, std::size_t bytes, std::size_t segment_size, Endpoint const &to)
+        {
+            UdpAwaiter awaiter = async_send_to(buffer, bytes, to);
+            // a single segment is a plain datagram
+            awaiter.m_single.m_segment_size = bytes > segment_size ? segment_size : 0;
+            return awaiter;
+        }
+
+        // @return datagrams received, at least 1
+        // the datagrams must be alive until resumed
+        UdpAwaiter async_recv_batch(std::span<Datagram> datagrams)
+        {
+            return { *m_impl, false, datagrams.data(), datagrams.size() };
+        }
+
+        // @return datagrams sent, at least 1, may be less than datagrams.size()
+        UdpAwaiter async_send_batch(std::span<Datagram> datagrams)
+        {
+            return { *m_impl, true, datagrams.data(), datagrams.size() };
+        }
+    };
+
+} // namespace tinyasync
+
+#endif